@@ -0,0 +1,911 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Micro-benchmarks for the parser. Build with optimizations, e.g.
+ *
+ *     cmake -S . -B build -DCMAKE_BUILD_TYPE=Release
+ *     cmake --build build --target bench_nbt
+ *     ./build/bench_nbt
+ */
+
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_cache.hpp"
+#include "nbt_document.hpp"
+#include "nbt_events.hpp"
+#include "nbt_inflate.hpp"
+#include "nbt_lazy.hpp"
+#include "nbt_names.hpp"
+#include "nbt_parallel.hpp"
+#include "nbt_query.hpp"
+#include "nbt_region.hpp"
+#include "nbt_schema.hpp"
+#include "nbt_tape.hpp"
+#include "nbt_value.hpp"
+#include "nbt_world.hpp"
+#include "nbt_writer.hpp"
+
+
+/**
+ * Runs f repeatedly for about half a second and prints its time per call, and
+ * its throughput if it processes bytes bytes of input per call.
+ */
+template <typename F>
+static void bench(const char* name, size_t bytes, F f) {
+  using clock = std::chrono::steady_clock;
+  // warm up
+  f();
+  size_t iterations = 0;
+  auto start = clock::now();
+  auto elapsed = clock::duration{0};
+  while (elapsed < std::chrono::milliseconds{500}) {
+    f();
+    iterations++;
+    elapsed = clock::now() - start;
+  }
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  double nsPerCall = seconds * 1e9 / iterations;
+  double mbPerSecond = bytes * iterations / seconds / (1 << 20);
+  if (bytes > 0) {
+    std::printf("%-48s %12.1f ns/call %10.1f MiB/s\n", name, nsPerCall, mbPerSecond);
+  }
+  else {
+    std::printf("%-48s %12.1f ns/call\n", name, nsPerCall);
+  }
+}
+
+/**
+ * Serializes a nameless array tag of count big-endian elements of type T.
+ */
+template <typename T>
+static std::vector<uint8_t> makeArray(TagID id, int32_t count) {
+  std::vector<uint8_t> bytes{static_cast<uint8_t>(id), 0x00, 0x00};
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    bytes.push_back(static_cast<uint8_t>(count >> shift));
+  }
+  for (int32_t i = 0; i < count; i++) {
+    uint64_t value = static_cast<uint64_t>(i) * 0x0101010101010101ull;
+    for (int shift = (sizeof(T) - 1) * 8; shift >= 0; shift -= 8) {
+      bytes.push_back(static_cast<uint8_t>(value >> shift));
+    }
+  }
+  return bytes;
+}
+
+/**
+ * The array decoding the parser used to do: one read and one push_back per
+ * element, then a by-value swap of the whole vector.
+ */
+template <typename T>
+static T readArrayPerElement(BufferInput& input) {
+  char id = 0;
+  int16_t nameSize = 0;
+  int32_t size = 0;
+  if (!input.read(&id, sizeof(id)) || !input.read(&nameSize, sizeof(nameSize)) ||
+      !input.read(&size, sizeof(size))) {
+    throw NBTException{"Unexpectedly reached end of file while reading array"};
+  }
+  size = IntTag::ftoh(size);
+  typename T::type values;
+  typename T::type::value_type value{};
+  for (int32_t i = 0; i < size; i++) {
+    if (!input.read(&value, sizeof(value))) {
+      throw NBTException{"Unexpectedly reached end of file while reading array"};
+    }
+    values.push_back(value);
+  }
+  typename T::type copy = values;
+  return T{"", T::ftoh(copy)};
+}
+
+template <typename T>
+static void benchArrays(const char* label, TagID id, int32_t count) {
+  std::vector<uint8_t> bytes = makeArray<typename T::type::value_type>(id, count);
+  char name[64];
+
+  std::snprintf(name, sizeof(name), "%s[%d] per-element", label, count);
+  bench(name, bytes.size(), [&]() {
+    BufferInput input{bytes};
+    volatile size_t sink = readArrayPerElement<T>(input).size();
+    (void) sink;
+  });
+
+  std::snprintf(name, sizeof(name), "%s[%d] bulk", label, count);
+  bench(name, bytes.size(), [&]() {
+    NBTReader reader{BufferInput{bytes}};
+    reader.readID();
+    volatile size_t sink = reader.template readTag<T>().size();
+    (void) sink;
+  });
+}
+
+/**
+ * Compares the dispatched swapInPlace kernel with a plain scalar loop.
+ */
+template <typename T>
+static void benchSwap(const char* label, size_t count) {
+  std::vector<T> values(count, 0x0102030405060708ull & ~T{0});
+  char name[64];
+
+  std::snprintf(name, sizeof(name), "%s[%zu] scalar", label, count);
+  bench(name, count * sizeof(T), [&]() {
+    for (T& value : values) {
+      if constexpr (sizeof(T) == 4) {
+        value = __builtin_bswap32(value);
+      }
+      else {
+        value = __builtin_bswap64(value);
+      }
+    }
+    asm volatile("" : : "r"(values.data()) : "memory");
+  });
+
+  std::snprintf(name, sizeof(name), "%s[%zu] swapInPlace", label, count);
+  bench(name, count * sizeof(T), [&]() {
+    swapInPlace(values.data(), values.size());
+    asm volatile("" : : "r"(values.data()) : "memory");
+  });
+}
+
+/**
+ * Appends big-endian NBT to a byte vector, for building benchmark input.
+ */
+class Emitter {
+  public:
+    std::vector<uint8_t> bytes;
+
+    void number(uint64_t value, int size) {
+      for (int shift = (size - 1) * 8; shift >= 0; shift -= 8) {
+        bytes.push_back(static_cast<uint8_t>(value >> shift));
+      }
+    }
+
+    void string(const std::string& str) {
+      number(str.size(), 2);
+      bytes.insert(bytes.end(), str.begin(), str.end());
+    }
+
+    void header(TagID id, const std::string& name) {
+      bytes.push_back(static_cast<uint8_t>(id));
+      string(name);
+    }
+
+    void end() {
+      bytes.push_back(0);
+    }
+};
+
+/**
+ * A chunk shaped roughly like a real one: some scalars, sections with
+ * palettes and block states, and a list of entities.
+ */
+static std::vector<uint8_t> makeChunk(int sections = 16, int entities = 32) {
+  Emitter e;
+  e.header(TagID::COMPOUND, "");
+  e.header(TagID::INT, "DataVersion");
+  e.number(2586, 4);
+  e.header(TagID::COMPOUND, "Level");
+  e.header(TagID::INT, "xPos");
+  e.number(12, 4);
+  e.header(TagID::INT, "zPos");
+  e.number(static_cast<uint32_t>(-7), 4);
+  e.header(TagID::LONG, "LastUpdate");
+  e.number(123456789, 8);
+  e.header(TagID::STRING, "Status");
+  e.string("full");
+  e.header(TagID::COMPOUND, "Heightmaps");
+  for (const char* name : {"MOTION_BLOCKING", "OCEAN_FLOOR", "WORLD_SURFACE"}) {
+    e.header(TagID::LONG_ARRAY, name);
+    e.number(37, 4);
+    for (int i = 0; i < 37; i++) {
+      e.number(0x0123456789abcdefull * i, 8);
+    }
+  }
+  e.end();
+  e.header(TagID::LIST, "Sections");
+  e.bytes.push_back(static_cast<uint8_t>(TagID::COMPOUND));
+  e.number(sections, 4);
+  for (int s = 0; s < sections; s++) {
+    e.header(TagID::BYTE, "Y");
+    e.bytes.push_back(static_cast<uint8_t>(s));
+    e.header(TagID::LIST, "Palette");
+    e.bytes.push_back(static_cast<uint8_t>(TagID::COMPOUND));
+    e.number(8, 4);
+    for (int p = 0; p < 8; p++) {
+      e.header(TagID::STRING, "Name");
+      e.string("minecraft:block_" + std::to_string(p));
+      e.end();
+    }
+    e.header(TagID::LONG_ARRAY, "BlockStates");
+    e.number(256, 4);
+    for (int i = 0; i < 256; i++) {
+      e.number(0x1111111111111111ull * (i % 15), 8);
+    }
+    e.header(TagID::BYTE_ARRAY, "BlockLight");
+    e.number(2048, 4);
+    e.bytes.insert(e.bytes.end(), 2048, 0x0f);
+    e.end();
+  }
+  e.header(TagID::LIST, "Entities");
+  e.bytes.push_back(static_cast<uint8_t>(TagID::COMPOUND));
+  e.number(entities, 4);
+  for (int n = 0; n < entities; n++) {
+    e.header(TagID::STRING, "id");
+    e.string("minecraft:cow");
+    e.header(TagID::LIST, "Pos");
+    e.bytes.push_back(static_cast<uint8_t>(TagID::DOUBLE));
+    e.number(3, 4);
+    for (int i = 0; i < 3; i++) {
+      double d = n * 1.5 + i;
+      uint64_t bits;
+      std::memcpy(&bits, &d, sizeof(bits));
+      e.number(bits, 8);
+    }
+    e.header(TagID::SHORT, "Health");
+    e.number(10, 2);
+    e.header(TagID::INT_ARRAY, "UUID");
+    e.number(4, 4);
+    for (int i = 0; i < 4; i++) {
+      e.number(n * 4 + i, 4);
+    }
+    e.end();
+  }
+  e.end();
+  e.end();
+  return e.bytes;
+}
+
+static void benchTrees() {
+  std::vector<uint8_t> chunk = makeChunk();
+
+  bench("chunk CompoundTag", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    reader.readID();
+    volatile size_t sink = reader.readCompoundTag().size();
+    (void) sink;
+  });
+
+  bench("chunk Value", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    volatile size_t sink = readNamedValue(reader).second.compound().members.size();
+    (void) sink;
+  });
+
+  bench("chunk skipTag", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    volatile size_t sink = reader.skipTag(reader.readID());
+    (void) sink;
+  });
+
+  Document doc;
+  bench("chunk Document (reused)", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    doc.read(reader);
+    volatile size_t sink = doc.root().size();
+    (void) sink;
+  });
+
+  bench("chunk Document (reused, borrowed)", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    doc.read(reader, true);
+    volatile size_t sink = doc.root().size();
+    (void) sink;
+  });
+
+  Document interned;
+  interned.setNameTable(std::make_shared<NameTable>());
+  bench("chunk Document (reused, interned)", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    interned.read(reader);
+    volatile size_t sink = interned.root().size();
+    (void) sink;
+  });
+  {
+    NBTReader reader{BufferInput{chunk}};
+    doc.read(reader);
+    std::printf("%-48s %12zu bytes, %zu interned\n", "chunk Document arena use, copied names",
+                doc.arena().bytesUsed(), interned.arena().bytesUsed());
+  }
+
+  std::string_view status = interned.nameTable()->intern("Status");
+  const Node& level = *interned.root().find("Level");
+  bench("chunk Level find(\"Status\")", 0, [&]() {
+    volatile const Node* sink = level.find("Status");
+    (void) sink;
+  });
+  bench("chunk Level findInterned(\"Status\")", 0, [&]() {
+    volatile const Node* sink = level.findInterned(status);
+    (void) sink;
+  });
+
+  Tape tape;
+  bench("chunk Tape (reused)", chunk.size(), [&]() {
+    tape.parse(chunk.data(), chunk.size());
+    volatile size_t sink = tape.size();
+    (void) sink;
+  });
+
+  // Touch every tag once, the way an analytics pass would.
+  std::function<int64_t(const Node&)> sumNodes = [&](const Node& node) {
+    int64_t sum = static_cast<int64_t>(node.id());
+    for (const Node& child : node) {
+      sum += sumNodes(child);
+    }
+    return sum;
+  };
+  bench("chunk Document parse + walk", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    doc.read(reader, true);
+    volatile int64_t sink = sumNodes(doc.root());
+    (void) sink;
+  });
+  bench("chunk Tape parse + walk", chunk.size(), [&]() {
+    tape.parse(chunk.data(), chunk.size());
+    int64_t sum = 0;
+    for (size_t i = 0; i < tape.size(); i++) {
+      sum += static_cast<int64_t>(tape.entry(i).id());
+    }
+    volatile int64_t sink = sum;
+    (void) sink;
+  });
+
+  // Walking an already-decoded tree: compounds and lists of compounds, the
+  // way code looking for entities or sections does.
+  NBTReader treeReader{BufferInput{chunk}};
+  treeReader.readID();
+  CompoundTag tree = treeReader.readCompoundTag();
+  std::function<int64_t(const TagBase&)> sumTags = [&](const TagBase& tag) {
+    int64_t sum = static_cast<int64_t>(tag.id());
+    if (tag.id() == TagID::COMPOUND) {
+      for (const std::shared_ptr<TagBase>& child : static_cast<const CompoundTag&>(tag).value()) {
+        sum += sumTags(*child);
+      }
+    }
+    else if (auto list = dynamic_cast<const ListTag<CompoundTag>*>(&tag)) {
+      for (const CompoundTag& element : list->value()) {
+        sum += sumTags(element);
+      }
+    }
+    return sum;
+  };
+  bench("chunk CompoundTag walk", chunk.size(), [&]() {
+    volatile int64_t sink = sumTags(tree);
+    (void) sink;
+  });
+
+  NBTReader valueReader{BufferInput{chunk}};
+  Value value = readNamedValue(valueReader).second;
+  std::function<int64_t(const Value&)> sumValues = [&](const Value& value) {
+    return value.visit([&](const auto& v) {
+      using V = std::decay_t<decltype(v)>;
+      int64_t sum = static_cast<int64_t>(value.id());
+      if constexpr (std::is_same<V, ValueCompound>::value) {
+        for (const ValueCompound::Member& member : v.members) {
+          sum += sumValues(member.second);
+        }
+      }
+      else if constexpr (std::is_same<V, ValueList>::value) {
+        if (v.elementID == TagID::COMPOUND) {
+          for (const Value& element : v.elements) {
+            sum += sumValues(element);
+          }
+        }
+      }
+      return sum;
+    });
+  };
+  bench("chunk Value walk", chunk.size(), [&]() {
+    volatile int64_t sink = sumValues(value);
+    (void) sink;
+  });
+  if (sumTags(tree) != sumValues(value)) {
+    std::printf("Tree walks disagree\n");
+  }
+}
+
+/**
+ * Pulls three fields out of a chunk, which is all most queries need.
+ */
+static void benchLazy() {
+  std::vector<uint8_t> chunk = makeChunk();
+
+  bench("chunk 3 fields, CompoundTag", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    reader.readID();
+    CompoundTag root = reader.readCompoundTag();
+    std::shared_ptr<CompoundTag> level = root.get<CompoundTag>("Level");
+    volatile int64_t sink = level->get<IntTag>("xPos")->value() +
+                            level->get<IntTag>("zPos")->value() +
+                            level->get<StringTag>("Status")->value().size();
+    (void) sink;
+  });
+
+  bench("chunk 3 fields, LazyCompound", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    reader.readID();
+    LazyCompound root = readLazyCompound(reader);
+    const LazyCompound* level = root.compound("Level");
+    volatile int64_t sink = level->get<IntTag>("xPos")->value() +
+                            level->get<IntTag>("zPos")->value() +
+                            level->get<StringTag>("Status")->value().size();
+    (void) sink;
+  });
+
+  // Bumping LastUpdate and saving, as a server does for every loaded chunk
+  NBTWriter writer;
+  bench("chunk edit 1 field, CompoundTag rewrite", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    reader.readID();
+    CompoundTag root = reader.readCompoundTag();
+    root.get<CompoundTag>("Level")->get<LongTag>("LastUpdate")->value()++;
+    writer.clear();
+    writer.writeTag(root);
+    volatile size_t sink = writer.size();
+    (void) sink;
+  });
+
+  bench("chunk edit 1 field, LazyCompound rewrite", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    reader.readID();
+    LazyCompound root = readLazyCompound(reader);
+    root.editCompound("Level")->edit<LongTag>("LastUpdate")->value()++;
+    writer.clear();
+    root.write(writer);
+    volatile size_t sink = writer.size();
+    (void) sink;
+  });
+}
+
+/**
+ * Extracts every section's block states, as a dashboard would.
+ */
+static void benchQuery() {
+  std::vector<uint8_t> chunk = makeChunk();
+
+  bench("chunk BlockStates, CompoundTag", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    reader.readID();
+    CompoundTag root = reader.readCompoundTag();
+    auto sections = root.get<CompoundTag>("Level")->get<ListTag<CompoundTag>>("Sections");
+    size_t sum = 0;
+    for (CompoundTag& section : sections->value()) {
+      sum += section.get<LongArrayTag>("BlockStates")->value().size();
+    }
+    volatile size_t sink = sum;
+    (void) sink;
+  });
+
+  Query query{"Level.Sections[*].BlockStates"};
+  bench("chunk BlockStates, Query", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    size_t sum = 0;
+    query.run(reader, [&](size_t, std::shared_ptr<TagBase> tag) {
+      sum += std::static_pointer_cast<LongArrayTag>(tag)->value().size();
+    });
+    volatile size_t sink = sum;
+    (void) sink;
+  });
+}
+
+/**
+ * Counts the tags of each type, touching every array element.
+ */
+struct TagCounter : NBTVisitor {
+  using NBTVisitor::value;
+  using NBTVisitor::array;
+
+  void beginCompound(std::string_view) {
+    compounds++;
+  }
+
+  template <typename T>
+  void value(std::string_view, T) {
+    values++;
+  }
+
+  void array(std::string_view, ArrayRef<int64_t> longs) {
+    for (int64_t l : longs) {
+      sum += l;
+    }
+  }
+
+  size_t compounds = 0;
+  size_t values = 0;
+  int64_t sum = 0;
+};
+
+static void benchEvents() {
+  std::vector<uint8_t> chunk = makeChunk();
+
+  EventParser parser;
+  bench("chunk EventParser, count tags", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    TagCounter counter;
+    parser.parse(reader, counter);
+    volatile int64_t sink = counter.sum + counter.values + counter.compounds;
+    (void) sink;
+  });
+}
+
+static void benchWriter() {
+  std::vector<uint8_t> chunk = makeChunk();
+  NBTReader reader{BufferInput{chunk}};
+  reader.readID();
+  CompoundTag root = reader.readCompoundTag();
+
+  NBTWriter writer;
+  bench("chunk NBTWriter, CompoundTag", chunk.size(), [&]() {
+    writer.clear();
+    writer.writeTag(root);
+    volatile size_t sink = writer.size();
+    (void) sink;
+  });
+
+  NBTWriter gathering;
+  gathering.setGatherThreshold(1024);
+  bench("chunk NBTWriter, CompoundTag, gathered", chunk.size(), [&]() {
+    gathering.clear();
+    gathering.writeTag(root);
+    volatile size_t sink = gathering.segments().size();
+    (void) sink;
+  });
+
+  std::vector<int64_t> blockStates(256);
+  std::vector<int8_t> blockLight(2048, 0x0f);
+  // Sections only, so smaller than the chunk
+  auto build = [&]() {
+    writer.clear();
+    writer.beginCompound("");
+    writer.writeInt("DataVersion", 2586);
+    writer.beginCompound("Level");
+    writer.beginList("Sections", TagID::COMPOUND, 16);
+    for (int s = 0; s < 16; s++) {
+      writer.beginCompound("");
+      writer.writeByte("Y", static_cast<int8_t>(s));
+      writer.writeLongArray("BlockStates", blockStates.data(), blockStates.size());
+      writer.writeByteArray("BlockLight", blockLight.data(), blockLight.size());
+      writer.endCompound();
+    }
+    writer.endList();
+    writer.endCompound();
+    writer.endCompound();
+  };
+  build();
+  bench("chunk NBTWriter, builder", writer.size(), build);
+}
+
+/**
+ * Parses a zlib-compressed chunk, the way chunks are stored in region files.
+ */
+static void benchInflate() {
+  std::vector<uint8_t> chunk = makeChunk();
+  std::vector<uint8_t> compressed(compressBound(chunk.size()));
+  uLongf compressedSize = compressed.size();
+  compress(compressed.data(), &compressedSize, chunk.data(), chunk.size());
+  compressed.resize(compressedSize);
+
+  std::vector<uint8_t> inflated(chunk.size());
+  bench("chunk zlib, uncompress then Document", chunk.size(), [&]() {
+    uLongf size = inflated.size();
+    uncompress(inflated.data(), &size, compressed.data(), compressed.size());
+    NBTReader reader{BufferInput{inflated.data(), size}};
+    volatile size_t sink = readDocument(reader).root().size();
+    (void) sink;
+  });
+
+  bench("chunk zlib, InflateInput to Document", chunk.size(), [&]() {
+    NBTReader reader{InflateInput{compressed.data(), compressed.size()}};
+    volatile size_t sink = readDocument(reader).root().size();
+    (void) sink;
+  });
+}
+
+/**
+ * Scans a generated world of 8 full regions with more and more threads.
+ */
+static void benchWorld() {
+  namespace fs = std::filesystem;
+  std::vector<uint8_t> chunk = makeChunk();
+  std::vector<uint8_t> compressed(compressBound(chunk.size()));
+  uLongf compressedSize = compressed.size();
+  compress(compressed.data(), &compressedSize, chunk.data(), chunk.size());
+  compressed.resize(compressedSize);
+
+  // Every chunk is the same, so every region file is too.
+  size_t sectors = (compressedSize + 5 + RegionFile::SECTOR_SIZE - 1) / RegionFile::SECTOR_SIZE;
+  std::vector<uint8_t> region(RegionFile::HEADER_SIZE +
+                              RegionFile::CHUNKS * sectors * RegionFile::SECTOR_SIZE);
+  for (int i = 0; i < RegionFile::CHUNKS; i++) {
+    uint32_t offset = static_cast<uint32_t>(2 + i * sectors);
+    uint32_t entry = offset << 8 | static_cast<uint32_t>(sectors);
+    uint32_t length = static_cast<uint32_t>(compressedSize + 1);
+    uint8_t* data = region.data() + offset * RegionFile::SECTOR_SIZE;
+    for (int b = 0; b < 4; b++) {
+      region[i * 4 + b] = static_cast<uint8_t>(entry >> (24 - 8 * b));
+      data[b] = static_cast<uint8_t>(length >> (24 - 8 * b));
+    }
+    data[4] = RegionFile::ZLIB;
+    std::memcpy(data + 5, compressed.data(), compressedSize);
+  }
+
+  char temp[] = "/tmp/nbt_bench_world_XXXXXX";
+  if (mkdtemp(temp) == nullptr) {
+    return;
+  }
+  fs::path world{temp};
+  fs::create_directories(world / "region");
+  for (int i = 0; i < 8; i++) {
+    std::string name = "r." + std::to_string(i % 4) + "." + std::to_string(i / 4) + ".mca";
+    std::ofstream file{world / "region" / name, std::ios_base::out | std::ios_base::binary};
+    file.write(reinterpret_cast<const char*>(region.data()), region.size());
+  }
+  std::vector<std::string> regions = findRegionFiles(world.string());
+  size_t bytes = regions.size() * RegionFile::CHUNKS * chunk.size();
+
+  std::vector<unsigned> threadCounts{1, 2, 4};
+  unsigned cores = std::thread::hardware_concurrency();
+  if (cores > 4) {
+    threadCounts.push_back(cores);
+  }
+  for (unsigned threads : threadCounts) {
+    WorldScanner scanner{threads};
+    std::string label = "world 8192 chunks, " + std::to_string(threads) + " threads";
+    bench(label.c_str(), bytes, [&]() {
+      volatile size_t sink = scanner.scan(regions, [](const ChunkInfo&, const Document&) { }).chunks;
+      (void) sink;
+    });
+  }
+  fs::remove_all(world);
+}
+
+/**
+ * Fetches a chunk from a region file, parsing it every time or through a
+ * ChunkCache.
+ */
+static void benchCache() {
+  std::vector<uint8_t> chunk = makeChunk();
+  NBTReader reader{BufferInput{chunk}};
+  reader.readID();
+  CompoundTag root = reader.readCompoundTag();
+
+  char path[] = "/tmp/nbt_bench_cache_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return;
+  }
+  close(fd);
+  {
+    RegionWriter writer{path};
+    writer.writeChunk(3, 7, root);
+  }
+
+  RegionFile region{path};
+  bench("region chunk, parse every time", chunk.size(), [&]() {
+    NBTReader chunkReader = region.openChunk(3, 7);
+    volatile size_t sink = readDocument(chunkReader).root().size();
+    (void) sink;
+  });
+
+  ChunkCache cache{64 << 20};
+  std::string name{path};
+  bench("region chunk, ChunkCache hit", chunk.size(), [&]() {
+    volatile size_t sink = cache.get(name, 3, 7)->root().size();
+    (void) sink;
+  });
+  unlink(path);
+}
+
+/**
+ * Decodes a large entity list serially and on pools of more and more
+ * threads.
+ */
+static void benchParallelList() {
+  NBTWriter writer;
+  writer.writeID(TagID::LIST);
+  writer.writeName("Entities");
+  writer.writeID(TagID::COMPOUND);
+  int32_t count = 10000;
+  writer.writeNumber<int32_t>(count);
+  for (int32_t i = 0; i < count; i++) {
+    writer.writeString("id", "minecraft:cow");
+    writer.beginList("Pos", TagID::DOUBLE, 3);
+    for (int j = 0; j < 3; j++) {
+      writer.writeDouble("", i + j * 0.5);
+    }
+    writer.endList();
+    writer.beginList("Motion", TagID::DOUBLE, 3);
+    for (int j = 0; j < 3; j++) {
+      writer.writeDouble("", 0.0);
+    }
+    writer.endList();
+    writer.writeFloat("Health", 10.0f);
+    writer.writeShort("Air", 300);
+    writer.writeByte("OnGround", 1);
+    int32_t uuid[4] = {i, i + 1, i + 2, i + 3};
+    writer.writeIntArray("UUID", uuid, 4);
+    writer.writeID(TagID::END);
+  }
+  std::vector<char> bytes{writer.data(), writer.data() + writer.size()};
+
+  bench("10000 entities, readTagList", bytes.size(), [&]() {
+    NBTReader reader{BufferInput{bytes}};
+    reader.readID();
+    volatile size_t sink = reader.readTagList<CompoundTag>().value().size();
+    (void) sink;
+  });
+
+  std::vector<unsigned> threadCounts{1, 2, 4};
+  unsigned cores = std::thread::hardware_concurrency();
+  if (cores > 4) {
+    threadCounts.push_back(cores);
+  }
+  for (unsigned threads : threadCounts) {
+    WorkStealingPool pool{threads};
+    std::string label = "10000 entities, parallel, " + std::to_string(threads) + " threads";
+    bench(label.c_str(), bytes.size(), [&]() {
+      NBTReader reader{BufferInput{bytes}};
+      reader.readID();
+      volatile size_t sink = readCompoundListParallel(reader, pool).value().size();
+      (void) sink;
+    });
+  }
+}
+
+static void benchLookup() {
+  CompoundTag compound{"Level"};
+  std::vector<std::string> names;
+  for (int i = 0; i < 40; i++) {
+    names.push_back("field" + std::to_string(i));
+    compound.push_back(IntTag{names.back(), i});
+  }
+
+  bench("CompoundTag 40 lookups, linear scan", 0, [&]() {
+    int64_t sum = 0;
+    for (const std::string& name : names) {
+      for (size_t i = 0; i < compound.size(); i++) {
+        std::shared_ptr<IntTag> child =
+          std::dynamic_pointer_cast<IntTag>(compound.at(i));
+        if (child && child->name() == name) {
+          sum += child->value();
+          break;
+        }
+      }
+    }
+    volatile int64_t sink = sum;
+    (void) sink;
+  });
+
+  bench("CompoundTag 40 lookups, get<IntTag>", 0, [&]() {
+    int64_t sum = 0;
+    for (const std::string& name : names) {
+      sum += compound.get<IntTag>(name)->value();
+    }
+    volatile int64_t sink = sum;
+    (void) sink;
+  });
+}
+
+
+struct BenchEntity {
+  std::string id;
+  std::vector<double> pos;
+  int16_t health;
+};
+
+struct BenchLevel {
+  int32_t x;
+  int32_t z;
+  int64_t lastUpdate;
+  std::string status;
+  std::vector<BenchEntity> entities;
+};
+
+struct BenchChunk {
+  int32_t dataVersion;
+  BenchLevel level;
+};
+
+/**
+ * Decodes a chunk's header fields and entities into structs, skipping the
+ * sections.
+ */
+static void benchSchema() {
+  std::vector<uint8_t> chunk = makeChunk();
+
+  bench("chunk header + entities, CompoundTag + copy", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    reader.readID();
+    CompoundTag root = reader.readCompoundTag();
+    BenchChunk out{};
+    out.dataVersion = root.get<IntTag>("DataVersion")->value();
+    std::shared_ptr<CompoundTag> level = root.get<CompoundTag>("Level");
+    out.level.x = level->get<IntTag>("xPos")->value();
+    out.level.z = level->get<IntTag>("zPos")->value();
+    out.level.lastUpdate = level->get<LongTag>("LastUpdate")->value();
+    out.level.status = level->get<StringTag>("Status")->value();
+    for (const CompoundTag& entity : level->get<ListTag<CompoundTag>>("Entities")->value()) {
+      BenchEntity& e = out.level.entities.emplace_back();
+      e.id = entity.get<StringTag>("id")->value();
+      e.pos = entity.get<ListTag<DoubleTag>>("Pos")->value();
+      e.health = entity.get<ShortTag>("Health")->value();
+    }
+    volatile size_t sink = out.level.entities.size();
+    (void) sink;
+  });
+
+  static constexpr auto entitySchema = makeSchema<BenchEntity>(
+      schemaField<StringTag>("id", &BenchEntity::id),
+      schemaList<DoubleTag>("Pos", &BenchEntity::pos),
+      schemaField<ShortTag>("Health", &BenchEntity::health));
+  static constexpr auto levelSchema = makeSchema<BenchLevel>(
+      schemaField<IntTag>("xPos", &BenchLevel::x),
+      schemaField<IntTag>("zPos", &BenchLevel::z),
+      schemaField<LongTag>("LastUpdate", &BenchLevel::lastUpdate),
+      schemaField<StringTag>("Status", &BenchLevel::status),
+      schemaCompoundList("Entities", &BenchLevel::entities, entitySchema));
+  static constexpr auto chunkSchema = makeSchema<BenchChunk>(
+      schemaField<IntTag>("DataVersion", &BenchChunk::dataVersion),
+      schemaCompound("Level", &BenchChunk::level, levelSchema));
+
+  bench("chunk header + entities, Schema", chunk.size(), [&]() {
+    NBTReader reader{BufferInput{chunk}};
+    BenchChunk out = chunkSchema.read(reader);
+    volatile size_t sink = out.level.entities.size();
+    (void) sink;
+  });
+}
+
+int main() {
+  // Heightmaps are 37 longs, block states up to 4096 longs, biomes 1024 ints.
+  benchArrays<LongArrayTag>("LONG_ARRAY", TagID::LONG_ARRAY, 37);
+  benchArrays<LongArrayTag>("LONG_ARRAY", TagID::LONG_ARRAY, 4096);
+  benchArrays<IntArrayTag>("INT_ARRAY", TagID::INT_ARRAY, 1024);
+  benchArrays<IntArrayTag>("INT_ARRAY", TagID::INT_ARRAY, 65536);
+  benchArrays<ByteArrayTag>("BYTE_ARRAY", TagID::BYTE_ARRAY, 16384);
+
+  benchSwap<uint32_t>("swap32", 1024);
+  benchSwap<uint64_t>("swap64", 4096);
+
+  benchTrees();
+  benchLazy();
+  benchQuery();
+  benchEvents();
+  benchWriter();
+  benchInflate();
+  benchWorld();
+  benchCache();
+  benchParallelList();
+  benchLookup();
+  benchSchema();
+  return 0;
+}
@@ -20,6 +20,7 @@
 #ifndef NBT_HPP
 #define NBT_HPP
 
+#include <algorithm>
 #include <cinttypes>
 #include <string>
 #include <vector>
@@ -28,6 +29,12 @@
 #include <exception>
 #include <iostream>
 #include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "nbt_input.hpp"
 
 
 enum class TagID {
@@ -46,10 +53,42 @@ enum class TagID {
   LONG_ARRAY = 12,
 };
 
+class NBTTagException : public std::exception {
+  public:
+    explicit NBTTagException(TagID id, std::string why) :
+      id{id}, why{why}
+    { }
+
+    virtual const char* what() const noexcept
+    {
+      static std::string expl = why + ": " + std::to_string(static_cast<unsigned int>(id));
+      return expl.c_str();
+    }
+
+    TagID id;
+    std::string why;
+};
+
+class NBTException : public std::exception {
+  public:
+    explicit NBTException(const char* why) :
+      why{why}
+    { }
+
+    virtual const char* what() const noexcept
+    {
+      return why;
+    }
+
+  private:
+    const char* why;
+};
+
 struct TagBase {
   TagBase() { }
   virtual ~TagBase() { }
   virtual TagID id() const = 0;
+  virtual const std::string& name() const = 0;
 };
 
 
@@ -57,9 +96,16 @@ template <TagID tagID, typename T>
 struct Tag : TagBase {
   public:
     typedef T type;
-    Tag(std::string name, T value) : mName{name}, mValue{value} { }
+    Tag(std::string name, T value) :
+      mName{std::move(name)}, mValue{std::move(value)} { }
     virtual ~Tag() { }
 
+    // The virtual destructor would otherwise turn moves into copies.
+    Tag(const Tag& other) = default;
+    Tag(Tag&& other) = default;
+    Tag& operator=(const Tag& other) = default;
+    Tag& operator=(Tag&& other) = default;
+
     static T ftoh(T unswapped);
     static T htof(T unswapped);
 
@@ -67,7 +113,7 @@ struct Tag : TagBase {
       return tagID;
     }
 
-    std::string name() const {
+    virtual const std::string& name() const override {
       return mName;
     }
 
@@ -75,6 +121,10 @@ struct Tag : TagBase {
       return mValue;
     }
 
+    const T& value() const {
+      return mValue;
+    }
+
   protected:
     std::string mName;
     T mValue;
@@ -85,7 +135,7 @@ struct ArrayTag : TagBase {
   public:
     typedef std::vector<T> type;
     ArrayTag(std::string name, std::vector<T> value) :
-      mName{name}, mValue{value} { }
+      mName{std::move(name)}, mValue{std::move(value)} { }
     virtual ~ArrayTag() { }
 
     static type ftoh(type unswapped);
@@ -95,7 +145,7 @@ struct ArrayTag : TagBase {
       return tagID;
     }
 
-    std::string name() const {
+    virtual const std::string& name() const override {
       return mName;
     }
 
@@ -103,6 +153,10 @@ struct ArrayTag : TagBase {
       return mValue;
     }
 
+    const std::vector<T>& value() const {
+      return mValue;
+    }
+
     size_t size() const {
       return mValue.size();
     }
@@ -141,6 +195,11 @@ class EndTag : TagBase {
     virtual TagID id() const override {
       return TagID::END;
     }
+
+    virtual const std::string& name() const override {
+      static const std::string empty;
+      return empty;
+    }
 };
 
 
@@ -159,6 +218,96 @@ using LongArrayTag = ArrayTag<TagID::LONG_ARRAY, int64_t>;
 using StringTag = Tag<TagID::STRING, std::string>;
 
 
+// Convert count contiguous 16/32/64-bit values between file (big-endian) and
+// host order in place. data doesn't need to be aligned. Defined in
+// nbt_swap.cpp, which picks a SIMD kernel for the CPU at run time.
+void swapInPlace16(void* data, size_t count);
+void swapInPlace32(void* data, size_t count);
+void swapInPlace64(void* data, size_t count);
+
+template <typename T>
+inline void swapInPlace(T* data, size_t count) {
+  static_assert(std::is_arithmetic<T>::value, "Only numbers are byte-swapped");
+  if constexpr (sizeof(T) == 2) {
+    swapInPlace16(data, count);
+  }
+  else if constexpr (sizeof(T) == 4) {
+    swapInPlace32(data, count);
+  }
+  else if constexpr (sizeof(T) == 8) {
+    swapInPlace64(data, count);
+  }
+}
+
+// Byte-order conversions between file (big-endian) and host order, defined in
+// nbt.cpp.
+template<> ByteTag::type ByteTag::ftoh(ByteTag::type unswapped);
+template<> ByteTag::type ByteTag::htof(ByteTag::type unswapped);
+template<> ShortTag::type ShortTag::ftoh(ShortTag::type unswapped);
+template<> ShortTag::type ShortTag::htof(ShortTag::type unswapped);
+template<> IntTag::type IntTag::ftoh(IntTag::type unswapped);
+template<> IntTag::type IntTag::htof(IntTag::type unswapped);
+template<> LongTag::type LongTag::ftoh(LongTag::type unswapped);
+template<> LongTag::type LongTag::htof(LongTag::type unswapped);
+template<> FloatTag::type FloatTag::ftoh(FloatTag::type unswapped);
+template<> FloatTag::type FloatTag::htof(FloatTag::type unswapped);
+template<> DoubleTag::type DoubleTag::ftoh(DoubleTag::type unswapped);
+template<> DoubleTag::type DoubleTag::htof(DoubleTag::type unswapped);
+template<> ByteArrayTag::type ByteArrayTag::ftoh(ByteArrayTag::type unswapped);
+template<> ByteArrayTag::type ByteArrayTag::htof(ByteArrayTag::type unswapped);
+template<> IntArrayTag::type IntArrayTag::ftoh(IntArrayTag::type unswapped);
+template<> IntArrayTag::type IntArrayTag::htof(IntArrayTag::type unswapped);
+template<> LongArrayTag::type LongArrayTag::ftoh(LongArrayTag::type unswapped);
+template<> LongArrayTag::type LongArrayTag::htof(LongArrayTag::type unswapped);
+
+
+/**
+ * Loads a big-endian T from p, which doesn't need to be aligned.
+ */
+template <typename T>
+inline T loadBigEndian(const char* p) {
+  static_assert(std::is_arithmetic<T>::value, "Only numbers are byte-swapped");
+  T value;
+  std::memcpy(&value, p, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if constexpr (sizeof(T) > 1) {
+    typedef typename std::conditional<sizeof(T) == 2, uint16_t,
+            typename std::conditional<sizeof(T) == 4, uint32_t,
+                                      uint64_t>::type>::type bits_type;
+    bits_type bits;
+    std::memcpy(&bits, &value, sizeof(T));
+    if constexpr (sizeof(T) == 2) {
+      bits = __builtin_bswap16(bits);
+    }
+    else if constexpr (sizeof(T) == 4) {
+      bits = __builtin_bswap32(bits);
+    }
+    else {
+      bits = __builtin_bswap64(bits);
+    }
+    std::memcpy(&value, &bits, sizeof(T));
+  }
+#endif
+  return value;
+}
+
+
+template <typename T>
+class ListTag;
+
+template <typename T>
+struct is_list_tag : std::false_type { };
+
+template <typename T>
+struct is_list_tag<ListTag<T>> : std::true_type { };
+
+template <typename T>
+struct is_array_tag : std::false_type { };
+
+template <TagID tagID, typename T>
+struct is_array_tag<ArrayTag<tagID, T>> : std::true_type { };
+
+
 
 template <typename T>
 class ListTag : public TagBase {
@@ -167,17 +316,22 @@ class ListTag : public TagBase {
 
     // Due to unique_ptr attribute, there will be no implicit copy operator
     explicit ListTag(std::string name, int32_t size) :
-      mName{name},
+      mName{std::move(name)},
       mValue{std::vector<typename T::type>()},
       mSize{size}
     {
-      mValue.reserve(size);
+      if (size < 0) {
+        throw NBTException{"Negative list size"};
+      }
+      // The size usually comes from the input, so don't trust it with more
+      // than a modest reservation; push_back grows the rest.
+      mValue.reserve(std::min<size_t>(size, 1 << 16));
     }
 
     ListTag(ListTag&& other) :
-      mName{other.name()},
-      mValue{std::move(other.value())},
-      mSize{other.size()}
+      mName{std::move(other.mName)},
+      mValue{std::move(other.mValue)},
+      mSize{other.mSize}
     { }
 
     virtual ~ListTag() {
@@ -193,7 +347,7 @@ class ListTag : public TagBase {
       return TagID::LIST;
     }
 
-    std::string name() const {
+    virtual const std::string& name() const override {
       return mName;
     }
 
@@ -201,6 +355,10 @@ class ListTag : public TagBase {
       return mValue;
     }
 
+    const std::vector<typename T::type>& value() const {
+      return mValue;
+    }
+
     void push_back(T tag) {
       value().push_back(tag.value());
     }
@@ -223,7 +381,7 @@ template <>
 class ListTag<EndTag> : public TagBase {
   public:
     explicit ListTag(std::string name, int32_t size) :
-      mName{name},
+      mName{std::move(name)},
       mSize{size} { }
 
     virtual ~ListTag() { }
@@ -243,7 +401,7 @@ class ListTag<EndTag> : public TagBase {
       return newList;
     }
 
-    std::string name() const {
+    virtual const std::string& name() const override {
       return mName;
     }
 
@@ -271,17 +429,21 @@ class ListTag<CompoundTag> : public TagBase {
     // Due to unique_ptr member, there will be no implicit copy constructor
     explicit ListTag(std::string name, TagID memberID, int32_t size) :
       mSize{size},
-      mName{name},
+      mName{std::move(name)},
       mValue{},
       mMemberID{memberID}
       {
-        mValue.reserve(size);
+        if (size < 0) {
+          throw NBTException{"Negative list size"};
+        }
+        mValue.reserve(std::min<size_t>(size, 1 << 16));
       }
 
     ListTag(ListTag&& other) :
-      mSize{other.size()},
-      mName{other.name()},
-      mValue{other.value()}
+      mSize{other.mSize},
+      mName{std::move(other.mName)},
+      mValue{std::move(other.mValue)},
+      mMemberID{other.mMemberID}
     { }
 
     virtual ~ListTag() { }
@@ -294,7 +456,7 @@ class ListTag<CompoundTag> : public TagBase {
       return getTagID<CompoundTag>();
     }
 
-    std::string name() const {
+    virtual const std::string& name() const override {
       return mName;
     }
 
@@ -302,6 +464,10 @@ class ListTag<CompoundTag> : public TagBase {
       return mValue;
     }
 
+    const std::vector<CompoundTag>& value() const {
+      return mValue;
+    }
+
     void push_back(CompoundTag tag);
 
     CompoundTag& at(size_t i) {
@@ -340,10 +506,21 @@ class CompoundTag : public Tag<TagID::COMPOUND, std::vector<std::shared_ptr<TagB
 
     virtual ~CompoundTag() { }
 
+    CompoundTag(const CompoundTag& other) = default;
+    CompoundTag(CompoundTag&& other) = default;
+    CompoundTag& operator=(const CompoundTag& other) = default;
+    CompoundTag& operator=(CompoundTag&& other) = default;
+
     template<class T>
     void push_back(T tag) {
       std::shared_ptr<TagBase> tagCopy = std::make_shared<T>(std::move(tag));
       value().push_back(tagCopy);
+      indexLast();
+    }
+
+    void push_back(std::shared_ptr<TagBase> tag) {
+      value().push_back(std::move(tag));
+      indexLast();
     }
 
     std::shared_ptr<TagBase> at(size_t i) {
@@ -353,6 +530,56 @@ class CompoundTag : public Tag<TagID::COMPOUND, std::vector<std::shared_ptr<TagB
     size_t size() const {
       return mValue.size();
     }
+
+    /**
+     * The first child named name, or nullptr. Compounds with at least
+     * INDEX_THRESHOLD children keep a hash index of their children's names,
+     * maintained by push_back, so this doesn't scan them.
+     */
+    std::shared_ptr<TagBase> find(std::string_view name) const;
+
+    /**
+     * The first child named name, if it is a T. Returns nullptr if there is
+     * no such child or it has a different type.
+     */
+    template<class T>
+    std::shared_ptr<T> get(std::string_view name) const {
+      std::shared_ptr<TagBase> child = find(name);
+      if constexpr (is_list_tag<T>::value) {
+        return std::dynamic_pointer_cast<T>(child);
+      }
+      else {
+        if (child == nullptr || child->id() != getTagID<T>()) {
+          return nullptr;
+        }
+        return std::static_pointer_cast<T>(child);
+      }
+    }
+
+    /**
+     * Rebuilds the name index. Needed after children are replaced or renamed
+     * through value(); appending through value() is noticed automatically.
+     */
+    void reindex();
+
+    static constexpr size_t INDEX_THRESHOLD = 8;
+
+  private:
+    void indexLast();
+    void insertIndex(uint32_t hash, uint32_t child);
+    const std::shared_ptr<TagBase>* findIndexed(std::string_view name) const;
+
+    struct Slot {
+      uint32_t hash;
+      // 1 + index of the child, or 0 for an empty slot
+      uint32_t child;
+    };
+
+    // Open addressing with linear probing; the size is a power of two.
+    std::vector<Slot> mIndex;
+    // Number of children in mIndex. find() only trusts the index while this
+    // matches size().
+    size_t mIndexed = 0;
 };
 
 
@@ -423,59 +650,208 @@ constexpr TagID getTagID<StringTag>() {
 
 
 
+/**
+ * Read-only view of an array payload, pointing into the buffer it was read
+ * from. The payload stays in file byte order; elements are converted when
+ * they're accessed.
+ */
+template <typename T>
+class ArrayView {
+  public:
+    typedef T value_type;
 
+    ArrayView() :
+      mData{nullptr}, mSize{0}
+    { }
 
-class NBTTagException : public std::exception {
+    ArrayView(const char* data, size_t size) :
+      mData{data}, mSize{size}
+    { }
+
+    /**
+     * The raw payload, size() * sizeof(T) bytes.
+     */
+    const char* data() const {
+      return mData;
+    }
+
+    size_t size() const {
+      return mSize;
+    }
+
+    bool empty() const {
+      return mSize == 0;
+    }
+
+    T operator[](size_t i) const {
+      return loadBigEndian<T>(mData + i * sizeof(T));
+    }
+
+    T at(size_t i) const {
+      if (i >= mSize) {
+        throw std::out_of_range("ArrayView::at");
+      }
+      return (*this)[i];
+    }
+
+    /**
+     * Copies the elements out in host byte order.
+     */
+    std::vector<T> toVector() const {
+      std::vector<T> values(mSize);
+      if (mSize > 0) {
+        std::memcpy(values.data(), mData, mSize * sizeof(T));
+        swapInPlace(values.data(), values.size());
+      }
+      return values;
+    }
+
+  private:
+    const char* mData;
+    size_t mSize;
+};
+
+/**
+ * Contiguous, read-only run of numbers in host byte order.
+ */
+template <typename T>
+class ArrayRef {
   public:
-    explicit NBTTagException(TagID id, std::string why) :
-      id{id}, why{why}
+    typedef T value_type;
+
+    ArrayRef() :
+      mData{nullptr}, mSize{0}
     { }
 
-    virtual const char* what() const noexcept
-    {
-      static std::string expl = why + ": " + std::to_string(static_cast<unsigned int>(id));
-      return expl.c_str();
+    ArrayRef(const T* data, size_t size) :
+      mData{data}, mSize{size}
+    { }
+
+    const T* data() const {
+      return mData;
     }
 
-    TagID id;
-    std::string why;
+    size_t size() const {
+      return mSize;
+    }
+
+    bool empty() const {
+      return mSize == 0;
+    }
+
+    const T* begin() const {
+      return mData;
+    }
+
+    const T* end() const {
+      return mData + mSize;
+    }
+
+    const T& operator[](size_t i) const {
+      return mData[i];
+    }
+
+    const T& at(size_t i) const {
+      if (i >= mSize) {
+        throw std::out_of_range("ArrayRef::at");
+      }
+      return mData[i];
+    }
+
+  private:
+    const T* mData;
+    size_t mSize;
 };
 
-class NBTException : public std::exception {
+/**
+ * What the payload of tag type T looks like when it isn't copied: strings
+ * become std::string_view and arrays become ArrayView. Numbers are returned
+ * by value as usual.
+ */
+template <typename T>
+struct view_of {
+  typedef typename T::type type;
+};
+
+template <>
+struct view_of<StringTag> {
+  typedef std::string_view type;
+};
+
+template <TagID tagID, typename T>
+struct view_of<ArrayTag<tagID, T>> {
+  typedef ArrayView<T> type;
+};
+
+/**
+ * A tag whose name and payload point into the buffer it was read from. It is
+ * only valid as long as that buffer is. Use toTag() to get an owning copy.
+ */
+template <typename T>
+class TagView {
   public:
-    explicit NBTException(const char* why) :
-      why{why}
+    typedef typename view_of<T>::type type;
+
+    TagView(std::string_view name, type value) :
+      mName{name}, mValue{value}
     { }
 
-    virtual const char* what() const noexcept
-    {
-      return why;
+    static constexpr TagID id() {
+      return getTagID<T>();
+    }
+
+    std::string_view name() const {
+      return mName;
+    }
+
+    const type& value() const {
+      return mValue;
+    }
+
+    T toTag() const {
+      if constexpr (std::is_same<T, StringTag>::value) {
+        return T{std::string{mName}, std::string{mValue}};
+      }
+      else if constexpr (is_array_tag<T>::value) {
+        return T{std::string{mName}, mValue.toVector()};
+      }
+      else {
+        return T{std::string{mName}, mValue};
+      }
     }
 
   private:
-    const char* why;
+    std::string_view mName;
+    type mValue;
 };
 
-class NBTFile {
+
+/**
+ * Parser for NBT data, specialized at compile time on where the bytes come
+ * from. See nbt_input.hpp for the interface an Input has to provide.
+ */
+template <typename Input>
+class NBTReader {
   public:
-    explicit NBTFile(std::string filename);
-    ~NBTFile();
+    explicit NBTReader(Input input) :
+      input{std::move(input)}
+    { }
 
     // no copy
-    NBTFile(NBTFile& other) = delete;
+    NBTReader(NBTReader& other) = delete;
 
     // only move
-    NBTFile& operator=(NBTFile&& other) {
-      file.swap(other.file);
-      return *this;
-    }
-    NBTFile(NBTFile&& other) {
-      std::swap(file, other.file);
-    }
+    NBTReader(NBTReader&& other) = default;
+    NBTReader& operator=(NBTReader&& other) = default;
 
     TagID readID();
     std::string readName();
 
+    /**
+     * Reads a name into an existing string, reusing its storage.
+     */
+    void readName(std::string& name);
+
     template <typename T>
     T readTag();
 
@@ -494,14 +870,648 @@ class NBTFile {
     CompoundTag readCompoundTag();
     CompoundTag readCompoundTag(std::string name);
 
-  private:
-    int32_t readListSize();
+    std::shared_ptr<TagBase> readPayload(TagID id, std::string name);
+
+    /**
+     * Steps over the name and payload of a tag whose ID has already been
+     * consumed, without building it. Returns the number of bytes skipped.
+     */
+    size_t skipTag(TagID id);
+
+    /**
+     * Steps over the payload of a tag whose ID and name have already been
+     * consumed. Returns the number of bytes skipped.
+     */
+    size_t skipPayload(TagID id);
+
+    static constexpr int MAX_DEPTH = 512;
+
+    /*
+     * Zero-copy reads, only available when Input is contiguous (see
+     * is_contiguous_input). Names, strings and arrays point into the input's
+     * buffer instead of being copied out, so they are valid for as long as
+     * that buffer is.
+     */
+    std::string_view readNameView();
+
+    template <typename T>
+    TagView<T> readTagView();
+
+    template <typename T>
+    TagView<T> readTagView(std::string_view name);
+
+    /*
+     * Building blocks for parsers layered on top of NBTReader, like Document.
+     * They throw NBTException if the input ends early.
+     */
     int32_t readSize();
-    std::ifstream file;
+
+    template <typename T>
+    T readNumber();
+
+    template <typename T>
+    void readNumbers(T* values, size_t count);
+
+    void readBytes(void* dst, size_t n);
+
+    /**
+     * Points at the next n bytes of a contiguous input and skips them.
+     */
+    const char* readView(size_t n);
+
+    /**
+     * Offset of the next byte to be read from a contiguous input.
+     */
+    size_t position() const {
+      return input.position();
+    }
+
+    /**
+     * Number of bytes left in a contiguous input.
+     */
+    size_t remaining() const {
+      return input.size() - input.position();
+    }
+
+  protected:
+    int32_t readListSize();
+
+    /*
+     * The recursive readers, with the depth of the tag being read. They
+     * throw NBTException past MAX_DEPTH, so corrupt or hostile input can't
+     * run the stack out.
+     */
+    template <typename T>
+    ListTag<T> readTagList(TagID id, std::string name, int depth);
+
+    CompoundTag readCompoundTag(std::string name, int depth);
+
+    std::shared_ptr<TagBase> readPayload(TagID id, std::string name, int depth);
+
+    size_t skipNested(TagID id, int depth);
+    void skipBytes(size_t n);
+
+    template <typename T>
+    void readValues(std::vector<T>& values, int32_t size);
+
+    Input input;
 };
 
+/**
+ * Reads an NBT file through std::ifstream.
+ */
+class NBTFile : public NBTReader<StreamInput> {
+  public:
+    explicit NBTFile(std::string filename) :
+      NBTReader<StreamInput>{StreamInput{filename}}
+    { }
+};
 
+/**
+ * Reads an NBT file by mapping it into memory. Every read is a bounds check
+ * and a copy out of the mapping instead of a trip through iostreams.
+ */
+class MappedNBTFile : public NBTReader<MappedInput> {
+  public:
+    explicit MappedNBTFile(std::string filename) :
+      NBTReader<MappedInput>{MappedInput{filename}}
+    { }
+};
+
+
+// -----------------------------------------------------------------------------
+
+template <typename Input>
+TagID NBTReader<Input>::readID() {
+  char rawID;
+  if (!input.read(&rawID, sizeof(char))) {
+    throw NBTException{"Unexpectedly reached end of file while reading ID"};
+  }
+  return static_cast<TagID>(rawID);
+}
+
+template <typename Input>
+std::string NBTReader<Input>::readName() {
+  // NOTE: Names are null-terminated, except when they're empty.
+  int16_t rawSize;
+  if (!input.read(&rawSize, sizeof(rawSize))) {
+    throw NBTException{"Unexpectedly reached end of file while reading name"};
+  }
+  uint16_t nameSize = static_cast<uint16_t>(ShortTag::ftoh(rawSize));
+  std::string name(nameSize, '\0');
+  if (!input.read(&name[0], nameSize)) {
+    throw NBTException{"Unexpectedly reached end of file while reading name"};
+  }
+  return name;
+}
+
+template <typename Input>
+void NBTReader<Input>::readName(std::string& name) {
+  int16_t rawSize;
+  if (!input.read(&rawSize, sizeof(rawSize))) {
+    throw NBTException{"Unexpectedly reached end of file while reading name"};
+  }
+  name.resize(static_cast<uint16_t>(ShortTag::ftoh(rawSize)));
+  if (!input.read(&name[0], name.size())) {
+    throw NBTException{"Unexpectedly reached end of file while reading name"};
+  }
+}
 
+template <typename Input>
+int32_t NBTReader<Input>::readSize() {
+  int32_t size;
+  if (!input.read(&size, sizeof(size))) {
+    throw NBTException{"Unexpectedly reached end of file while reading size"};
+  }
+  return IntTag::ftoh(size);
+}
+
+/**
+ * Reads one big-endian number.
+ */
+template <typename Input>
+template <typename T>
+T NBTReader<Input>::readNumber() {
+  char raw[sizeof(T)];
+  if (!input.read(raw, sizeof(raw))) {
+    throw NBTException{"Unexpectedly reached end of file while reading tag value"};
+  }
+  return loadBigEndian<T>(raw);
+}
+
+/**
+ * Reads count big-endian numbers with a single read and converts them in
+ * place.
+ */
+template <typename Input>
+template <typename T>
+void NBTReader<Input>::readNumbers(T* values, size_t count) {
+  if (!input.read(values, count * sizeof(T))) {
+    throw NBTException{"Unexpectedly reached end of file while reading array"};
+  }
+  swapInPlace(values, count);
+}
+
+template <typename Input>
+void NBTReader<Input>::readBytes(void* dst, size_t n) {
+  if (!input.read(dst, n)) {
+    throw NBTException{"Unexpectedly reached end of file while reading tag value"};
+  }
+}
+
+template <typename Input>
+const char* NBTReader<Input>::readView(size_t n) {
+  static_assert(is_contiguous_input<Input>::value,
+                "Views need an input backed by a contiguous buffer");
+  const char* ptr;
+  if (!input.view(ptr, n)) {
+    throw NBTException{"Unexpectedly reached end of file while reading tag value"};
+  }
+  return ptr;
+}
+
+template <typename Input>
+int32_t NBTReader<Input>::readListSize() {
+  int32_t size;
+  if (!input.read(&size, sizeof(size))) {
+    throw NBTException{"Unexpectedly reached end of file while reading list size"};
+  }
+  return IntTag::ftoh(size);
+}
+
+/**
+ * Reads the payload of a tag whose ID and name have already been consumed.
+ * StringTag and the ArrayTag types have a length prefix; everything else is a
+ * single fixed-size value.
+ */
+template <typename Input>
+template <typename T>
+T NBTReader<Input>::readTag(std::string name) {
+  if constexpr (std::is_same<T, StringTag>::value) {
+    // Lengths are unsigned: strings run up to 65535 bytes.
+    int16_t rawLength;
+    if (!input.read(&rawLength, sizeof(rawLength))) {
+      throw NBTException{"Unexpectedly reached end of file while reading string length"};
+    }
+    size_t length = static_cast<uint16_t>(ShortTag::ftoh(rawLength));
+    std::string str(length, '\0');
+    if (!input.read(&str[0], length)) {
+      throw NBTException{"Unexpectedly reached end of file while reading string value"};
+    }
+    return StringTag{std::move(name), std::move(str)};
+  }
+  else if constexpr (is_array_tag<T>::value) {
+    return readTagArray<T>(std::move(name), readSize());
+  }
+  else {
+    typename T::type value;
+    if (!input.read(&value, sizeof(value))) {
+      throw NBTException{"Unexpectedly reached end of file while reading tag value"};
+    }
+    return T{std::move(name), T::ftoh(std::move(value))};
+  }
+}
+
+/**
+ * Reads the name and payload of a tag whose ID has already been consumed.
+ * EndTag has no name or value.
+ */
+template <typename Input>
+template <typename T>
+T NBTReader<Input>::readTag() {
+  if constexpr (std::is_same<T, EndTag>::value) {
+    return EndTag{};
+  }
+  else {
+    return readTag<T>(readName());
+  }
+}
+
+/**
+ * Reads size big-endian numbers into values, replacing its contents. The
+ * payload is copied in with as few reads as possible and then byte-swapped in
+ * place.
+ */
+template <typename Input>
+template <typename T>
+void NBTReader<Input>::readValues(std::vector<T>& values, int32_t size) {
+  if (size < 0) {
+    throw NBTException{"Negative array size"};
+  }
+  // A corrupt size shouldn't make us allocate gigabytes up front, so grow in
+  // bounded steps. Real arrays fit in the first step.
+  constexpr size_t step = (1 << 20) / sizeof(T);
+  values.clear();
+  size_t total = static_cast<size_t>(size);
+  while (values.size() < total) {
+    size_t done = values.size();
+    size_t count = std::min(total - done, step);
+    values.resize(done + count);
+    readNumbers(values.data() + done, count);
+  }
+}
+
+/**
+ * Helper for reading arrays of fixed-size values.
+ */
+template <typename Input>
+template <typename T>
+T NBTReader<Input>::readTagArray(std::string name, int32_t size) {
+  T tag{std::move(name), typename T::type{}};
+  readValues(tag.value(), size);
+  return tag;
+}
+
+
+template <typename Input>
+template <typename T>
+ListTag<T> NBTReader<Input>::readTagList(TagID id, std::string name) {
+  return readTagList<T>(id, std::move(name), 0);
+}
+
+template <typename Input>
+template <typename T>
+ListTag<T> NBTReader<Input>::readTagList(TagID id, std::string name, int depth) {
+  if (depth > MAX_DEPTH) {
+    throw NBTException{"Tags are nested too deeply"};
+  }
+  if constexpr (std::is_same<T, CompoundTag>::value) {
+    int32_t size = readSize();
+    ListTag<CompoundTag> list{std::move(name), id, size};
+    for (int i = 0; i < size; i++) {
+      list.push_back(readCompoundTag("", depth + 1));
+    }
+    return list;
+  }
+  else if constexpr (std::is_same<T, EndTag>::value) {
+    // Elements of an empty list have no payload, so there is nothing to read
+    // past the size.
+    return ListTag<EndTag>{std::move(name), readSize()};
+  }
+  else if constexpr (std::is_arithmetic<typename T::type>::value) {
+    // Lists of numbers are laid out exactly like the array tags.
+    int32_t size = readListSize();
+    ListTag<T> list{std::move(name), size};
+    readValues(list.value(), size);
+    return list;
+  }
+  else {
+    int32_t size = readListSize();
+    ListTag<T> list{std::move(name), size};
+    for (int i = 0; i < size; i++) {
+      list.push_back(readTag<T>(""));
+    }
+    return list;
+  }
+}
+
+template <typename Input>
+template <typename T>
+ListTag<T> NBTReader<Input>::readTagList() {
+  std::string name = readName();
+  TagID id = readID();
+  return readTagList<T>(id, std::move(name));
+}
+
+
+template <typename Input>
+std::string_view NBTReader<Input>::readNameView() {
+  static_assert(is_contiguous_input<Input>::value,
+                "Views need an input backed by a contiguous buffer");
+  int16_t rawSize;
+  if (!input.read(&rawSize, sizeof(rawSize))) {
+    throw NBTException{"Unexpectedly reached end of file while reading name"};
+  }
+  uint16_t nameSize = static_cast<uint16_t>(ShortTag::ftoh(rawSize));
+  const char* name;
+  if (!input.view(name, nameSize)) {
+    throw NBTException{"Unexpectedly reached end of file while reading name"};
+  }
+  return std::string_view{name, nameSize};
+}
+
+template <typename Input>
+template <typename T>
+TagView<T> NBTReader<Input>::readTagView(std::string_view name) {
+  static_assert(is_contiguous_input<Input>::value,
+                "Views need an input backed by a contiguous buffer");
+  if constexpr (std::is_same<T, StringTag>::value) {
+    int16_t length;
+    if (!input.read(&length, sizeof(length))) {
+      throw NBTException{"Unexpectedly reached end of file while reading string length"};
+    }
+    size_t size = static_cast<uint16_t>(ShortTag::ftoh(length));
+    const char* str;
+    if (!input.view(str, size)) {
+      throw NBTException{"Unexpectedly reached end of file while reading string value"};
+    }
+    return TagView<T>{name, std::string_view{str, size}};
+  }
+  else if constexpr (is_array_tag<T>::value) {
+    int32_t size = readSize();
+    if (size < 0) {
+      throw NBTException{"Negative array size"};
+    }
+    typedef typename T::type::value_type value_type;
+    const char* payload;
+    if (!input.view(payload, static_cast<size_t>(size) * sizeof(value_type))) {
+      throw NBTException{"Unexpectedly reached end of file while reading array"};
+    }
+    return TagView<T>{name, ArrayView<value_type>{payload, static_cast<size_t>(size)}};
+  }
+  else {
+    typename T::type value;
+    if (!input.read(&value, sizeof(value))) {
+      throw NBTException{"Unexpectedly reached end of file while reading tag value"};
+    }
+    return TagView<T>{name, T::ftoh(value)};
+  }
+}
+
+template <typename Input>
+template <typename T>
+TagView<T> NBTReader<Input>::readTagView() {
+  return readTagView<T>(readNameView());
+}
+
+
+template <typename Input>
+CompoundTag NBTReader<Input>::readCompoundTag() {
+  std::string name = readName();
+  return readCompoundTag(std::move(name));
+}
+
+template <typename Input>
+CompoundTag NBTReader<Input>::readCompoundTag(std::string name) {
+  return readCompoundTag(std::move(name), 0);
+}
+
+template <typename Input>
+CompoundTag NBTReader<Input>::readCompoundTag(std::string name, int depth) {
+  if (depth > MAX_DEPTH) {
+    throw NBTException{"Tags are nested too deeply"};
+  }
+  CompoundTag ct{std::move(name)};
+  for (TagID id = readID(); id != TagID::END; id = readID()) {
+    ct.push_back(readPayload(id, readName(), depth + 1));
+  }
+  return ct;
+}
+
+/**
+ * Reads the payload of a tag of type id, whose ID and name have already been
+ * consumed, into a tag of the matching class.
+ */
+template <typename Input>
+std::shared_ptr<TagBase> NBTReader<Input>::readPayload(TagID id, std::string name) {
+  return readPayload(id, std::move(name), 0);
+}
+
+template <typename Input>
+std::shared_ptr<TagBase> NBTReader<Input>::readPayload(TagID id, std::string name, int depth) {
+  switch (id) {
+    case TagID::BYTE:
+      return std::make_shared<ByteTag>(readTag<ByteTag>(std::move(name)));
+    case TagID::SHORT:
+      return std::make_shared<ShortTag>(readTag<ShortTag>(std::move(name)));
+    case TagID::INT:
+      return std::make_shared<IntTag>(readTag<IntTag>(std::move(name)));
+    case TagID::LONG:
+      return std::make_shared<LongTag>(readTag<LongTag>(std::move(name)));
+    case TagID::FLOAT:
+      return std::make_shared<FloatTag>(readTag<FloatTag>(std::move(name)));
+    case TagID::DOUBLE:
+      return std::make_shared<DoubleTag>(readTag<DoubleTag>(std::move(name)));
+    case TagID::BYTE_ARRAY:
+      return std::make_shared<ByteArrayTag>(readTag<ByteArrayTag>(std::move(name)));
+    case TagID::STRING:
+      return std::make_shared<StringTag>(readTag<StringTag>(std::move(name)));
+    case TagID::LIST:
+      {
+        // Read contained TypeID
+        TagID listID = readID();
+        switch (listID) {
+          case TagID::END:
+            return std::make_shared<ListTag<EndTag>>(readTagList<EndTag>(listID, std::move(name), depth));
+          case TagID::BYTE:
+            return std::make_shared<ListTag<ByteTag>>(readTagList<ByteTag>(listID, std::move(name), depth));
+          case TagID::SHORT:
+            return std::make_shared<ListTag<ShortTag>>(readTagList<ShortTag>(listID, std::move(name), depth));
+          case TagID::INT:
+            return std::make_shared<ListTag<IntTag>>(readTagList<IntTag>(listID, std::move(name), depth));
+          case TagID::LONG:
+            return std::make_shared<ListTag<LongTag>>(readTagList<LongTag>(listID, std::move(name), depth));
+          case TagID::FLOAT:
+            return std::make_shared<ListTag<FloatTag>>(readTagList<FloatTag>(listID, std::move(name), depth));
+          case TagID::DOUBLE:
+            return std::make_shared<ListTag<DoubleTag>>(readTagList<DoubleTag>(listID, std::move(name), depth));
+          case TagID::BYTE_ARRAY:
+            return std::make_shared<ListTag<ByteArrayTag>>(readTagList<ByteArrayTag>(listID, std::move(name), depth));
+          case TagID::STRING:
+            return std::make_shared<ListTag<StringTag>>(readTagList<StringTag>(listID, std::move(name), depth));
+          //case TagID::LIST:
+          //  //ct.push_back(id, readTag<ListTag>());
+          //  // Read contained TypeID
+          //  //ct.push_back(id, readTagList());
+          //  break;
+          case TagID::COMPOUND:
+            return std::make_shared<ListTag<CompoundTag>>(readTagList<CompoundTag>(listID, std::move(name), depth));
+          case TagID::INT_ARRAY:
+            return std::make_shared<ListTag<IntArrayTag>>(readTagList<IntArrayTag>(listID, std::move(name), depth));
+          case TagID::LONG_ARRAY:
+            return std::make_shared<ListTag<LongArrayTag>>(readTagList<LongArrayTag>(listID, std::move(name), depth));
+          default:
+            throw NBTTagException(listID, "Unrecognized tag in list");
+        }
+      }
+    case TagID::COMPOUND:
+      return std::make_shared<CompoundTag>(readCompoundTag(std::move(name), depth));
+    case TagID::INT_ARRAY:
+      return std::make_shared<IntArrayTag>(readTag<IntArrayTag>(std::move(name)));
+    case TagID::LONG_ARRAY:
+      return std::make_shared<LongArrayTag>(readTag<LongArrayTag>(std::move(name)));
+    default:
+      throw NBTTagException(id, "Unrecognized tag");
+  }
+}
+
+
+
+
+/**
+ * Size of the payload of a fixed-size tag, or 0 for strings, arrays, lists
+ * and compounds.
+ */
+constexpr size_t fixedPayloadSize(TagID id) {
+  switch (id) {
+    case TagID::BYTE:
+      return 1;
+    case TagID::SHORT:
+      return 2;
+    case TagID::INT:
+    case TagID::FLOAT:
+      return 4;
+    case TagID::LONG:
+    case TagID::DOUBLE:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * Advances the input by n bytes, seeking or moving a pointer if the input
+ * supports it and reading into a scratch buffer otherwise.
+ */
+template <typename Input>
+void NBTReader<Input>::skipBytes(size_t n) {
+  if constexpr (has_skip<Input>::value) {
+    if (!input.skip(n)) {
+      throw NBTException{"Unexpectedly reached end of file while skipping tag"};
+    }
+  }
+  else {
+    char scratch[4096];
+    while (n > 0) {
+      size_t count = std::min(n, sizeof(scratch));
+      if (!input.read(scratch, count)) {
+        throw NBTException{"Unexpectedly reached end of file while skipping tag"};
+      }
+      n -= count;
+    }
+  }
+}
+
+template <typename Input>
+size_t NBTReader<Input>::skipTag(TagID id) {
+  if (id == TagID::END) {
+    return 0;
+  }
+  size_t nameSize = static_cast<uint16_t>(readNumber<int16_t>());
+  skipBytes(nameSize);
+  return sizeof(int16_t) + nameSize + skipPayload(id);
+}
+
+template <typename Input>
+size_t NBTReader<Input>::skipPayload(TagID id) {
+  return skipNested(id, 1);
+}
+
+/**
+ * Strings and arrays are skipped using their length prefix, and lists of
+ * numbers as one block. Only compounds and lists of variable-size elements
+ * are walked.
+ */
+template <typename Input>
+size_t NBTReader<Input>::skipNested(TagID id, int depth) {
+  if (depth > MAX_DEPTH) {
+    throw NBTException{"Tags are nested too deeply"};
+  }
+  switch (id) {
+    case TagID::END:
+      return 0;
+    case TagID::BYTE:
+    case TagID::SHORT:
+    case TagID::INT:
+    case TagID::LONG:
+    case TagID::FLOAT:
+    case TagID::DOUBLE:
+      skipBytes(fixedPayloadSize(id));
+      return fixedPayloadSize(id);
+    case TagID::STRING:
+      {
+        size_t length = static_cast<uint16_t>(readNumber<int16_t>());
+        skipBytes(length);
+        return sizeof(int16_t) + length;
+      }
+    case TagID::BYTE_ARRAY:
+    case TagID::INT_ARRAY:
+    case TagID::LONG_ARRAY:
+      {
+        int32_t size = readSize();
+        if (size < 0) {
+          throw NBTException{"Negative array size"};
+        }
+        size_t width = id == TagID::BYTE_ARRAY ? 1 : id == TagID::INT_ARRAY ? 4 : 8;
+        size_t bytes = static_cast<size_t>(size) * width;
+        skipBytes(bytes);
+        return sizeof(int32_t) + bytes;
+      }
+    case TagID::LIST:
+      {
+        TagID elementID = readID();
+        int32_t size = readListSize();
+        size_t skipped = 1 + sizeof(int32_t);
+        // Ends have no payload, so a list of them is empty whatever its size
+        // says.
+        if (size <= 0 || elementID == TagID::END) {
+          return skipped;
+        }
+        size_t width = fixedPayloadSize(elementID);
+        if (width > 0) {
+          size_t bytes = static_cast<size_t>(size) * width;
+          skipBytes(bytes);
+          return skipped + bytes;
+        }
+        for (int32_t i = 0; i < size; i++) {
+          skipped += skipNested(elementID, depth + 1);
+        }
+        return skipped;
+      }
+    case TagID::COMPOUND:
+      {
+        size_t skipped = 1;
+        for (TagID child = readID(); child != TagID::END; child = readID()) {
+          size_t nameSize = static_cast<uint16_t>(readNumber<int16_t>());
+          skipBytes(nameSize);
+          skipped += 1 + sizeof(int16_t) + nameSize + skipNested(child, depth + 1);
+        }
+        return skipped;
+      }
+    default:
+      throw NBTTagException(id, "Unrecognized tag");
+  }
+}
 
 
 #endif // NBT_HPP
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_CACHE_HPP
+#define NBT_CACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_document.hpp"
+#include "nbt_names.hpp"
+#include "nbt_region.hpp"
+
+
+/**
+ * Bounded cache of parsed chunks, keyed by region file and chunk
+ * coordinates, for services that read the same chunks again and again.
+ *
+ *     ChunkCache cache{256 << 20};
+ *     ChunkCache::Handle chunk = cache.get("world/region/r.0.0.mca", 3, 7);
+ *     if (chunk) {
+ *       int32_t x = chunk->root().find("xPos")->value<IntTag>();
+ *     }
+ *
+ * Chunks are held as Documents and handed out as shared, read-only handles,
+ * which stay valid after the chunk has been evicted. Eviction is least
+ * recently used first, and the budget is in bytes: the arena memory of the
+ * Documents still in the cache. Region files are mapped on first use and
+ * kept mapped; their mappings don't count against the budget.
+ *
+ * Tag names are interned in one NameTable shared by all the chunks, so
+ * each distinct name is stored once rather than once per chunk.
+ *
+ * Lookups hash the region name once and then index the region's chunk
+ * slots directly, so they cost the same however full the cache is. A hit
+ * makes no syscalls.
+ *
+ * The cache doesn't watch the files. After a region has been written,
+ * refresh() reads its timestamp table again and drops the chunks whose
+ * timestamps changed, keeping the rest.
+ *
+ * All calls are thread-safe. Chunks are parsed outside the lock, so misses
+ * on different chunks don't wait for each other.
+ */
+class ChunkCache {
+  public:
+    typedef std::shared_ptr<const Document> Handle;
+
+    struct Stats {
+      size_t hits;
+      size_t misses;
+      size_t evictions;
+    };
+
+    explicit ChunkCache(size_t budget);
+
+    // no copy
+    ChunkCache(const ChunkCache& other) = delete;
+    ChunkCache& operator=(const ChunkCache& other) = delete;
+
+    /**
+     * The chunk, from the cache or parsed from the region file, or an empty
+     * handle if the region doesn't hold it. Throws NBTException if the
+     * region file or the chunk can't be read.
+     */
+    Handle get(const std::string& region, int x, int z);
+
+    /**
+     * Rereads a region's tables, dropping the chunks that have changed, and
+     * returns how many were dropped. Throws NBTException if the region file
+     * can't be read any more, after dropping all of its chunks.
+     */
+    size_t refresh(const std::string& region);
+
+    /**
+     * Refreshes every region in the cache.
+     */
+    size_t refresh();
+
+    /**
+     * Drops every chunk and unmaps every region.
+     */
+    void clear();
+
+    /**
+     * Changes the budget, evicting chunks as needed.
+     */
+    void setBudget(size_t budget);
+
+    size_t budget() const;
+
+    /**
+     * Bytes held by the chunks in the cache.
+     */
+    size_t bytes() const;
+
+    /**
+     * Number of chunks in the cache.
+     */
+    size_t size() const;
+
+    Stats stats() const;
+
+    /**
+     * The table the chunks' names are interned in, shared by every chunk
+     * the cache hands out. Intern lookup keys in it once to find children
+     * with Node::findInterned().
+     */
+    const std::shared_ptr<NameTable>& nameTable() const {
+      return mNames;
+    }
+
+  private:
+    struct Region;
+
+    struct Entry {
+      Region* region;
+      int index;
+      uint32_t timestamp;
+      size_t bytes;
+      Handle document;
+    };
+
+    typedef std::list<Entry>::iterator EntryIt;
+
+    struct Region {
+      // Replaced by refresh(); shared with misses being parsed
+      std::shared_ptr<const RegionFile> file;
+      // Cached chunks by table index, or mEntries.end()
+      std::vector<EntryIt> slots;
+    };
+
+    Region& region(const std::string& name);
+    void erase(EntryIt it);
+    void evict();
+    size_t refresh(Region& region, const std::string& name);
+
+    mutable std::mutex mMutex;
+    size_t mBudget;
+    size_t mBytes;
+    Stats mStats;
+    // Most recently used first
+    std::list<Entry> mEntries;
+    std::unordered_map<std::string, std::unique_ptr<Region>> mRegions;
+    std::shared_ptr<NameTable> mNames;
+};
+
+
+#endif // NBT_CACHE_HPP
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_CURSOR_HPP
+#define NBT_CURSOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+/**
+ * Pull parser: a cursor over the tags of an NBTReader that the caller moves
+ * explicitly. It holds no tree, only one frame per open compound or list, so
+ * reading can be interleaved with other work and abandoned at any point.
+ *
+ *     NBTFile file{"level.dat"};
+ *     NBTCursor cursor{file};
+ *     cursor.next();           // the root compound
+ *     cursor.enter();
+ *     while (cursor.next()) {
+ *       if (cursor.name() == "Data") { ... }
+ *     }
+ *
+ * next() moves to the following tag in the current compound or list,
+ * skipping whatever of the current tag hasn't been read. enter() steps into
+ * the current compound or list, and leave() skips the rest of it and steps
+ * back out, onto the compound or list itself.
+ *
+ * Names and strings are views into a buffer owned by the cursor (or into the
+ * input's buffer, for contiguous inputs), valid until the cursor moves.
+ */
+template <typename Input>
+class NBTCursor {
+  public:
+    explicit NBTCursor(NBTReader<Input>& reader) :
+      mReader{&reader},
+      mFrames{},
+      mID{TagID::END},
+      mName{},
+      mNameBuffer{},
+      mString{},
+      mPending{false},
+      mRootRead{false}
+    { }
+
+    /**
+     * Moves to the next tag at the current level. Returns false, leaving the
+     * cursor on TagID::END, when there are none left.
+     */
+    bool next();
+
+    /**
+     * Steps into the current compound or list; call next() to move to its
+     * first child. Throws NBTTagException if the current tag is something
+     * else, or has already been read.
+     */
+    void enter();
+
+    /**
+     * Skips the rest of the innermost compound or list entered, and steps
+     * back out onto it. Its name isn't kept, so name() is empty afterwards.
+     */
+    void leave();
+
+    /**
+     * Skips the payload of the current tag, returning the number of bytes
+     * skipped. next() does this implicitly.
+     */
+    size_t skip();
+
+    TagID tagId() const {
+      return mID;
+    }
+
+    std::string_view name() const {
+      return mName;
+    }
+
+    /**
+     * Number of compounds and lists entered.
+     */
+    size_t depth() const {
+      return mFrames.size();
+    }
+
+    /**
+     * Element type and size of the innermost list entered.
+     */
+    TagID elementID() const;
+    int32_t listSize() const;
+
+    /**
+     * Reads the value of the current tag, if it is a number of type T.
+     */
+    template <typename T>
+    typename T::type read();
+
+    /**
+     * Reads the value of the current tag, if it is a StringTag.
+     */
+    std::string_view readString();
+
+    /**
+     * Reads the current tag into a tag of the matching class.
+     */
+    std::shared_ptr<TagBase> readTag();
+
+  private:
+    struct Frame {
+      TagID id;
+      TagID elementID;
+      int32_t size;
+      // List elements left, or 0 once a compound's end tag has been read
+      int32_t remaining;
+    };
+
+    void consume(TagID expected);
+    void readCurrentName();
+
+    NBTReader<Input>* mReader;
+    std::vector<Frame> mFrames;
+    TagID mID;
+    std::string_view mName;
+    std::string mNameBuffer;
+    std::string mString;
+    // Whether the payload of the current tag is still unread
+    bool mPending;
+    bool mRootRead;
+};
+
+
+// -----------------------------------------------------------------------------
+
+template <typename Input>
+void NBTCursor<Input>::readCurrentName() {
+  if constexpr (is_contiguous_input<Input>::value) {
+    mName = mReader->readNameView();
+  }
+  else {
+    mReader->readName(mNameBuffer);
+    mName = mNameBuffer;
+  }
+}
+
+template <typename Input>
+bool NBTCursor<Input>::next() {
+  skip();
+  mID = TagID::END;
+  mName = std::string_view{};
+  if (mFrames.empty()) {
+    if (mRootRead) {
+      return false;
+    }
+    mRootRead = true;
+    mID = mReader->readID();
+    if (mID == TagID::END) {
+      return false;
+    }
+    readCurrentName();
+  }
+  else {
+    Frame& frame = mFrames.back();
+    if (frame.remaining == 0) {
+      return false;
+    }
+    if (frame.id == TagID::LIST) {
+      frame.remaining--;
+      mID = frame.elementID;
+    }
+    else {
+      mID = mReader->readID();
+      if (mID == TagID::END) {
+        frame.remaining = 0;
+        return false;
+      }
+      readCurrentName();
+    }
+  }
+  mPending = true;
+  return true;
+}
+
+template <typename Input>
+void NBTCursor<Input>::enter() {
+  if (!mPending || (mID != TagID::COMPOUND && mID != TagID::LIST)) {
+    throw NBTTagException(mID, "Can only enter an unread compound or list");
+  }
+  if (static_cast<int>(mFrames.size()) >= NBTReader<Input>::MAX_DEPTH) {
+    throw NBTException{"Tags are nested too deeply"};
+  }
+  mPending = false;
+  if (mID == TagID::LIST) {
+    TagID elementID = mReader->readID();
+    int32_t size = std::max(mReader->readSize(), 0);
+    // Ends have no payload, so a list of them is empty whatever its size
+    // says.
+    if (elementID == TagID::END) {
+      size = 0;
+    }
+    mFrames.push_back(Frame{TagID::LIST, elementID, size, size});
+  }
+  else {
+    mFrames.push_back(Frame{TagID::COMPOUND, TagID::END, 0, 1});
+  }
+}
+
+template <typename Input>
+void NBTCursor<Input>::leave() {
+  if (mFrames.empty()) {
+    throw NBTException{"Not inside a compound or list"};
+  }
+  skip();
+  Frame& frame = mFrames.back();
+  if (frame.id == TagID::LIST) {
+    for (; frame.remaining > 0; frame.remaining--) {
+      mReader->skipPayload(frame.elementID);
+    }
+  }
+  else if (frame.remaining > 0) {
+    for (TagID id = mReader->readID(); id != TagID::END; id = mReader->readID()) {
+      mReader->skipTag(id);
+    }
+  }
+  mID = frame.id;
+  mFrames.pop_back();
+  // The name of the container is long gone by now.
+  mName = std::string_view{};
+}
+
+template <typename Input>
+size_t NBTCursor<Input>::skip() {
+  if (!mPending) {
+    return 0;
+  }
+  mPending = false;
+  return mReader->skipPayload(mID);
+}
+
+template <typename Input>
+TagID NBTCursor<Input>::elementID() const {
+  for (auto it = mFrames.rbegin(); it != mFrames.rend(); ++it) {
+    if (it->id == TagID::LIST) {
+      return it->elementID;
+    }
+  }
+  throw NBTException{"Not inside a list"};
+}
+
+template <typename Input>
+int32_t NBTCursor<Input>::listSize() const {
+  for (auto it = mFrames.rbegin(); it != mFrames.rend(); ++it) {
+    if (it->id == TagID::LIST) {
+      return it->size;
+    }
+  }
+  throw NBTException{"Not inside a list"};
+}
+
+template <typename Input>
+void NBTCursor<Input>::consume(TagID expected) {
+  if (!mPending || mID != expected) {
+    throw NBTTagException(mID, "Current tag is read or has a different type");
+  }
+  mPending = false;
+}
+
+template <typename Input>
+template <typename T>
+typename T::type NBTCursor<Input>::read() {
+  static_assert(std::is_arithmetic<typename T::type>::value,
+                "Use readString or readTag for other tags");
+  consume(getTagID<T>());
+  return mReader->template readNumber<typename T::type>();
+}
+
+template <typename Input>
+std::string_view NBTCursor<Input>::readString() {
+  consume(TagID::STRING);
+  size_t length = static_cast<uint16_t>(mReader->template readNumber<int16_t>());
+  if constexpr (is_contiguous_input<Input>::value) {
+    return std::string_view{mReader->readView(length), length};
+  }
+  else {
+    mString.resize(length);
+    mReader->readBytes(&mString[0], length);
+    return mString;
+  }
+}
+
+template <typename Input>
+std::shared_ptr<TagBase> NBTCursor<Input>::readTag() {
+  consume(mID);
+  return mReader->readPayload(mID, std::string{mName});
+}
+
+
+#endif // NBT_CURSOR_HPP
@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_DOCUMENT_HPP
+#define NBT_DOCUMENT_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+/**
+ * Bump allocator. Allocations are never freed one by one; everything goes
+ * away at once when the arena is reset or destroyed. Blocks are kept across
+ * reset() so that a reused arena stops allocating once it has warmed up.
+ */
+class Arena {
+  public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    explicit Arena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+
+    // no copy
+    Arena(const Arena& other) = delete;
+    Arena& operator=(const Arena& other) = delete;
+
+    // only move
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+
+    void* allocate(size_t size, size_t align) {
+      size_t offset = (mUsed + align - 1) & ~(align - 1);
+      if (offset + size > mCapacity) {
+        return allocateSlow(size, align);
+      }
+      mUsed = offset + size;
+      return mCurrent + offset;
+    }
+
+    /**
+     * Uninitialized storage for count objects of type T, which must not need
+     * a destructor.
+     */
+    template <typename T>
+    T* allocate(size_t count) {
+      static_assert(std::is_trivially_destructible<T>::value,
+                    "Arena memory is released without running destructors");
+      return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    std::string_view copy(std::string_view str);
+
+    /**
+     * Forgets every allocation, keeping the blocks for reuse.
+     */
+    void reset();
+
+    /**
+     * Bytes handed out since the last reset, including alignment padding.
+     */
+    size_t bytesUsed() const;
+
+    /**
+     * Bytes held in blocks, used or not.
+     */
+    size_t bytesReserved() const;
+
+  private:
+    void* allocateSlow(size_t size, size_t align);
+    void useBlock(size_t index);
+
+    struct Block {
+      std::unique_ptr<char[]> data;
+      size_t size;
+    };
+
+    size_t mBlockSize;
+    std::vector<Block> mBlocks;
+    size_t mBlock;
+    size_t mUsedBefore;
+    char* mCurrent;
+    size_t mUsed;
+    size_t mCapacity;
+};
+
+
+/**
+ * How the value of tag type T is handed out by Node::value<T>().
+ */
+template <typename T>
+struct node_value {
+  typedef typename T::type type;
+};
+
+template <>
+struct node_value<StringTag> {
+  typedef std::string_view type;
+};
+
+template <TagID tagID, typename T>
+struct node_value<ArrayTag<tagID, T>> {
+  typedef ArrayRef<T> type;
+};
+
+
+class Document;
+class NameTable;
+
+/**
+ * One tag in a Document. Nodes, their names, and their payloads all live in
+ * the document's arena, so a Node is only valid as long as its Document.
+ *
+ * Compounds and lists both have children: a compound's children are its
+ * named tags, and a list's children are its (unnamed) elements.
+ */
+class Node {
+  public:
+    TagID id() const {
+      return mId;
+    }
+
+    std::string_view name() const {
+      return std::string_view{mName, mNameSize};
+    }
+
+    /**
+     * Type of the elements of a list.
+     */
+    TagID elementID() const {
+      return mElementId;
+    }
+
+    /**
+     * Number of children of a compound or list, number of elements of an
+     * array, or length of a string.
+     */
+    size_t size() const {
+      return mSize;
+    }
+
+    const Node* begin() const {
+      return hasChildren() ? mValue.children : nullptr;
+    }
+
+    const Node* end() const {
+      return hasChildren() ? mValue.children + mSize : nullptr;
+    }
+
+    const Node& at(size_t i) const;
+
+    /**
+     * First child of a compound named name, or nullptr. This is a linear
+     * scan.
+     */
+    const Node* find(std::string_view name) const;
+
+    /**
+     * First child of a compound with the interned name name, comparing
+     * pointers rather than bytes. name has to come from the NameTable the
+     * document was read with.
+     */
+    const Node* findInterned(std::string_view name) const;
+
+    /**
+     * The value of a node of tag type T. Numbers are returned by value,
+     * strings as std::string_view and arrays as ArrayRef. Throws
+     * NBTTagException if the node has a different type.
+     */
+    template <typename T>
+    typename node_value<T>::type value() const;
+
+  private:
+    friend class Document;
+
+    bool hasChildren() const {
+      return mId == TagID::COMPOUND || mId == TagID::LIST;
+    }
+
+    TagID mId;
+    TagID mElementId;
+    uint16_t mNameSize;
+    uint32_t mSize;
+    const char* mName;
+    union {
+      int64_t integer;
+      float f;
+      double d;
+      const char* bytes;
+      const void* array;
+      Node* children;
+    } mValue;
+};
+
+
+/**
+ * An NBT tree whose nodes, names and payloads are allocated from a single
+ * arena. Parsing costs a handful of block allocations rather than one per
+ * tag, and the whole tree is freed at once.
+ *
+ *     MappedNBTFile file{"level.dat"};
+ *     Document doc = readDocument(file);
+ *     int32_t version = doc.root().find("Data")->find("version")->value<IntTag>();
+ */
+class Document {
+  public:
+    Document();
+
+    // no copy
+    Document(const Document& other) = delete;
+    Document& operator=(const Document& other) = delete;
+
+    // only move
+    Document(Document&& other) = default;
+    Document& operator=(Document&& other) = default;
+
+    /**
+     * Parses one tag (ID, name and payload) from reader, replacing what was in
+     * the document and reusing its arena.
+     *
+     * If borrow is true and the input is contiguous, names, strings and byte
+     * arrays point into the input's buffer instead of being copied, so that
+     * buffer has to outlive the document. Int and long arrays are always
+     * copied, since they have to be byte-swapped.
+     */
+    template <typename Input>
+    void read(NBTReader<Input>& reader, bool borrow = false);
+
+    /**
+     * The root tag, usually an unnamed compound.
+     */
+    const Node& root() const;
+
+    bool empty() const {
+      return mRoot == nullptr;
+    }
+
+    void clear();
+
+    const Arena& arena() const {
+      return mArena;
+    }
+
+    /**
+     * Interns names in table from the next read() on, instead of copying
+     * them into the arena (or, when borrowing, pointing into the input).
+     * The document keeps the table alive. nullptr turns interning off.
+     */
+    void setNameTable(std::shared_ptr<NameTable> table);
+
+    const std::shared_ptr<NameTable>& nameTable() const {
+      return mNames;
+    }
+
+    /**
+     * Bytes of memory held, used or not: the arena's blocks, scratch space
+     * and the Document itself. Interned names belong to their table and
+     * aren't counted.
+     */
+    size_t memoryUsage() const;
+
+    /**
+     * Deepest nesting of compounds and lists that will be parsed.
+     */
+    static constexpr int MAX_DEPTH = 512;
+
+  private:
+    template <typename Input, bool borrow>
+    void readPayload(NBTReader<Input>& reader, Node& node, int depth);
+
+    template <typename Input, bool borrow>
+    std::string_view readString(NBTReader<Input>& reader);
+
+    template <typename T, typename Input>
+    const T* readArray(NBTReader<Input>& reader, size_t count);
+
+    template <typename Input, bool borrow>
+    Node* readList(NBTReader<Input>& reader, Node& list, int depth);
+
+    template <typename Input, bool borrow>
+    std::string_view readName(NBTReader<Input>& reader);
+
+    std::string_view intern(std::string_view name);
+
+    Arena mArena;
+    Node* mRoot;
+    // Children of the compounds being parsed, before they're copied into the
+    // arena. Kept across reads so it doesn't need to grow again.
+    std::vector<Node> mScratch;
+    std::shared_ptr<NameTable> mNames;
+    // Names read from streaming inputs, before they're interned
+    std::string mNameBuffer;
+};
+
+/**
+ * Parses one tag from reader into a new Document. See Document::read.
+ */
+template <typename Input>
+Document readDocument(NBTReader<Input>& reader, bool borrow = false) {
+  Document doc;
+  doc.read(reader, borrow);
+  return doc;
+}
+
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+typename node_value<T>::type Node::value() const {
+  constexpr TagID expected = getTagID<T>();
+  if (mId != expected) {
+    throw NBTTagException(mId, "Tag has a different type");
+  }
+  if constexpr (std::is_same<T, StringTag>::value) {
+    return std::string_view{mValue.bytes, mSize};
+  }
+  else if constexpr (is_array_tag<T>::value) {
+    typedef typename T::type::value_type element_type;
+    return ArrayRef<element_type>{
+      static_cast<const element_type*>(mValue.array), mSize};
+  }
+  else if constexpr (std::is_same<T, FloatTag>::value) {
+    return mValue.f;
+  }
+  else if constexpr (std::is_same<T, DoubleTag>::value) {
+    return mValue.d;
+  }
+  else {
+    return static_cast<typename T::type>(mValue.integer);
+  }
+}
+
+
+template <typename Input>
+void Document::read(NBTReader<Input>& reader, bool borrow) {
+  clear();
+  Node* root = mArena.allocate<Node>(1);
+  root->mId = reader.readID();
+  root->mElementId = TagID::END;
+  if (root->mId == TagID::END) {
+    root->mName = nullptr;
+    root->mNameSize = 0;
+    root->mSize = 0;
+    root->mValue.integer = 0;
+    mRoot = root;
+    return;
+  }
+  if constexpr (is_contiguous_input<Input>::value) {
+    if (borrow) {
+      std::string_view name = readName<Input, true>(reader);
+      root->mName = name.data();
+      root->mNameSize = static_cast<uint16_t>(name.size());
+      readPayload<Input, true>(reader, *root, 0);
+      mRoot = root;
+      return;
+    }
+  }
+  std::string_view name = readName<Input, false>(reader);
+  root->mName = name.data();
+  root->mNameSize = static_cast<uint16_t>(name.size());
+  readPayload<Input, false>(reader, *root, 0);
+  mRoot = root;
+}
+
+/**
+ * Reads a length-prefixed string, either pointing into the input or copied
+ * into the arena.
+ */
+template <typename Input, bool borrow>
+std::string_view Document::readString(NBTReader<Input>& reader) {
+  size_t size = reader.template readNumber<uint16_t>();
+  if constexpr (borrow) {
+    return std::string_view{reader.readView(size), size};
+  }
+  else {
+    char* str = mArena.allocate<char>(size);
+    reader.readBytes(str, size);
+    return std::string_view{str, size};
+  }
+}
+
+/**
+ * Reads a name: interned if there's a name table, like a string otherwise.
+ */
+template <typename Input, bool borrow>
+std::string_view Document::readName(NBTReader<Input>& reader) {
+  if (mNames == nullptr) {
+    return readString<Input, borrow>(reader);
+  }
+  size_t size = reader.template readNumber<uint16_t>();
+  if constexpr (is_contiguous_input<Input>::value) {
+    return intern(std::string_view{reader.readView(size), size});
+  }
+  else {
+    mNameBuffer.resize(size);
+    reader.readBytes(&mNameBuffer[0], size);
+    return intern(mNameBuffer);
+  }
+}
+
+/**
+ * Reads an array payload into the arena. Sizes come from the input, so
+ * they're checked against the bytes left before allocating when the input is
+ * contiguous; streaming inputs fill a buffer in bounded steps first, so a
+ * corrupt size runs out of input rather than memory.
+ */
+template <typename T, typename Input>
+const T* Document::readArray(NBTReader<Input>& reader, size_t count) {
+  constexpr size_t step = (1 << 20) / sizeof(T);
+  if constexpr (is_contiguous_input<Input>::value) {
+    const char* payload = reader.readView(count * sizeof(T));
+    T* values = mArena.allocate<T>(count);
+    if (count > 0) {
+      std::memcpy(values, payload, count * sizeof(T));
+      swapInPlace(values, count);
+    }
+    return values;
+  }
+  else if (count <= step) {
+    T* values = mArena.allocate<T>(count);
+    reader.readNumbers(values, count);
+    return values;
+  }
+  else {
+    std::vector<T> buffer;
+    while (buffer.size() < count) {
+      size_t done = buffer.size();
+      size_t n = std::min(count - done, step);
+      buffer.resize(done + n);
+      reader.readNumbers(buffer.data() + done, n);
+    }
+    T* values = mArena.allocate<T>(count);
+    std::copy(buffer.begin(), buffer.end(), values);
+    return values;
+  }
+}
+
+/**
+ * Reads the elements of a list whose element ID and size are already in
+ * list. Every element takes at least a byte, so a contiguous input can't
+ * hold more elements than it has bytes left. Long lists from streaming
+ * inputs go through the scratch stack, like compound children, so they only
+ * take memory as their elements are actually read.
+ */
+template <typename Input, bool borrow>
+Node* Document::readList(NBTReader<Input>& reader, Node& list, int depth) {
+  constexpr size_t step = (1 << 20) / sizeof(Node);
+  bool bounded = true;
+  if constexpr (is_contiguous_input<Input>::value) {
+    if (list.mSize > reader.remaining()) {
+      throw NBTException{"List is longer than the input"};
+    }
+  }
+  else {
+    bounded = list.mSize <= step;
+  }
+  Node element;
+  element.mId = list.mElementId;
+  element.mElementId = TagID::END;
+  element.mName = nullptr;
+  element.mNameSize = 0;
+  if (bounded) {
+    Node* elements = mArena.allocate<Node>(list.mSize);
+    for (uint32_t i = 0; i < list.mSize; i++) {
+      elements[i] = element;
+      readPayload<Input, borrow>(reader, elements[i], depth + 1);
+    }
+    return elements;
+  }
+  size_t first = mScratch.size();
+  for (uint32_t i = 0; i < list.mSize; i++) {
+    Node next = element;
+    readPayload<Input, borrow>(reader, next, depth + 1);
+    mScratch.push_back(next);
+  }
+  Node* elements = mArena.allocate<Node>(list.mSize);
+  std::copy(mScratch.begin() + first, mScratch.end(), elements);
+  mScratch.resize(first);
+  return elements;
+}
+
+template <typename Input, bool borrow>
+void Document::readPayload(NBTReader<Input>& reader, Node& node, int depth) {
+  switch (node.mId) {
+    case TagID::BYTE:
+      node.mSize = 0;
+      node.mValue.integer = reader.template readNumber<int8_t>();
+      break;
+    case TagID::SHORT:
+      node.mSize = 0;
+      node.mValue.integer = reader.template readNumber<int16_t>();
+      break;
+    case TagID::INT:
+      node.mSize = 0;
+      node.mValue.integer = reader.template readNumber<int32_t>();
+      break;
+    case TagID::LONG:
+      node.mSize = 0;
+      node.mValue.integer = reader.template readNumber<int64_t>();
+      break;
+    case TagID::FLOAT:
+      node.mSize = 0;
+      node.mValue.f = reader.template readNumber<float>();
+      break;
+    case TagID::DOUBLE:
+      node.mSize = 0;
+      node.mValue.d = reader.template readNumber<double>();
+      break;
+    case TagID::STRING:
+      {
+        std::string_view str = readString<Input, borrow>(reader);
+        node.mSize = static_cast<uint32_t>(str.size());
+        node.mValue.bytes = str.data();
+      }
+      break;
+    case TagID::BYTE_ARRAY:
+      {
+        int32_t size = reader.readSize();
+        if (size < 0) {
+          throw NBTException{"Negative array size"};
+        }
+        node.mSize = static_cast<uint32_t>(size);
+        if constexpr (borrow) {
+          node.mValue.array = reader.readView(node.mSize);
+        }
+        else {
+          node.mValue.array = readArray<int8_t>(reader, node.mSize);
+        }
+      }
+      break;
+    case TagID::INT_ARRAY:
+      {
+        int32_t size = reader.readSize();
+        if (size < 0) {
+          throw NBTException{"Negative array size"};
+        }
+        node.mSize = static_cast<uint32_t>(size);
+        node.mValue.array = readArray<int32_t>(reader, node.mSize);
+      }
+      break;
+    case TagID::LONG_ARRAY:
+      {
+        int32_t size = reader.readSize();
+        if (size < 0) {
+          throw NBTException{"Negative array size"};
+        }
+        node.mSize = static_cast<uint32_t>(size);
+        node.mValue.array = readArray<int64_t>(reader, node.mSize);
+      }
+      break;
+    case TagID::LIST:
+      {
+        if (depth >= MAX_DEPTH) {
+          throw NBTException{"Tags are nested too deeply"};
+        }
+        node.mElementId = reader.readID();
+        int32_t size = reader.readSize();
+        if (size < 0) {
+          throw NBTException{"Negative list size"};
+        }
+        if (size > 0 && node.mElementId == TagID::END) {
+          throw NBTTagException(node.mElementId, "Unrecognized tag in list");
+        }
+        node.mSize = static_cast<uint32_t>(size);
+        node.mValue.children = readList<Input, borrow>(reader, node, depth);
+      }
+      break;
+    case TagID::COMPOUND:
+      {
+        if (depth >= MAX_DEPTH) {
+          throw NBTException{"Tags are nested too deeply"};
+        }
+        // Children go on the scratch stack until the END tag tells us how
+        // many there are. Nested compounds push theirs above ours and pop
+        // them again before we get control back.
+        size_t first = mScratch.size();
+        TagID id;
+        while ((id = reader.readID()) != TagID::END) {
+          Node child;
+          child.mId = id;
+          child.mElementId = TagID::END;
+          std::string_view name = readName<Input, borrow>(reader);
+          child.mName = name.data();
+          child.mNameSize = static_cast<uint16_t>(name.size());
+          readPayload<Input, borrow>(reader, child, depth + 1);
+          mScratch.push_back(child);
+        }
+        size_t count = mScratch.size() - first;
+        Node* children = mArena.allocate<Node>(count);
+        std::copy(mScratch.begin() + first, mScratch.end(), children);
+        mScratch.resize(first);
+        node.mSize = static_cast<uint32_t>(count);
+        node.mValue.children = children;
+      }
+      break;
+    default:
+      throw NBTTagException(node.mId, "Unrecognized tag");
+  }
+}
+
+
+#endif // NBT_DOCUMENT_HPP
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_EVENTS_HPP
+#define NBT_EVENTS_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+/**
+ * Visitor with a no-op handler for every event, to inherit from when only a
+ * few are interesting. Handlers of the derived class hide all overloads of
+ * the same name here, so add e.g. `using NBTVisitor::value;` when overriding
+ * only some of the value() overloads.
+ *
+ * Names and values are only valid for the duration of the call. Elements of
+ * lists have empty names.
+ */
+struct NBTVisitor {
+  void beginCompound(std::string_view) { }
+  void endCompound() { }
+  void beginList(std::string_view, TagID, int32_t) { }
+  void endList() { }
+  void value(std::string_view, int8_t) { }
+  void value(std::string_view, int16_t) { }
+  void value(std::string_view, int32_t) { }
+  void value(std::string_view, int64_t) { }
+  void value(std::string_view, float) { }
+  void value(std::string_view, double) { }
+  void value(std::string_view, std::string_view) { }
+  void array(std::string_view, ArrayRef<int8_t>) { }
+  void array(std::string_view, ArrayRef<int32_t>) { }
+  void array(std::string_view, ArrayRef<int64_t>) { }
+};
+
+
+/**
+ * Push parser: walks one tag and reports it to a visitor as a sequence of
+ * events, without building anything. The visitor is a template parameter, so
+ * every event is a direct (usually inlined) call, and memory use depends on
+ * the nesting depth rather than the size of the document.
+ *
+ * Arrays are handed out in host byte order from scratch buffers that the
+ * parser keeps between calls to parse().
+ */
+class EventParser {
+  public:
+    EventParser() = default;
+
+    /**
+     * Reads the next tag (ID, name and payload) and reports it to visitor.
+     * Throws NBTException if the input ends early.
+     */
+    template <typename Input, typename Visitor>
+    void parse(NBTReader<Input>& reader, Visitor& visitor);
+
+    /**
+     * Reports the payload of a tag whose ID and name have already been
+     * consumed.
+     */
+    template <typename Input, typename Visitor>
+    void parsePayload(NBTReader<Input>& reader, TagID id, std::string_view name,
+                      Visitor& visitor, int depth = 1);
+
+  private:
+    template <typename Input>
+    std::string_view readName(NBTReader<Input>& reader);
+
+    template <typename Input>
+    std::string_view readString(NBTReader<Input>& reader);
+
+    template <typename T, typename Input>
+    ArrayRef<T> readArray(NBTReader<Input>& reader, std::vector<T>& scratch);
+
+    std::string mName;
+    std::string mString;
+    std::vector<int8_t> mBytes;
+    std::vector<int32_t> mInts;
+    std::vector<int64_t> mLongs;
+};
+
+/**
+ * Reads the next tag from reader and reports it to visitor.
+ */
+template <typename Input, typename Visitor>
+void parseEvents(NBTReader<Input>& reader, Visitor& visitor) {
+  EventParser parser;
+  parser.parse(reader, visitor);
+}
+
+
+// -----------------------------------------------------------------------------
+
+template <typename Input>
+std::string_view EventParser::readName(NBTReader<Input>& reader) {
+  if constexpr (is_contiguous_input<Input>::value) {
+    return reader.readNameView();
+  }
+  else {
+    reader.readName(mName);
+    return mName;
+  }
+}
+
+template <typename Input>
+std::string_view EventParser::readString(NBTReader<Input>& reader) {
+  size_t length = static_cast<uint16_t>(reader.template readNumber<int16_t>());
+  if constexpr (is_contiguous_input<Input>::value) {
+    return std::string_view{reader.readView(length), length};
+  }
+  else {
+    mString.resize(length);
+    reader.readBytes(&mString[0], length);
+    return mString;
+  }
+}
+
+template <typename T, typename Input>
+ArrayRef<T> EventParser::readArray(NBTReader<Input>& reader, std::vector<T>& scratch) {
+  int32_t size = reader.readSize();
+  if (size < 0) {
+    throw NBTException{"Negative array size"};
+  }
+  size_t total = static_cast<size_t>(size);
+  if constexpr (is_contiguous_input<Input>::value) {
+    // The bounds check comes first, so a corrupt size can't make us
+    // allocate more than the input holds.
+    const char* payload = reader.readView(total * sizeof(T));
+    scratch.resize(total);
+    if (total > 0) {
+      std::memcpy(scratch.data(), payload, total * sizeof(T));
+      swapInPlace(scratch.data(), total);
+    }
+  }
+  else {
+    // Grow in bounded steps, like NBTReader::readValues.
+    constexpr size_t step = (1 << 20) / sizeof(T);
+    scratch.clear();
+    while (scratch.size() < total) {
+      size_t done = scratch.size();
+      size_t count = std::min(total - done, step);
+      scratch.resize(done + count);
+      reader.readNumbers(scratch.data() + done, count);
+    }
+  }
+  return ArrayRef<T>{scratch.data(), total};
+}
+
+template <typename Input, typename Visitor>
+void EventParser::parse(NBTReader<Input>& reader, Visitor& visitor) {
+  TagID id = reader.readID();
+  if (id == TagID::END) {
+    return;
+  }
+  parsePayload(reader, id, readName(reader), visitor);
+}
+
+template <typename Input, typename Visitor>
+void EventParser::parsePayload(NBTReader<Input>& reader, TagID id,
+                               std::string_view name, Visitor& visitor,
+                               int depth) {
+  if (depth > NBTReader<Input>::MAX_DEPTH) {
+    throw NBTException{"Tags are nested too deeply"};
+  }
+  switch (id) {
+    case TagID::BYTE:
+      visitor.value(name, reader.template readNumber<int8_t>());
+      break;
+    case TagID::SHORT:
+      visitor.value(name, reader.template readNumber<int16_t>());
+      break;
+    case TagID::INT:
+      visitor.value(name, reader.template readNumber<int32_t>());
+      break;
+    case TagID::LONG:
+      visitor.value(name, reader.template readNumber<int64_t>());
+      break;
+    case TagID::FLOAT:
+      visitor.value(name, reader.template readNumber<float>());
+      break;
+    case TagID::DOUBLE:
+      visitor.value(name, reader.template readNumber<double>());
+      break;
+    case TagID::STRING:
+      visitor.value(name, readString(reader));
+      break;
+    case TagID::BYTE_ARRAY:
+      visitor.array(name, readArray(reader, mBytes));
+      break;
+    case TagID::INT_ARRAY:
+      visitor.array(name, readArray(reader, mInts));
+      break;
+    case TagID::LONG_ARRAY:
+      visitor.array(name, readArray(reader, mLongs));
+      break;
+    case TagID::LIST:
+      {
+        TagID elementID = reader.readID();
+        int32_t size = std::max(reader.readSize(), 0);
+        visitor.beginList(name, elementID, size);
+        for (int32_t i = 0; i < size; i++) {
+          parsePayload(reader, elementID, std::string_view{}, visitor, depth + 1);
+        }
+        visitor.endList();
+      }
+      break;
+    case TagID::COMPOUND:
+      visitor.beginCompound(name);
+      for (TagID child = reader.readID(); child != TagID::END; child = reader.readID()) {
+        parsePayload(reader, child, readName(reader), visitor, depth + 1);
+      }
+      visitor.endCompound();
+      break;
+    default:
+      throw NBTTagException(id, "Unrecognized tag");
+  }
+}
+
+
+#endif // NBT_EVENTS_HPP
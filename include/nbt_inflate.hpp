@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_INFLATE_HPP
+#define NBT_INFLATE_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "nbt.hpp"
+
+
+/**
+ * Decompresses gzip or zlib data on the fly for NBTReader. The format is
+ * detected from the first bytes; anything else is passed through as raw NBT.
+ *
+ * Compressed bytes are pulled from the source and inflated one window at a
+ * time as the parser asks for more, so memory use stays at one input chunk,
+ * one output window and zlib's own state, however large the inflated data.
+ *
+ * Throws NBTException if the compressed data is corrupt, or inflates to more
+ * than maxSize() bytes (deflate packs up to about a thousand bytes into one,
+ * so a small corrupt or hostile file could otherwise expand without end). A
+ * truncated stream just ends early, like any other input.
+ */
+class InflateInput {
+  public:
+    static constexpr size_t WINDOW_SIZE = 64 * 1024;
+    static constexpr size_t DEFAULT_MAX_SIZE = size_t{1} << 30;
+
+    /**
+     * Reads compressed data from a file descriptor, which is not closed.
+     */
+    explicit InflateInput(int fd);
+
+    /**
+     * Reads compressed data from a caller-owned buffer, which must outlive
+     * the input. The buffer is handed to zlib directly, without a copy.
+     */
+    InflateInput(const void* data, size_t size);
+
+    /**
+     * Opens and reads a file.
+     */
+    explicit InflateInput(std::string filename);
+
+    ~InflateInput();
+
+    // no copy
+    InflateInput(const InflateInput& other) = delete;
+    InflateInput& operator=(const InflateInput& other) = delete;
+
+    // only move
+    InflateInput(InflateInput&& other) noexcept;
+    InflateInput& operator=(InflateInput&& other) noexcept;
+
+    bool read(void* dst, size_t n) {
+      if (n <= mEnd - mBegin) {
+        std::memcpy(dst, mWindow + mBegin, n);
+        mBegin += n;
+        return true;
+      }
+      return readSlow(static_cast<char*>(dst), n);
+    }
+
+    bool skip(size_t n) {
+      if (n <= mEnd - mBegin) {
+        mBegin += n;
+        return true;
+      }
+      return readSlow(nullptr, n);
+    }
+
+    /**
+     * Whether the source turned out to be gzip or zlib data. Only known once
+     * something has been read.
+     */
+    bool compressed() const;
+
+    /**
+     * Number of decompressed bytes handed out so far.
+     */
+    size_t position() const;
+
+    /**
+     * Most bytes compressed data may inflate to before reads throw.
+     * Uncompressed input isn't limited.
+     */
+    void setMaxSize(size_t maxSize);
+
+    size_t maxSize() const;
+
+  private:
+    struct State;
+
+    bool readSlow(char* dst, size_t n);
+
+    std::unique_ptr<State> mState;
+    // Output window, owned by mState
+    const char* mWindow;
+    size_t mBegin;
+    size_t mEnd;
+};
+
+
+/**
+ * Reads an NBT file that may be gzip- or zlib-compressed, like level.dat.
+ */
+class CompressedNBTFile : public NBTReader<InflateInput> {
+  public:
+    explicit CompressedNBTFile(std::string filename) :
+      NBTReader<InflateInput>{InflateInput{filename}}
+    { }
+};
+
+
+#endif // NBT_INFLATE_HPP
@@ -0,0 +1,326 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_INPUT_HPP
+#define NBT_INPUT_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __has_include(<span>)
+#include <span>
+#endif
+
+
+/*
+ * Byte sources for NBTReader.
+ *
+ * An input only has to provide
+ *
+ *     bool read(void* dst, size_t n);
+ *
+ * which copies the next n bytes to dst, or returns false if fewer than n bytes
+ * are left. Inputs backed by a contiguous buffer can also provide
+ *
+ *     bool view(const char*& ptr, size_t n);
+ *
+ * which points ptr at the next n bytes instead of copying them, enabling the
+ * zero-copy NBTReader calls. Inputs that can step over bytes without copying
+ * them (by advancing a pointer or seeking) can provide
+ *
+ *     bool skip(size_t n);
+ *
+ * which NBTReader::skipTag uses instead of reading into a scratch buffer.
+ * NBTReader is a template over its input, so these calls are
+ * resolved (and usually inlined) at compile time. Any type with that member
+ * can be used, e.g.
+ *
+ *     NBTReader reader{BufferInput{bytes.data(), bytes.size()}};
+ *     CompoundTag root = reader.readCompoundTag();
+ */
+
+
+/**
+ * Reads from a file through std::ifstream.
+ */
+class StreamInput {
+  public:
+    explicit StreamInput(std::string filename);
+
+    bool read(void* dst, size_t n) {
+      file.read(static_cast<char*>(dst), n);
+      return !file.fail();
+    }
+
+    bool skip(size_t n) {
+      file.ignore(static_cast<std::streamsize>(n));
+      return static_cast<size_t>(file.gcount()) == n;
+    }
+
+  private:
+    std::ifstream file;
+};
+
+
+/**
+ * Read-only memory mapping of a whole file. The mapping is released when the
+ * MappedFile is destroyed.
+ */
+class MappedFile {
+  public:
+    /**
+     * How the mapping will be read, passed on to the kernel as a hint for
+     * readahead.
+     */
+    enum Access {
+      SEQUENTIAL,
+      RANDOM
+    };
+
+    explicit MappedFile(std::string filename, Access access = SEQUENTIAL);
+    ~MappedFile();
+
+    // no copy
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+
+    // only move
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const char* data() const {
+      return mData;
+    }
+
+    size_t size() const {
+      return mSize;
+    }
+
+  private:
+    const char* mData;
+    size_t mSize;
+};
+
+
+/**
+ * Reads from a contiguous, caller-owned buffer by walking a pointer over it.
+ * The buffer must outlive the input.
+ */
+class BufferInput {
+  public:
+    BufferInput(const void* data, size_t size) :
+      mData{static_cast<const char*>(data)}, mSize{size}, mPos{0}
+    { }
+
+    template <typename T>
+    explicit BufferInput(const std::vector<T>& bytes) :
+      BufferInput{bytes.data(), bytes.size() * sizeof(T)}
+    { }
+
+#ifdef __cpp_lib_span
+    explicit BufferInput(std::span<const std::byte> bytes) :
+      BufferInput{bytes.data(), bytes.size()}
+    { }
+#endif
+
+    bool read(void* dst, size_t n) {
+      if (n > mSize - mPos) {
+        return false;
+      }
+      std::memcpy(dst, mData + mPos, n);
+      mPos += n;
+      return true;
+    }
+
+    bool view(const char*& ptr, size_t n) {
+      if (n > mSize - mPos) {
+        return false;
+      }
+      ptr = mData + mPos;
+      mPos += n;
+      return true;
+    }
+
+    bool skip(size_t n) {
+      if (n > mSize - mPos) {
+        return false;
+      }
+      mPos += n;
+      return true;
+    }
+
+    const char* data() const {
+      return mData;
+    }
+
+    size_t position() const {
+      return mPos;
+    }
+
+    size_t size() const {
+      return mSize;
+    }
+
+  private:
+    const char* mData;
+    size_t mSize;
+    size_t mPos;
+};
+
+
+/**
+ * Reads from a memory-mapped file by walking a pointer over the mapping.
+ */
+class MappedInput {
+  public:
+    explicit MappedInput(std::string filename) :
+      mFile{filename}, mBuffer{mFile.data(), mFile.size()}
+    { }
+
+    bool read(void* dst, size_t n) {
+      return mBuffer.read(dst, n);
+    }
+
+    bool view(const char*& ptr, size_t n) {
+      return mBuffer.view(ptr, n);
+    }
+
+    bool skip(size_t n) {
+      return mBuffer.skip(n);
+    }
+
+    const char* data() const {
+      return mBuffer.data();
+    }
+
+    size_t position() const {
+      return mBuffer.position();
+    }
+
+    size_t size() const {
+      return mBuffer.size();
+    }
+
+  private:
+    // The mapping doesn't move when a MappedFile is moved, so mBuffer stays
+    // valid across moves.
+    MappedFile mFile;
+    BufferInput mBuffer;
+};
+
+
+/**
+ * Reads from a raw file descriptor (file, pipe, socket) through a fixed-size
+ * buffer, so that small fields don't each cost a syscall. The descriptor is
+ * not closed by the input.
+ */
+class FdInput {
+  public:
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    explicit FdInput(int fd) :
+      mFd{fd},
+      mBuffer{std::make_unique<char[]>(BUFFER_SIZE)},
+      mBegin{0},
+      mEnd{0}
+    { }
+
+    bool read(void* dst, size_t n) {
+      if (n <= mEnd - mBegin) {
+        std::memcpy(dst, mBuffer.get() + mBegin, n);
+        mBegin += n;
+        return true;
+      }
+      return readSlow(static_cast<char*>(dst), n);
+    }
+
+    bool skip(size_t n) {
+      if (n <= mEnd - mBegin) {
+        mBegin += n;
+        return true;
+      }
+      return skipSlow(n);
+    }
+
+  private:
+    bool readSlow(char* dst, size_t n);
+    bool skipSlow(size_t n);
+
+    int mFd;
+    std::unique_ptr<char[]> mBuffer;
+    size_t mBegin;
+    size_t mEnd;
+};
+
+
+/**
+ * Reads from an existing std::istream, which must outlive the input.
+ */
+class IStreamInput {
+  public:
+    explicit IStreamInput(std::istream& stream) :
+      mStream{&stream}
+    { }
+
+    bool read(void* dst, size_t n) {
+      mStream->read(static_cast<char*>(dst), n);
+      return !mStream->fail();
+    }
+
+    bool skip(size_t n) {
+      mStream->ignore(static_cast<std::streamsize>(n));
+      return static_cast<size_t>(mStream->gcount()) == n;
+    }
+
+  private:
+    std::istream* mStream;
+};
+
+
+/**
+ * Whether Input provides view(), i.e. is backed by a contiguous buffer.
+ */
+template <typename Input, typename = void>
+struct is_contiguous_input : std::false_type { };
+
+template <typename Input>
+struct is_contiguous_input<Input, std::void_t<decltype(
+    std::declval<Input&>().view(std::declval<const char*&>(), size_t{}))>> :
+  std::true_type { };
+
+/**
+ * Whether Input provides skip().
+ */
+template <typename Input, typename = void>
+struct has_skip : std::false_type { };
+
+template <typename Input>
+struct has_skip<Input, std::void_t<decltype(
+    std::declval<Input&>().skip(size_t{}))>> :
+  std::true_type { };
+
+
+#endif // NBT_INPUT_HPP
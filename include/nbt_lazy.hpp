@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_LAZY_HPP
+#define NBT_LAZY_HPP
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+class NBTWriter;
+
+
+/**
+ * A compound whose children are only decoded when they're first accessed.
+ *
+ * Reading one walks the payload once, recording the type, name and byte range
+ * of each child without building anything. at(), find() and get() decode a
+ * child into the usual tag classes and cache it; compound() scans a nested
+ * compound the same way, so a lookup only pays for the path it follows.
+ *
+ * It can also be edited and written back out, at a cost proportional to what
+ * changed. Children changed through edit() or set() are marked dirty, and
+ * editCompound() gives a nested compound to edit the same way. write() then
+ * re-encodes only the dirty children, and the compounds on the path to them,
+ * and copies every other child's bytes verbatim from the source buffer.
+ * Changes made through the tags returned by the const accessors aren't
+ * tracked, and are lost when writing.
+ *
+ * A child is edited either as a tag or, if it is a compound, with
+ * editCompound(), not both: edit() re-encodes the changes made through
+ * editCompound() first, and compound() and editCompound() throw
+ * NBTException for a child that has been edited as a tag. The const
+ * accessors return a fresh snapshot of a compound child with changes made
+ * through editCompound(), and leave the nested compound in place. Pointers
+ * from editCompound() stay valid until that child is passed to edit(),
+ * set() or erase().
+ *
+ * Names and byte ranges point into the reader's buffer, which must outlive
+ * the LazyCompound and everything written from it. Decoding mutates the
+ * cache, so a LazyCompound must not be accessed from several threads at once.
+ */
+class LazyCompound {
+  public:
+    LazyCompound();
+
+    /**
+     * Scans the payload of a compound whose ID and name have already been
+     * consumed, leaving the reader just past its end tag.
+     */
+    template <typename Input>
+    void read(NBTReader<Input>& reader, std::string_view name = {});
+
+    std::string_view name() const {
+      return mName;
+    }
+
+    size_t size() const {
+      return mEntries.size();
+    }
+
+    TagID id(size_t i) const {
+      return mEntries.at(i).id;
+    }
+
+    std::string_view name(size_t i) const {
+      return mEntries.at(i).name;
+    }
+
+    /**
+     * Encoded size in bytes of the payload of the i-th child.
+     */
+    size_t payloadSize(size_t i) const {
+      return mEntries.at(i).size;
+    }
+
+    /**
+     * Whether the i-th child has been decoded by at().
+     */
+    bool decoded(size_t i) const {
+      return mEntries.at(i).tag != nullptr;
+    }
+
+    /**
+     * Index of the first child named name, or npos.
+     */
+    size_t indexOf(std::string_view name) const;
+
+    /**
+     * The i-th child, decoded on first access.
+     */
+    std::shared_ptr<TagBase> at(size_t i) const;
+
+    /**
+     * The first child named name, decoded on first access, or nullptr.
+     */
+    std::shared_ptr<TagBase> find(std::string_view name) const;
+
+    /**
+     * The first child named name, if it is a T. Returns nullptr if there is
+     * no such child or it has a different type.
+     */
+    template <typename T>
+    std::shared_ptr<T> get(std::string_view name) const;
+
+    /**
+     * The compound child named name, scanned but not decoded, or nullptr if
+     * there is no such child or it isn't a compound.
+     */
+    const LazyCompound* compound(std::string_view name) const;
+
+    /**
+     * The i-th child, decoded, for changing. The child is marked dirty.
+     */
+    std::shared_ptr<TagBase> edit(size_t i);
+
+    /**
+     * The first child named name, if it is a T, for changing. Returns
+     * nullptr if there is no such child or it has a different type.
+     */
+    template <typename T>
+    std::shared_ptr<T> edit(std::string_view name);
+
+    /**
+     * The compound child named name, for editing its children, or nullptr
+     * if there is no such child or it isn't a compound.
+     */
+    LazyCompound* editCompound(std::string_view name);
+
+    /**
+     * Replaces the first child with the same name as tag, or appends tag if
+     * there is none.
+     */
+    void set(std::shared_ptr<TagBase> tag);
+
+    /**
+     * Removes the first child named name. Returns whether there was one.
+     */
+    bool erase(std::string_view name);
+
+    /**
+     * Whether the i-th child has been changed through edit() or set().
+     */
+    bool dirty(size_t i) const {
+      return mEntries.at(i).dirty;
+    }
+
+    /**
+     * Whether anything in the compound, at any depth, has been changed.
+     */
+    bool modified() const;
+
+    /**
+     * Writes the compound's ID, name and payload.
+     */
+    void write(NBTWriter& writer) const;
+
+    /**
+     * Writes the compound's payload, up to and including its end tag.
+     * Unchanged children are copied from the source buffer with
+     * NBTWriter::writeEncoded, so with a gather threshold set, large runs of
+     * them aren't copied at all.
+     */
+    void writePayload(NBTWriter& writer) const;
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+  private:
+    struct Entry {
+      TagID id;
+      std::string_view name;
+      // The whole tag in the source buffer, from its ID, or nullptr for
+      // children added by set()
+      const char* source;
+      // Payload, after the ID and name
+      const char* payload;
+      size_t size;
+      mutable std::shared_ptr<TagBase> tag;
+      mutable std::unique_ptr<LazyCompound> compound;
+      // tag, rather than the source, holds the child's value
+      mutable bool dirty;
+    };
+
+    std::shared_ptr<TagBase> materialize(const Entry& entry) const;
+    LazyCompound* scanCompound(size_t i) const;
+
+    std::string_view mName;
+    std::vector<Entry> mEntries;
+    // Children have been added or removed
+    bool mChanged;
+};
+
+/**
+ * Reads the name of a compound whose ID has already been consumed, and scans
+ * its payload.
+ */
+template <typename Input>
+LazyCompound readLazyCompound(NBTReader<Input>& reader);
+
+
+// -----------------------------------------------------------------------------
+
+template <typename Input>
+void LazyCompound::read(NBTReader<Input>& reader, std::string_view name) {
+  static_assert(is_contiguous_input<Input>::value,
+                "LazyCompound needs an input backed by a contiguous buffer");
+  mName = name;
+  mEntries.clear();
+  mChanged = false;
+  for (TagID id = reader.readID(); id != TagID::END; id = reader.readID()) {
+    const char* source = reader.readView(0) - 1;
+    Entry entry{id, reader.readNameView(), source, nullptr, 0, nullptr, nullptr, false};
+    entry.payload = reader.readView(0);
+    entry.size = reader.skipPayload(id);
+    mEntries.push_back(std::move(entry));
+  }
+}
+
+template <typename T>
+std::shared_ptr<T> LazyCompound::get(std::string_view name) const {
+  size_t i = indexOf(name);
+  if (i == npos) {
+    return nullptr;
+  }
+  if constexpr (is_list_tag<T>::value) {
+    if (mEntries[i].id != TagID::LIST) {
+      return nullptr;
+    }
+    return std::dynamic_pointer_cast<T>(at(i));
+  }
+  else {
+    if (mEntries[i].id != getTagID<T>()) {
+      return nullptr;
+    }
+    return std::static_pointer_cast<T>(at(i));
+  }
+}
+
+template <typename T>
+std::shared_ptr<T> LazyCompound::edit(std::string_view name) {
+  size_t i = indexOf(name);
+  if (i == npos) {
+    return nullptr;
+  }
+  if constexpr (is_list_tag<T>::value) {
+    if (mEntries[i].id != TagID::LIST) {
+      return nullptr;
+    }
+    return std::dynamic_pointer_cast<T>(edit(i));
+  }
+  else {
+    if (mEntries[i].id != getTagID<T>()) {
+      return nullptr;
+    }
+    return std::static_pointer_cast<T>(edit(i));
+  }
+}
+
+template <typename Input>
+LazyCompound readLazyCompound(NBTReader<Input>& reader) {
+  LazyCompound compound;
+  std::string_view name = reader.readNameView();
+  compound.read(reader, name);
+  return compound;
+}
+
+
+#endif // NBT_LAZY_HPP
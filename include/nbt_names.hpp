@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_NAMES_HPP
+#define NBT_NAMES_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+
+#include "nbt_document.hpp"
+
+
+/**
+ * Interns tag names: each distinct name is stored once, and every lookup of
+ * it returns the same std::string_view, valid for as long as the table. Two
+ * names interned in the same table are equal exactly when their views point
+ * at the same bytes, so same() compares them without looking at the bytes.
+ *
+ * Chunks repeat the same few hundred names over and over, so documents read
+ * with a shared table (see Document::setNameTable) don't each hold a copy.
+ * Names are never removed, so a table fed arbitrary names grows without
+ * bound; give untrusted input a table of its own.
+ *
+ * All calls are thread-safe. The table is split into shards, each with its
+ * own lock, so threads interning different names rarely wait for each
+ * other, and each thread remembers the names it interned last, so repeated
+ * names usually take no lock at all. That memory holds one table at a time:
+ * one table can be shared by every thread, or each can have its own, but a
+ * thread switching back and forth between tables loses it.
+ */
+class NameTable {
+  public:
+    static constexpr size_t SHARDS = 16;
+
+    NameTable();
+
+    // no copy or move, since views point into it
+    NameTable(const NameTable& other) = delete;
+    NameTable& operator=(const NameTable& other) = delete;
+
+    /**
+     * The interned copy of name, adding it if it isn't there yet.
+     */
+    std::string_view intern(std::string_view name);
+
+    /**
+     * The interned copy of name, or a view with a null data() if it hasn't
+     * been interned.
+     */
+    std::string_view find(std::string_view name) const;
+
+    /**
+     * Whether two names interned in the same table are the same name.
+     */
+    static bool same(std::string_view a, std::string_view b) {
+      return a.data() == b.data() && a.size() == b.size();
+    }
+
+    /**
+     * Number of names interned.
+     */
+    size_t size() const;
+
+    /**
+     * Bytes held by the names, including the sets indexing them.
+     */
+    size_t memoryUsage() const;
+
+  private:
+    struct Shard {
+      mutable std::mutex mutex;
+      // Small blocks: a table typically holds a few kilobytes of names.
+      Arena arena{4096};
+      std::unordered_set<std::string_view> names;
+    };
+
+    Shard& shard(std::string_view name);
+    const Shard& shard(std::string_view name) const;
+
+    // Unique for the life of the process, unlike the table's address
+    uint64_t mId;
+    std::array<Shard, SHARDS> mShards;
+};
+
+
+#endif // NBT_NAMES_HPP
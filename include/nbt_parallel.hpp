@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_PARALLEL_HPP
+#define NBT_PARALLEL_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_input.hpp"
+#include "nbt_pool.hpp"
+
+
+/**
+ * Reads the payload of a list of compounds, whose name and element ID have
+ * already been consumed, decoding the elements in parallel on pool. The
+ * result is the same as readTagList<CompoundTag>(TagID::COMPOUND, name).
+ *
+ * Element boundaries are found first with skipPayload(), which only reads
+ * lengths, in a single pass. The elements are then decoded straight from
+ * the input's buffer, in batches spread over the pool, each into its own
+ * slot of a vector sized up front, so order is kept without any merging.
+ *
+ * Worth it for lists of hundreds of compounds or more, like the entities of
+ * a crowded chunk; small lists are decoded in a single batch. Can be called
+ * from a task on pool.
+ */
+template <typename Input>
+ListTag<CompoundTag> readCompoundListParallel(NBTReader<Input>& reader, std::string name,
+                                              WorkStealingPool& pool);
+
+/**
+ * Reads the name, element ID and payload of a list of compounds, like
+ * readTagList<CompoundTag>(). An empty list with elements of type TagID::END,
+ * as the game writes them, is read as an empty list of compounds. Throws
+ * NBTTagException if the elements are of another type.
+ */
+template <typename Input>
+ListTag<CompoundTag> readCompoundListParallel(NBTReader<Input>& reader, WorkStealingPool& pool);
+
+
+// -----------------------------------------------------------------------------
+
+template <typename Input>
+ListTag<CompoundTag> readCompoundListParallel(NBTReader<Input>& reader, std::string name,
+                                              WorkStealingPool& pool) {
+  static_assert(is_contiguous_input<Input>::value,
+                "Elements are decoded straight from the input's buffer");
+  // Fewer elements than this per batch aren't worth a task.
+  constexpr size_t MIN_BATCH = 16;
+
+  int32_t size = reader.readSize();
+  if (size < 0) {
+    throw NBTException{"Negative list size"};
+  }
+  const char* payload = reader.readView(0);
+  // Grown as elements are found, so a corrupt size can't make us allocate
+  // more than the input holds.
+  std::vector<size_t> offsets;
+  offsets.reserve(std::min<size_t>(size, 1 << 16) + 1);
+  offsets.push_back(0);
+  for (int32_t i = 0; i < size; i++) {
+    offsets.push_back(offsets.back() + reader.skipPayload(TagID::COMPOUND));
+  }
+
+  std::vector<CompoundTag> elements(static_cast<size_t>(size));
+  size_t batches = std::min<size_t>(pool.size() * 4, elements.size() / MIN_BATCH + 1);
+  pool.parallelFor(elements.size(), batches,
+      [&](size_t begin, size_t end, unsigned) {
+        for (size_t i = begin; i < end; i++) {
+          NBTReader<BufferInput> element{
+            BufferInput{payload + offsets[i], offsets[i + 1] - offsets[i]}};
+          elements[i] = element.readCompoundTag("");
+        }
+      });
+
+  ListTag<CompoundTag> list{std::move(name), TagID::COMPOUND, size};
+  list.value() = std::move(elements);
+  return list;
+}
+
+template <typename Input>
+ListTag<CompoundTag> readCompoundListParallel(NBTReader<Input>& reader, WorkStealingPool& pool) {
+  std::string name = reader.readName();
+  TagID id = reader.readID();
+  if (id == TagID::END) {
+    if (reader.readSize() < 0) {
+      throw NBTException{"Negative list size"};
+    }
+    return ListTag<CompoundTag>{std::move(name), TagID::COMPOUND, 0};
+  }
+  if (id != TagID::COMPOUND) {
+    throw NBTTagException(id, "List elements are not compounds");
+  }
+  return readCompoundListParallel(reader, std::move(name), pool);
+}
+
+
+#endif // NBT_PARALLEL_HPP
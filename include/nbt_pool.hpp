@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_POOL_HPP
+#define NBT_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Fixed set of worker threads with one task deque each. A worker runs the
+ * newest task from its own deque, and when that is empty steals the oldest
+ * from another's. Tasks submitted from inside a task go to the submitting
+ * worker's deque, so a task that splits its work into subtasks keeps them
+ * local (and cache-warm) until other workers run dry and come to steal.
+ *
+ * Tasks are given the index of the worker running them, from 0 to size() - 1,
+ * for indexing per-thread state without locks.
+ */
+class WorkStealingPool {
+  public:
+    typedef std::function<void(unsigned worker)> Task;
+
+    /**
+     * Starts threads workers, or one per hardware thread if threads is 0.
+     */
+    explicit WorkStealingPool(unsigned threads = 0);
+
+    /**
+     * Runs the tasks still queued, then stops the workers.
+     */
+    ~WorkStealingPool();
+
+    // no copy
+    WorkStealingPool(const WorkStealingPool& other) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool& other) = delete;
+
+    unsigned size() const {
+      return static_cast<unsigned>(mWorkers.size());
+    }
+
+    void submit(Task task);
+
+    /**
+     * Blocks until every task submitted so far has finished. If any of them
+     * threw, rethrows the first exception once the rest are done. Must not
+     * be called from a task.
+     */
+    void wait();
+
+    /**
+     * Calls f(begin, end, worker) on the workers for consecutive ranges
+     * covering [0, count), at most batches of them, and blocks until all
+     * have returned. If any threw, rethrows the first exception once the
+     * rest are done.
+     *
+     * Unlike wait(), this only waits for its own ranges, and it can be
+     * called from a task: the calling worker runs queued tasks, its own
+     * ranges first, instead of sitting idle.
+     */
+    void parallelFor(size_t count, size_t batches,
+                     const std::function<void(size_t begin, size_t end, unsigned worker)>& f);
+
+  private:
+    struct Worker {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+      std::thread thread;
+    };
+
+    void run(unsigned index);
+    bool take(unsigned index, Task& task);
+    void execute(unsigned index, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    // Guards sleeping and waking, not the deques
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    // Tasks in the deques (briefly negative while a task is stolen before
+    // its submitter has counted it)
+    std::atomic<long> mQueued;
+    // Tasks submitted and not yet finished
+    std::atomic<long> mPending;
+    std::atomic<unsigned> mNext;
+    bool mStop;
+    std::exception_ptr mError;
+};
+
+
+#endif // NBT_POOL_HPP
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_QUERY_HPP
+#define NBT_QUERY_HPP
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+/**
+ * One step of a path: a named child of a compound, or one or all elements of
+ * a list.
+ */
+struct PathStep {
+  enum Kind {
+    NAME,
+    INDEX,
+    ALL
+  };
+
+  Kind kind;
+  std::string name;
+  int32_t index;
+
+  bool operator==(const PathStep& other) const {
+    return kind == other.kind && name == other.name && index == other.index;
+  }
+};
+
+/**
+ * Parses a path like "Level.Sections[*].BlockStates" into its steps. Names
+ * are separated by dots and may contain anything but '.' and '['; each can be
+ * followed by list subscripts, either an index or '*'. Paths start inside the
+ * root tag, so a path into a root list starts with a subscript. Throws
+ * NBTException if the path is malformed.
+ */
+std::vector<PathStep> parsePath(std::string_view path);
+
+
+/**
+ * A set of paths compiled for evaluation in a single streaming pass.
+ *
+ * run() reads one tag and calls back with every tag matched by one of the
+ * paths, decoded into the usual tag classes. Subtrees that no path leads into
+ * are skipped with NBTReader::skipPayload instead of being built, so the cost
+ * of a query is mostly that of the data it returns.
+ *
+ *     Query query{"Level.xPos", "Level.Sections[*].BlockStates"};
+ *     query.run(reader, [](size_t path, std::shared_ptr<TagBase> tag) { ... });
+ *
+ * The paths are kept as a trie, so paths with a common prefix share the work
+ * of following it. A path may not be a prefix of another, and a list can't
+ * be subscripted both with '*' and with indices.
+ */
+class Query {
+  public:
+    Query(std::initializer_list<std::string_view> paths);
+    explicit Query(const std::vector<std::string>& paths);
+
+    /**
+     * Number of paths.
+     */
+    size_t size() const {
+      return mPaths;
+    }
+
+    /**
+     * Reads the next tag (ID, name and payload) from reader, calling
+     * onMatch(path, tag) for every match in document order, where path is
+     * the index of the matching path. Returns the number of matches.
+     */
+    template <typename Input, typename F>
+    size_t run(NBTReader<Input>& reader, F&& onMatch) const;
+
+    /**
+     * Like run(), for the payload of a tag whose ID and name have already
+     * been consumed.
+     */
+    template <typename Input, typename F>
+    size_t runPayload(NBTReader<Input>& reader, TagID id, F&& onMatch) const;
+
+    static constexpr uint32_t NO_MATCH = UINT32_MAX;
+
+  private:
+    struct Node {
+      PathStep step;
+      // Index of the path ending here, or NO_MATCH
+      uint32_t match;
+      std::vector<uint32_t> children;
+    };
+
+    void add(std::string_view path);
+    uint32_t findChild(const Node& node, std::string_view name) const;
+    uint32_t findChild(const Node& node, int32_t index) const;
+
+    template <typename Input, typename F>
+    size_t visit(NBTReader<Input>& reader, TagID id, uint32_t node, F& onMatch,
+                 int depth) const;
+
+    std::vector<Node> mNodes;
+    size_t mPaths;
+};
+
+
+// -----------------------------------------------------------------------------
+
+template <typename Input, typename F>
+size_t Query::run(NBTReader<Input>& reader, F&& onMatch) const {
+  TagID id = reader.readID();
+  if (id == TagID::END) {
+    return 0;
+  }
+  if constexpr (is_contiguous_input<Input>::value) {
+    reader.readNameView();
+  }
+  else {
+    reader.readName();
+  }
+  return visit(reader, id, 0, onMatch, 1);
+}
+
+template <typename Input, typename F>
+size_t Query::runPayload(NBTReader<Input>& reader, TagID id, F&& onMatch) const {
+  return visit(reader, id, 0, onMatch, 1);
+}
+
+/**
+ * Evaluates the paths below node against the payload of a tag of type id,
+ * which node has matched.
+ */
+template <typename Input, typename F>
+size_t Query::visit(NBTReader<Input>& reader, TagID id, uint32_t node,
+                    F& onMatch, int depth) const {
+  if (depth > NBTReader<Input>::MAX_DEPTH) {
+    throw NBTException{"Tags are nested too deeply"};
+  }
+  const Node& parent = mNodes[node];
+  size_t matches = 0;
+  if (id == TagID::COMPOUND) {
+    // Names are only compared, so borrow them from the input when we can.
+    std::string buffer;
+    for (TagID childID = reader.readID(); childID != TagID::END;
+         childID = reader.readID()) {
+      std::string_view name;
+      if constexpr (is_contiguous_input<Input>::value) {
+        name = reader.readNameView();
+      }
+      else {
+        reader.readName(buffer);
+        name = buffer;
+      }
+      uint32_t child = findChild(parent, name);
+      if (child == NO_MATCH) {
+        reader.skipPayload(childID);
+      }
+      else if (mNodes[child].match != NO_MATCH) {
+        onMatch(static_cast<size_t>(mNodes[child].match),
+                reader.readPayload(childID, std::string{name}));
+        matches++;
+      }
+      else {
+        matches += visit(reader, childID, child, onMatch, depth + 1);
+      }
+    }
+  }
+  else if (id == TagID::LIST) {
+    TagID elementID = reader.readID();
+    int32_t size = reader.readSize();
+    for (int32_t i = 0; i < size; i++) {
+      uint32_t child = findChild(parent, i);
+      if (child == NO_MATCH) {
+        reader.skipPayload(elementID);
+      }
+      else if (mNodes[child].match != NO_MATCH) {
+        onMatch(static_cast<size_t>(mNodes[child].match),
+                reader.readPayload(elementID, ""));
+        matches++;
+      }
+      else {
+        matches += visit(reader, elementID, child, onMatch, depth + 1);
+      }
+    }
+  }
+  else {
+    // The path leads further down, but this tag has no children.
+    reader.skipPayload(id);
+  }
+  return matches;
+}
+
+
+#endif // NBT_QUERY_HPP
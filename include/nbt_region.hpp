@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#ifndef NBT_REGION_HPP
+#define NBT_REGION_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_inflate.hpp"
+#include "nbt_input.hpp"
+
+
+class NBTWriter;
+
+
+/**
+ * A region file (.mca): 32 x 32 chunks, each stored compressed in its own
+ * run of 4 KiB sectors, behind two 4 KiB tables holding every chunk's
+ * location and the time it was last saved.
+ *
+ * The file is memory-mapped and only the two tables are decoded up front.
+ * Chunks are found with a table lookup and inflated straight out of the
+ * mapping when asked for, so random access to a chunk costs no syscalls.
+ *
+ *     RegionFile region{"world/region/r.0.0.mca"};
+ *     if (region.contains(3, 7)) {
+ *       CompoundTag chunk = region.readChunk(3, 7);
+ *     }
+ *
+ * Chunk coordinates are taken modulo 32, so either coordinates within the
+ * region or absolute chunk coordinates can be used.
+ */
+class RegionFile {
+  public:
+    static constexpr int SIDE = 32;
+    static constexpr int CHUNKS = SIDE * SIDE;
+    static constexpr size_t SECTOR_SIZE = 4096;
+    static constexpr size_t HEADER_SIZE = 2 * SECTOR_SIZE;
+    // Most a chunk may inflate to. Real chunks are well under a megabyte;
+    // anything past this is corrupt.
+    static constexpr size_t MAX_INFLATED_SIZE = 64 << 20;
+
+    /**
+     * Compression schemes, from the byte before each chunk's data.
+     */
+    enum Compression : uint8_t {
+      GZIP = 1,
+      ZLIB = 2,
+      NONE = 3
+    };
+
+    /**
+     * The stored bytes of a chunk, still compressed.
+     */
+    struct ChunkData {
+      uint8_t compression;
+      const char* data;
+      size_t size;
+    };
+
+    /**
+     * Maps a region file. An empty file is an empty region. Throws
+     * NBTException if the file can't be mapped or its tables are truncated.
+     */
+    explicit RegionFile(std::string filename);
+
+    /**
+     * Reads a region held in a caller-owned buffer, which must outlive it.
+     */
+    RegionFile(const void* data, size_t size);
+
+    // no copy
+    RegionFile(const RegionFile& other) = delete;
+    RegionFile& operator=(const RegionFile& other) = delete;
+
+    // only move
+    RegionFile(RegionFile&& other) = default;
+    RegionFile& operator=(RegionFile&& other) = default;
+
+    /**
+     * Position of a chunk in the tables.
+     */
+    static int index(int x, int z) {
+      return (x & (SIDE - 1)) + (z & (SIDE - 1)) * SIDE;
+    }
+
+    /**
+     * Whether the region holds the chunk.
+     */
+    bool contains(int x, int z) const {
+      return mLocations[index(x, z)].sectors != 0;
+    }
+
+    /**
+     * Number of chunks in the region.
+     */
+    size_t chunkCount() const;
+
+    /**
+     * When the chunk was last saved, in seconds since the epoch, or 0 if it
+     * never was.
+     */
+    uint32_t timestamp(int x, int z) const {
+      return mTimestamps[index(x, z)];
+    }
+
+    /**
+     * The chunk's compressed bytes, without copying them. Throws
+     * NBTException if the chunk is missing, lies outside the file, or is
+     * stored in a separate .mcc file.
+     */
+    ChunkData chunkData(int x, int z) const;
+
+    /**
+     * A reader over the chunk's decompressed NBT, for use with any of the
+     * parsers. Throws NBTException if the compression scheme isn't one of
+     * the above.
+     */
+    NBTReader<InflateInput> openChunk(int x, int z) const;
+
+    /**
+     * Decompresses and parses a whole chunk.
+     */
+    CompoundTag readChunk(int x, int z) const;
+
+    const char* data() const {
+      return mData;
+    }
+
+    size_t size() const {
+      return mSize;
+    }
+
+  private:
+    struct Location {
+      // In sectors from the start of the file
+      uint32_t offset;
+      uint32_t sectors;
+    };
+
+    void readHeader();
+
+    // Empty when reading a caller's buffer
+    std::optional<MappedFile> mFile;
+    const char* mData;
+    size_t mSize;
+    std::vector<Location> mLocations;
+    std::vector<uint32_t> mTimestamps;
+};
+
+
+/**
+ * Writes chunks into a region file without rewriting the rest of it.
+ *
+ * Each chunk goes into the first run of free sectors large enough for it,
+ * or onto the end of the file, and its old sectors are freed once the
+ * table points at the new ones. The old copy is never overwritten before
+ * then, so a crash partway through leaves either the old or the new
+ * version, not a half-written chunk. (Without sync() the kernel may still
+ * reorder the writes on their way to the disk, so that holds for a crashed
+ * process, not a power cut.)
+ *
+ * With setInPlace(true), a chunk that still fits in its sectors is instead
+ * overwritten where it is, freeing any sectors it no longer needs. That
+ * keeps files from growing when chunks are rewritten, but is not crash
+ * safe: a torn write loses both versions.
+ *
+ * Freed sectors inside the file stay there until compact() rewrites it.
+ *
+ * RegionFile maps the file as it was when opened, so reopen it to read
+ * chunks written since.
+ */
+class RegionWriter {
+  public:
+    /**
+     * Largest run of sectors one chunk can take, limited by the one-byte
+     * count in the table.
+     */
+    static constexpr size_t MAX_CHUNK_SECTORS = 255;
+
+    /**
+     * Opens a region file for updating, creating it if it doesn't exist.
+     * Table entries pointing outside the file are dropped. Throws
+     * NBTException if the file can't be opened or its tables are
+     * truncated.
+     */
+    explicit RegionWriter(std::string filename);
+
+    ~RegionWriter();
+
+    // no copy
+    RegionWriter(const RegionWriter& other) = delete;
+    RegionWriter& operator=(const RegionWriter& other) = delete;
+
+    // only move
+    RegionWriter(RegionWriter&& other) noexcept;
+    RegionWriter& operator=(RegionWriter&& other) noexcept;
+
+    bool contains(int x, int z) const {
+      return mLocations[RegionFile::index(x, z)].sectors != 0;
+    }
+
+    uint32_t timestamp(int x, int z) const {
+      return mTimestamps[RegionFile::index(x, z)];
+    }
+
+    size_t chunkCount() const;
+
+    /**
+     * Length of the file in sectors, including the tables.
+     */
+    size_t sectorCount() const {
+      return mUsed.size();
+    }
+
+    /**
+     * Sectors in the file that no chunk uses.
+     */
+    size_t freeSectors() const;
+
+    /**
+     * Serializes a chunk, compresses it with zlib and stores it, with the
+     * given timestamp or, if that is 0, the current time. Throws
+     * NBTException if it needs more than MAX_CHUNK_SECTORS sectors or a
+     * write fails.
+     */
+    void writeChunk(int x, int z, const TagBase& chunk, uint32_t timestamp = 0);
+
+    /**
+     * Compresses and stores a chunk that has already been serialized,
+     * including gathered arrays.
+     */
+    void writeChunk(int x, int z, const NBTWriter& chunk, uint32_t timestamp = 0);
+
+    /**
+     * Stores data that is already compressed as described by compression.
+     */
+    void writeChunkData(int x, int z, uint8_t compression, const void* data,
+                        size_t size, uint32_t timestamp = 0);
+
+    /**
+     * Whether chunks that still fit their sectors are overwritten in place.
+     * Off by default; see the class comment.
+     */
+    void setInPlace(bool inPlace) {
+      mInPlace = inPlace;
+    }
+
+    bool inPlace() const {
+      return mInPlace;
+    }
+
+    /**
+     * Drops a chunk from the tables and frees its sectors.
+     */
+    void removeChunk(int x, int z);
+
+    /**
+     * Rewrites the file with its chunks packed together in table order,
+     * through a temporary file that replaces the original once it is
+     * complete and synced. The directory is synced after the rename.
+     */
+    void compact();
+
+    /**
+     * Flushes everything written to the disk.
+     */
+    void sync();
+
+  private:
+    struct Location {
+      uint32_t offset;
+      uint32_t sectors;
+    };
+
+    struct State;
+
+    void readHeader();
+
+    /**
+     * Writes the chunk waiting in the buffer (header and size bytes of data)
+     * and points the tables at it.
+     */
+    void store(int index, uint8_t compression, size_t size, uint32_t timestamp);
+
+    uint32_t allocate(uint32_t sectors);
+    void release(uint32_t offset, uint32_t sectors);
+    void writeAt(int fd, const void* data, size_t size, size_t offset);
+
+    std::string mFilename;
+    int mFd;
+    std::vector<Location> mLocations;
+    std::vector<uint32_t> mTimestamps;
+    // One flag per sector of the file
+    std::vector<bool> mUsed;
+    bool mInPlace;
+    // Compression state and the chunk being stored
+    std::unique_ptr<State> mState;
+};
+
+
+#endif // NBT_REGION_HPP
@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_SCHEMA_HPP
+#define NBT_SCHEMA_HPP
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_value.hpp"
+
+
+/**
+ * Binds the tag named name, of tag class T (IntTag, StringTag,
+ * LongArrayTag, ...), to a member of S of type T::type.
+ */
+template <typename T, typename S>
+struct SchemaField {
+  typedef S object_type;
+  static constexpr TagID id = getTagID<T>();
+
+  std::string_view name;
+  typename T::type S::* member;
+
+  template <typename Input>
+  void read(NBTReader<Input>& reader, S& out) const;
+};
+
+/**
+ * Binds a list of tags of class T to a std::vector<T::type> member of S.
+ */
+template <typename T, typename S>
+struct SchemaList {
+  typedef S object_type;
+  static constexpr TagID id = TagID::LIST;
+
+  std::string_view name;
+  std::vector<typename T::type> S::* member;
+
+  template <typename Input>
+  void read(NBTReader<Input>& reader, S& out) const;
+};
+
+/**
+ * Binds a compound to a member of S, decoded with its own schema.
+ */
+template <typename S, typename Nested>
+struct SchemaCompound {
+  typedef S object_type;
+  static constexpr TagID id = TagID::COMPOUND;
+
+  std::string_view name;
+  typename Nested::object_type S::* member;
+  Nested schema;
+
+  template <typename Input>
+  void read(NBTReader<Input>& reader, S& out) const;
+};
+
+/**
+ * Binds a list of compounds to a std::vector member of S, each element
+ * decoded with its own schema.
+ */
+template <typename S, typename Nested>
+struct SchemaCompoundList {
+  typedef S object_type;
+  static constexpr TagID id = TagID::LIST;
+
+  std::string_view name;
+  std::vector<typename Nested::object_type> S::* member;
+  Nested schema;
+
+  template <typename Input>
+  void read(NBTReader<Input>& reader, S& out) const;
+};
+
+
+/**
+ * A compile-time mapping from the children of a compound to the members of
+ * a struct S, to decode data of a known shape straight into S without
+ * building a tree:
+ *
+ *     struct Player {
+ *       int32_t dataVersion;
+ *       std::string dimension;
+ *       std::vector<double> pos;
+ *     };
+ *
+ *     constexpr auto playerSchema = makeSchema<Player>(
+ *         schemaField<IntTag>("DataVersion", &Player::dataVersion),
+ *         schemaField<StringTag>("Dimension", &Player::dimension),
+ *         schemaList<DoubleTag>("Pos", &Player::pos));
+ *
+ *     Player player = playerSchema.read(reader);
+ *
+ * Member types are checked against the tag classes' T::type when the schema
+ * is compiled, and tag types against getTagID<T>() when decoding: a child
+ * with a field's name but another type throws NBTTagException. Children with
+ * no field are skipped, and members with no child keep their value.
+ *
+ * Names are matched against a key computed at compile time from each
+ * field's length and first six bytes, which is the whole name for most
+ * names. The search starts after the last field matched, so children
+ * written in schema order are found on the first compare.
+ */
+template <typename S, typename... Fields>
+class Schema {
+  public:
+    typedef S object_type;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    constexpr explicit Schema(Fields... fields) :
+      mFields{fields...},
+      mNames{fields.name...},
+      mKeys{key(fields.name)...}
+    {
+      static_assert((std::is_same<typename Fields::object_type, S>::value && ...),
+                    "Every field must bind a member of S");
+    }
+
+    /**
+     * Reads the ID, name and payload of a compound into a new S. Throws
+     * NBTTagException if the tag is something else.
+     */
+    template <typename Input>
+    S read(NBTReader<Input>& reader) const;
+
+    /**
+     * Reads the payload of a compound whose ID and name have already been
+     * consumed into out, leaving the reader just past its end tag.
+     */
+    template <typename Input>
+    void readPayload(NBTReader<Input>& reader, S& out) const;
+
+    /**
+     * Index of the field named name, searching from hint on, or npos.
+     */
+    constexpr size_t indexOf(std::string_view name, size_t hint = 0) const;
+
+    static constexpr size_t size() {
+      return sizeof...(Fields);
+    }
+
+  private:
+    /**
+     * Length and the first six bytes, which is the whole name if it's no
+     * longer than that.
+     */
+    static constexpr uint64_t key(std::string_view name) {
+      uint64_t result = name.size() & 0xffff;
+      for (size_t i = 0; i < name.size() && i < 6; i++) {
+        result |= static_cast<uint64_t>(static_cast<uint8_t>(name[i])) << (16 + 8 * i);
+      }
+      return result;
+    }
+
+    template <typename Input, size_t... I>
+    void readField(NBTReader<Input>& reader, size_t index, TagID id, S& out,
+                   std::index_sequence<I...>) const;
+
+    std::tuple<Fields...> mFields;
+    std::array<std::string_view, sizeof...(Fields)> mNames;
+    std::array<uint64_t, sizeof...(Fields)> mKeys;
+};
+
+template <typename S, typename... Fields>
+constexpr Schema<S, Fields...> makeSchema(Fields... fields) {
+  return Schema<S, Fields...>{fields...};
+}
+
+template <typename T, typename S>
+constexpr SchemaField<T, S> schemaField(std::string_view name, typename T::type S::* member) {
+  return SchemaField<T, S>{name, member};
+}
+
+template <typename T, typename S>
+constexpr SchemaList<T, S> schemaList(std::string_view name,
+                                      std::vector<typename T::type> S::* member) {
+  return SchemaList<T, S>{name, member};
+}
+
+template <typename S, typename Nested>
+constexpr SchemaCompound<S, Nested> schemaCompound(std::string_view name,
+                                                   typename Nested::object_type S::* member,
+                                                   Nested schema) {
+  return SchemaCompound<S, Nested>{name, member, schema};
+}
+
+template <typename S, typename Nested>
+constexpr SchemaCompoundList<S, Nested> schemaCompoundList(
+    std::string_view name, std::vector<typename Nested::object_type> S::* member,
+    Nested schema) {
+  return SchemaCompoundList<S, Nested>{name, member, schema};
+}
+
+
+// -----------------------------------------------------------------------------
+
+/**
+ * Reads the payload of a tag of class T into value, reusing its storage.
+ */
+template <typename T, typename Input>
+void readSchemaValue(NBTReader<Input>& reader, typename T::type& value) {
+  typedef typename T::type type;
+  if constexpr (std::is_arithmetic<type>::value) {
+    value = reader.template readNumber<type>();
+  }
+  else if constexpr (std::is_same<T, StringTag>::value) {
+    reader.readName(value);
+  }
+  else {
+    int32_t size = reader.readSize();
+    if (size < 0) {
+      throw NBTException{"Negative array size"};
+    }
+    readValueNumbers(reader, value, static_cast<size_t>(size));
+  }
+}
+
+/**
+ * Reads the element ID and size of a list, checking the elements are of
+ * type id. Empty lists, which the game often writes with elements of type
+ * TagID::END, are always accepted.
+ */
+template <typename Input>
+size_t readSchemaListHeader(NBTReader<Input>& reader, TagID id) {
+  TagID elementID = reader.readID();
+  int32_t size = std::max(reader.readSize(), 0);
+  if (size > 0 && elementID != id) {
+    throw NBTTagException(elementID, "List element has a different type than its field");
+  }
+  return static_cast<size_t>(size);
+}
+
+template <typename T, typename S>
+template <typename Input>
+void SchemaField<T, S>::read(NBTReader<Input>& reader, S& out) const {
+  readSchemaValue<T>(reader, out.*member);
+}
+
+template <typename T, typename S>
+template <typename Input>
+void SchemaList<T, S>::read(NBTReader<Input>& reader, S& out) const {
+  size_t size = readSchemaListHeader(reader, getTagID<T>());
+  std::vector<typename T::type>& values = out.*member;
+  if constexpr (std::is_arithmetic<typename T::type>::value) {
+    readValueNumbers(reader, values, size);
+  }
+  else {
+    values.clear();
+    for (size_t i = 0; i < size; i++) {
+      values.emplace_back();
+      readSchemaValue<T>(reader, values.back());
+    }
+  }
+}
+
+template <typename S, typename Nested>
+template <typename Input>
+void SchemaCompound<S, Nested>::read(NBTReader<Input>& reader, S& out) const {
+  schema.readPayload(reader, out.*member);
+}
+
+template <typename S, typename Nested>
+template <typename Input>
+void SchemaCompoundList<S, Nested>::read(NBTReader<Input>& reader, S& out) const {
+  size_t size = readSchemaListHeader(reader, TagID::COMPOUND);
+  std::vector<typename Nested::object_type>& values = out.*member;
+  values.clear();
+  for (size_t i = 0; i < size; i++) {
+    values.emplace_back();
+    schema.readPayload(reader, values.back());
+  }
+}
+
+template <typename S, typename... Fields>
+constexpr size_t Schema<S, Fields...>::indexOf(std::string_view name, size_t hint) const {
+  uint64_t nameKey = key(name);
+  for (size_t n = 0; n < sizeof...(Fields); n++) {
+    size_t i = (hint + n) % sizeof...(Fields);
+    if (mKeys[i] == nameKey && (name.size() <= 6 || mNames[i] == name)) {
+      return i;
+    }
+  }
+  return npos;
+}
+
+template <typename S, typename... Fields>
+template <typename Input, size_t... I>
+void Schema<S, Fields...>::readField(NBTReader<Input>& reader, size_t index, TagID id,
+                                     S& out, std::index_sequence<I...>) const {
+  // Unrolled into a compare and a direct call per field.
+  auto readIf = [&](const auto& field, size_t i) {
+    if (i != index) {
+      return false;
+    }
+    if (id != field.id) {
+      throw NBTTagException(id, "Tag has a different type than its field");
+    }
+    field.read(reader, out);
+    return true;
+  };
+  (readIf(std::get<I>(mFields), I) || ...);
+}
+
+template <typename S, typename... Fields>
+template <typename Input>
+void Schema<S, Fields...>::readPayload(NBTReader<Input>& reader, S& out) const {
+  std::string buffer;
+  size_t next = 0;
+  for (TagID id = reader.readID(); id != TagID::END; id = reader.readID()) {
+    std::string_view name;
+    if constexpr (is_contiguous_input<Input>::value) {
+      name = reader.readNameView();
+    }
+    else {
+      reader.readName(buffer);
+      name = buffer;
+    }
+    size_t i = indexOf(name, next);
+    if (i == npos) {
+      reader.skipPayload(id);
+      continue;
+    }
+    readField(reader, i, id, out, std::index_sequence_for<Fields...>{});
+    next = i + 1;
+  }
+}
+
+template <typename S, typename... Fields>
+template <typename Input>
+S Schema<S, Fields...>::read(NBTReader<Input>& reader) const {
+  TagID id = reader.readID();
+  if (id != TagID::COMPOUND) {
+    throw NBTTagException(id, "Schemas can only read compounds");
+  }
+  // The name is encoded like a string.
+  reader.skipPayload(TagID::STRING);
+  S out{};
+  readPayload(reader, out);
+  return out;
+}
+
+
+#endif // NBT_SCHEMA_HPP
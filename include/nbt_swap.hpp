@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_SWAP_HPP
+#define NBT_SWAP_HPP
+
+#include <cstddef>
+#include <vector>
+
+
+/**
+ * One set of bulk byte-swap kernels, with the same contract as
+ * swapInPlace16/32/64 in nbt.hpp.
+ *
+ * The swapInPlace functions pick the fastest set the CPU supports. This is
+ * exposed so that tests can run every set, not just the one the test machine
+ * happens to pick; other code should call swapInPlace.
+ */
+struct SwapKernels {
+  const char* name;
+  void (*swap16)(void* data, size_t count);
+  void (*swap32)(void* data, size_t count);
+  void (*swap64)(void* data, size_t count);
+};
+
+/**
+ * Every kernel set this CPU can run, the portable one first. On big-endian
+ * hosts, where nothing needs swapping, that is a single set of no-ops.
+ */
+std::vector<SwapKernels> availableSwapKernels();
+
+
+#endif // NBT_SWAP_HPP
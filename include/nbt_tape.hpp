@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_TAPE_HPP
+#define NBT_TAPE_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+class Tape;
+
+/**
+ * One fixed-size tape entry per tag, laid out in document order. A compound
+ * or list entry is followed by its children's entries, and records the index
+ * one past its last descendant so a whole subtree can be skipped in one step.
+ *
+ * Names, strings and arrays aren't copied: the entry holds their offset in
+ * the source buffer.
+ */
+struct TapeEntry {
+  // TagIDs, stored as bytes to keep entries at 16 bytes. Use id() and
+  // elementID() to read them.
+  uint8_t rawID;
+  // Element type, for lists
+  uint8_t rawElementID;
+  uint16_t nameSize;
+  uint32_t nameOffset;
+  // Numbers: the value, sign-extended or as raw float/double bits.
+  // Strings and arrays: payload offset (low half) and length (high half).
+  // Compounds and lists: end index (low half) and child count (high half).
+  uint64_t value;
+
+  uint32_t low() const {
+    return static_cast<uint32_t>(value);
+  }
+
+  uint32_t high() const {
+    return static_cast<uint32_t>(value >> 32);
+  }
+
+  TagID id() const {
+    return static_cast<TagID>(rawID);
+  }
+
+  TagID elementID() const {
+    return static_cast<TagID>(rawElementID);
+  }
+
+  void setID(TagID id) {
+    rawID = static_cast<uint8_t>(id);
+  }
+
+  void setElementID(TagID id) {
+    rawElementID = static_cast<uint8_t>(id);
+  }
+};
+
+static_assert(sizeof(TapeEntry) == 16, "Tape entries should stay 16 bytes");
+
+
+/**
+ * Handle to one entry of a Tape: a tape pointer and an index. It is as cheap
+ * to copy as a pointer, and only valid as long as the tape and its source
+ * buffer are.
+ */
+class TapeRef {
+  public:
+    /**
+     * Walks the children of a compound or list by jumping from sibling to
+     * sibling.
+     */
+    class iterator {
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef TapeRef value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const TapeRef* pointer;
+        typedef TapeRef reference;
+
+        iterator(const Tape* tape, uint32_t index) :
+          mTape{tape}, mIndex{index}
+        { }
+
+        TapeRef operator*() const {
+          return TapeRef{mTape, mIndex};
+        }
+
+        iterator& operator++() {
+          mIndex = TapeRef{mTape, mIndex}.next();
+          return *this;
+        }
+
+        iterator operator++(int) {
+          iterator old{*this};
+          ++*this;
+          return old;
+        }
+
+        bool operator==(const iterator& other) const {
+          return mIndex == other.mIndex;
+        }
+
+        bool operator!=(const iterator& other) const {
+          return mIndex != other.mIndex;
+        }
+
+      private:
+        const Tape* mTape;
+        uint32_t mIndex;
+    };
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    TapeRef(const Tape* tape, uint32_t index) :
+      mTape{tape}, mIndex{index}
+    { }
+
+    /**
+     * False for the TapeRef returned when find() comes up empty.
+     */
+    bool valid() const {
+      return mIndex != NONE;
+    }
+
+    explicit operator bool() const {
+      return valid();
+    }
+
+    TagID id() const;
+    std::string_view name() const;
+
+    /**
+     * Type of the elements of a list.
+     */
+    TagID elementID() const;
+
+    /**
+     * Number of children of a compound or list, number of elements of an
+     * array, or length of a string.
+     */
+    size_t size() const;
+
+    uint32_t index() const {
+      return mIndex;
+    }
+
+    /**
+     * Index of the entry after this tag and all of its descendants.
+     */
+    uint32_t next() const;
+
+    iterator begin() const;
+    iterator end() const;
+
+    /**
+     * The i-th child of a compound or list. Lists of numbers have one entry
+     * per element, so this is plain index arithmetic for them; otherwise it
+     * jumps over i siblings.
+     */
+    TapeRef at(size_t i) const;
+
+    /**
+     * Child of a compound named name, or an invalid TapeRef if there is none.
+     */
+    TapeRef find(std::string_view name) const;
+
+    /**
+     * The value of a tag of type T: numbers by value, strings as
+     * std::string_view, arrays as big-endian ArrayViews. Throws
+     * NBTTagException if the tag has a different type.
+     */
+    template <typename T>
+    typename view_of<T>::type value() const;
+
+  private:
+    const TapeEntry& entry() const;
+    bool hasChildren() const;
+
+    const Tape* mTape;
+    uint32_t mIndex;
+};
+
+
+/**
+ * Flat, single-pass representation of an NBT buffer: one TapeEntry per tag in
+ * a contiguous vector. Parsing allocates nothing once the vector has grown to
+ * size, so a Tape can be reused across files by calling parse() again.
+ *
+ * The source buffer is not copied and must outlive the tape.
+ */
+class Tape {
+  public:
+    Tape();
+
+    /**
+     * Parses the tag (ID, name and payload) at the start of data, replacing
+     * the tape's contents. Buffers larger than 4 GiB aren't supported.
+     */
+    void parse(const void* data, size_t size);
+
+    TapeRef root() const;
+
+    bool empty() const {
+      return mEntries.empty();
+    }
+
+    size_t size() const {
+      return mEntries.size();
+    }
+
+    const TapeEntry& entry(size_t i) const {
+      return mEntries[i];
+    }
+
+    const char* data() const {
+      return mData;
+    }
+
+    /**
+     * Bytes of the source buffer consumed by the last parse().
+     */
+    size_t bytesParsed() const {
+      return mParsed;
+    }
+
+    static constexpr int MAX_DEPTH = 512;
+
+  private:
+    void parsePayload(NBTReader<BufferInput>& reader, uint32_t index, int depth);
+    uint32_t offsetOf(const char* ptr) const;
+
+    std::vector<TapeEntry> mEntries;
+    const char* mData;
+    size_t mSize;
+    size_t mParsed;
+};
+
+
+// -----------------------------------------------------------------------------
+
+inline const TapeEntry& TapeRef::entry() const {
+  return mTape->entry(mIndex);
+}
+
+inline TagID TapeRef::id() const {
+  return entry().id();
+}
+
+inline std::string_view TapeRef::name() const {
+  const TapeEntry& e = entry();
+  return std::string_view{mTape->data() + e.nameOffset, e.nameSize};
+}
+
+inline TagID TapeRef::elementID() const {
+  return entry().elementID();
+}
+
+inline bool TapeRef::hasChildren() const {
+  TagID id = entry().id();
+  return id == TagID::COMPOUND || id == TagID::LIST;
+}
+
+inline size_t TapeRef::size() const {
+  const TapeEntry& e = entry();
+  switch (e.id()) {
+    case TagID::STRING:
+    case TagID::BYTE_ARRAY:
+    case TagID::INT_ARRAY:
+    case TagID::LONG_ARRAY:
+    case TagID::LIST:
+    case TagID::COMPOUND:
+      return e.high();
+    default:
+      return 0;
+  }
+}
+
+inline uint32_t TapeRef::next() const {
+  return hasChildren() ? entry().low() : mIndex + 1;
+}
+
+inline TapeRef::iterator TapeRef::begin() const {
+  return iterator{mTape, hasChildren() ? mIndex + 1 : mIndex};
+}
+
+inline TapeRef::iterator TapeRef::end() const {
+  return iterator{mTape, hasChildren() ? entry().low() : mIndex};
+}
+
+template <typename T>
+typename view_of<T>::type TapeRef::value() const {
+  const TapeEntry& e = entry();
+  constexpr TagID expected = getTagID<T>();
+  if (e.id() != expected) {
+    throw NBTTagException(e.id(), "Tag has a different type");
+  }
+  if constexpr (std::is_same<T, StringTag>::value) {
+    return std::string_view{mTape->data() + e.low(), e.high()};
+  }
+  else if constexpr (is_array_tag<T>::value) {
+    typedef typename T::type::value_type element_type;
+    return ArrayView<element_type>{mTape->data() + e.low(), e.high()};
+  }
+  else if constexpr (std::is_same<T, FloatTag>::value) {
+    uint32_t bits = e.low();
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  else if constexpr (std::is_same<T, DoubleTag>::value) {
+    double d;
+    std::memcpy(&d, &e.value, sizeof(d));
+    return d;
+  }
+  else {
+    return static_cast<typename T::type>(static_cast<int64_t>(e.value));
+  }
+}
+
+
+#endif // NBT_TAPE_HPP
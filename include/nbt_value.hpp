@@ -0,0 +1,389 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_VALUE_HPP
+#define NBT_VALUE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+class Value;
+
+
+/**
+ * Elements of a list, all of type elementID.
+ */
+struct ValueList {
+  TagID elementID = TagID::END;
+  std::vector<Value> elements;
+};
+
+/**
+ * Named children of a compound, in order.
+ */
+struct ValueCompound {
+  typedef std::pair<std::string, Value> Member;
+
+  std::vector<Member> members;
+
+  /**
+   * First child named name, or nullptr. This is a linear scan.
+   */
+  Value* find(std::string_view name);
+  const Value* find(std::string_view name) const;
+
+  /**
+   * Replaces the first child named name, or appends one.
+   */
+  void set(std::string name, Value value);
+};
+
+
+/**
+ * How the value of tag type T is stored in a Value: numbers and strings as
+ * T::type, arrays as std::vector, and compounds as ValueCompound.
+ */
+template <typename T>
+struct value_storage {
+  typedef typename T::type type;
+};
+
+template <>
+struct value_storage<CompoundTag> {
+  typedef ValueCompound type;
+};
+
+
+/**
+ * A tag's value, without a class hierarchy: a std::variant whose index is
+ * the TagID. Numbers are stored inline, and strings, arrays, lists and
+ * compounds own their storage, so a list or compound is one allocation for
+ * all of its elements rather than one per tag. Names live in the compound
+ * that holds the value.
+ *
+ * Code that handles every type dispatches with visit(), which the compiler
+ * turns into a jump table over the alternatives, instead of through virtual
+ * calls and dynamic_pointer_cast:
+ *
+ *     value.visit([](const auto& v) {
+ *       using V = std::decay_t<decltype(v)>;
+ *       if constexpr (std::is_same<V, ValueCompound>::value) { ... }
+ *     });
+ *
+ * NBTWriter::writeValue() writes one out. A default-constructed Value is
+ * TagID::END.
+ */
+class Value {
+  public:
+    typedef std::variant<std::monostate,
+                         int8_t,
+                         int16_t,
+                         int32_t,
+                         int64_t,
+                         float,
+                         double,
+                         std::vector<int8_t>,
+                         std::string,
+                         ValueList,
+                         ValueCompound,
+                         std::vector<int32_t>,
+                         std::vector<int64_t>> Data;
+
+    Value() = default;
+
+    /**
+     * Holds value, whose type picks the TagID: int32_t is an INT,
+     * std::vector<int64_t> a LONG_ARRAY, and so on.
+     */
+    template <typename T,
+              typename = std::enable_if_t<!std::is_same<std::decay_t<T>, Value>::value &&
+                                          std::is_constructible<Data, T&&>::value>>
+    Value(T&& value) :
+      mData{std::forward<T>(value)}
+    { }
+
+    /**
+     * A value of tag type T, e.g. Value::of<ShortTag>(5).
+     */
+    template <typename T>
+    static Value of(typename value_storage<T>::type value) {
+      Value result;
+      result.mData.template emplace<index<T>()>(std::move(value));
+      return result;
+    }
+
+    TagID id() const {
+      return static_cast<TagID>(mData.index());
+    }
+
+    /**
+     * Whether the value has tag type T.
+     */
+    template <typename T>
+    bool is() const {
+      return mData.index() == index<T>();
+    }
+
+    /**
+     * The value, if it has tag type T. Throws NBTTagException otherwise.
+     */
+    template <typename T>
+    typename value_storage<T>::type& get();
+
+    template <typename T>
+    const typename value_storage<T>::type& get() const;
+
+    /**
+     * The value, if it has tag type T, or nullptr.
+     */
+    template <typename T>
+    typename value_storage<T>::type* getIf() {
+      return std::get_if<index<T>()>(&mData);
+    }
+
+    template <typename T>
+    const typename value_storage<T>::type* getIf() const {
+      return std::get_if<index<T>()>(&mData);
+    }
+
+    /**
+     * The value of a list. Throws NBTTagException if it is something else.
+     */
+    ValueList& list();
+    const ValueList& list() const;
+
+    /**
+     * The value of a compound. Throws NBTTagException if it is something
+     * else.
+     */
+    ValueCompound& compound() {
+      return get<CompoundTag>();
+    }
+
+    const ValueCompound& compound() const {
+      return get<CompoundTag>();
+    }
+
+    /**
+     * Calls f with the stored value, whose type depends on id(): see Data.
+     */
+    template <typename F>
+    decltype(auto) visit(F&& f) {
+      return std::visit(std::forward<F>(f), mData);
+    }
+
+    template <typename F>
+    decltype(auto) visit(F&& f) const {
+      return std::visit(std::forward<F>(f), mData);
+    }
+
+    Data& data() {
+      return mData;
+    }
+
+    const Data& data() const {
+      return mData;
+    }
+
+  private:
+    template <typename T>
+    static constexpr size_t index() {
+      return static_cast<size_t>(getTagID<T>());
+    }
+
+    Data mData;
+};
+
+static_assert(std::is_same<std::variant_alternative_t<static_cast<size_t>(TagID::LIST), Value::Data>,
+                           ValueList>::value,
+              "Value::Data is indexed by TagID");
+static_assert(std::variant_size<Value::Data>::value == static_cast<size_t>(TagID::LONG_ARRAY) + 1,
+              "Value::Data has one alternative per TagID");
+
+
+/**
+ * Reads the payload of a tag whose ID and name have already been consumed.
+ */
+template <typename Input>
+Value readValue(NBTReader<Input>& reader, TagID id, int depth = 1);
+
+/**
+ * Reads the next tag, returning its name and value. At the end of a compound
+ * the value is TagID::END.
+ */
+template <typename Input>
+ValueCompound::Member readNamedValue(NBTReader<Input>& reader);
+
+/**
+ * Converts a tag from the class hierarchy.
+ */
+Value toValue(const TagBase& tag);
+
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+typename value_storage<T>::type& Value::get() {
+  if (mData.index() != index<T>()) {
+    throw NBTTagException(id(), "Value has a different type");
+  }
+  return *std::get_if<index<T>()>(&mData);
+}
+
+template <typename T>
+const typename value_storage<T>::type& Value::get() const {
+  if (mData.index() != index<T>()) {
+    throw NBTTagException(id(), "Value has a different type");
+  }
+  return *std::get_if<index<T>()>(&mData);
+}
+
+inline ValueList& Value::list() {
+  if (id() != TagID::LIST) {
+    throw NBTTagException(id(), "Value is not a list");
+  }
+  return *std::get_if<ValueList>(&mData);
+}
+
+inline const ValueList& Value::list() const {
+  if (id() != TagID::LIST) {
+    throw NBTTagException(id(), "Value is not a list");
+  }
+  return *std::get_if<ValueList>(&mData);
+}
+
+/**
+ * Replaces values with the next count numbers. On streaming inputs the
+ * vector grows in bounded steps, like NBTReader::readValues, so a corrupt
+ * count can't make us allocate more than the input holds.
+ */
+template <typename T, typename Input>
+void readValueNumbers(NBTReader<Input>& reader, std::vector<T>& values, size_t count) {
+  if constexpr (is_contiguous_input<Input>::value) {
+    const char* payload = reader.readView(count * sizeof(T));
+    values.resize(count);
+    if (count > 0) {
+      std::memcpy(values.data(), payload, count * sizeof(T));
+      swapInPlace(values.data(), count);
+    }
+  }
+  else {
+    constexpr size_t step = (1 << 20) / sizeof(T);
+    values.clear();
+    while (values.size() < count) {
+      size_t done = values.size();
+      size_t n = std::min(count - done, step);
+      values.resize(done + n);
+      reader.readNumbers(values.data() + done, n);
+    }
+  }
+}
+
+/**
+ * Reads an array payload.
+ */
+template <typename T, typename Input>
+std::vector<T> readValueArray(NBTReader<Input>& reader) {
+  int32_t size = reader.readSize();
+  if (size < 0) {
+    throw NBTException{"Negative array size"};
+  }
+  std::vector<T> values;
+  readValueNumbers(reader, values, static_cast<size_t>(size));
+  return values;
+}
+
+template <typename Input>
+Value readValue(NBTReader<Input>& reader, TagID id, int depth) {
+  if (depth > NBTReader<Input>::MAX_DEPTH) {
+    throw NBTException{"Tags are nested too deeply"};
+  }
+  switch (id) {
+    case TagID::BYTE:
+      return reader.template readNumber<int8_t>();
+    case TagID::SHORT:
+      return reader.template readNumber<int16_t>();
+    case TagID::INT:
+      return reader.template readNumber<int32_t>();
+    case TagID::LONG:
+      return reader.template readNumber<int64_t>();
+    case TagID::FLOAT:
+      return reader.template readNumber<float>();
+    case TagID::DOUBLE:
+      return reader.template readNumber<double>();
+    case TagID::BYTE_ARRAY:
+      return readValueArray<int8_t>(reader);
+    case TagID::INT_ARRAY:
+      return readValueArray<int32_t>(reader);
+    case TagID::LONG_ARRAY:
+      return readValueArray<int64_t>(reader);
+    case TagID::STRING:
+      return reader.readName();
+    case TagID::LIST:
+      {
+        ValueList list;
+        list.elementID = reader.readID();
+        int32_t size = std::max(reader.readSize(), 0);
+        // Ends have no payload, so a list of them is empty whatever its
+        // size says.
+        if (list.elementID == TagID::END) {
+          size = 0;
+        }
+        for (int32_t i = 0; i < size; i++) {
+          list.elements.push_back(readValue(reader, list.elementID, depth + 1));
+        }
+        return list;
+      }
+    case TagID::COMPOUND:
+      {
+        ValueCompound compound;
+        for (TagID child = reader.readID(); child != TagID::END; child = reader.readID()) {
+          std::string name = reader.readName();
+          compound.members.emplace_back(std::move(name), readValue(reader, child, depth + 1));
+        }
+        return compound;
+      }
+    default:
+      throw NBTTagException(id, "Unrecognized tag");
+  }
+}
+
+template <typename Input>
+ValueCompound::Member readNamedValue(NBTReader<Input>& reader) {
+  TagID id = reader.readID();
+  if (id == TagID::END) {
+    return ValueCompound::Member{};
+  }
+  std::string name = reader.readName();
+  Value value = readValue(reader, id);
+  return ValueCompound::Member{std::move(name), std::move(value)};
+}
+
+
+#endif // NBT_VALUE_HPP
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_WORLD_HPP
+#define NBT_WORLD_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "nbt.hpp"
+#include "nbt_document.hpp"
+
+
+/**
+ * Region files (r.<x>.<z>.mca) in the region directories of a world, one per
+ * dimension, sorted by path. A directory holding region files directly is
+ * also accepted.
+ */
+std::vector<std::string> findRegionFiles(const std::string& directory);
+
+
+/**
+ * Where a chunk came from. x and z are absolute chunk coordinates, worked
+ * out from the region file's name (or relative to the region if the name
+ * isn't r.<x>.<z>.mca).
+ */
+struct ChunkInfo {
+  std::string_view region;
+  int x;
+  int z;
+  uint32_t timestamp;
+  // Stored size, still compressed
+  size_t size;
+};
+
+/**
+ * Totals for a scan.
+ */
+struct ScanStats {
+  size_t regions;
+  size_t chunks;
+  // Chunks or regions that couldn't be read
+  size_t errors;
+  size_t compressedBytes;
+  size_t bytes;
+};
+
+
+/**
+ * Decompresses and parses every chunk of a set of region files in parallel.
+ *
+ * Each region file is a task on a WorkStealingPool, which maps the region
+ * and splits it into one task per row of chunks, so idle threads steal rows
+ * of busy regions instead of waiting out the largest file. Every thread
+ * keeps its own inflate state, buffer and Document, whose arena stops
+ * allocating once it has seen a large chunk, so the steady state allocates
+ * nothing per chunk.
+ *
+ *     WorldScanner scanner;
+ *     ScanStats stats = scanner.scan(findRegionFiles("world"),
+ *         [](const ChunkInfo& chunk, const Document& doc) { ... });
+ *
+ * Chunks that can't be read are counted in ScanStats::errors and passed to
+ * the error callback, if one is set; the scan carries on. Exceptions thrown
+ * by the callbacks end the scan and are rethrown from scan().
+ */
+class WorldScanner {
+  public:
+    /**
+     * Called for each chunk, concurrently from several threads. The
+     * Document is only valid for the duration of the call.
+     */
+    typedef std::function<void(const ChunkInfo& chunk, const Document& doc)> Callback;
+
+    typedef std::function<void(const ChunkInfo& chunk, const NBTException& error)> ErrorCallback;
+
+    /**
+     * Scans with threads threads, or one per hardware thread if threads is 0.
+     */
+    explicit WorldScanner(unsigned threads = 0);
+
+    ~WorldScanner();
+
+    // no copy
+    WorldScanner(const WorldScanner& other) = delete;
+    WorldScanner& operator=(const WorldScanner& other) = delete;
+
+    unsigned threads() const;
+
+    /**
+     * Called for chunks and region files that can't be read, concurrently
+     * from several threads. For an unreadable region file, x and z are
+     * those of its first chunk.
+     */
+    void onError(ErrorCallback callback) {
+      mOnError = std::move(callback);
+    }
+
+    ScanStats scan(const std::vector<std::string>& regions, const Callback& callback);
+
+    /**
+     * Folds every chunk into a Result without locking: each thread folds into
+     * its own copy of init with map(result, chunk, doc), and the copies are
+     * then merged in thread order with combine(result, std::move(other)).
+     */
+    template <typename Result, typename Map, typename Combine>
+    Result reduce(const std::vector<std::string>& regions, Result init,
+                  Map map, Combine combine, ScanStats* stats = nullptr);
+
+  private:
+    struct State;
+
+    typedef std::function<void(unsigned worker, const ChunkInfo& chunk,
+                               const Document& doc)> WorkerCallback;
+
+    ScanStats run(const std::vector<std::string>& regions, const WorkerCallback& callback);
+
+    std::unique_ptr<State> mState;
+    ErrorCallback mOnError;
+};
+
+
+// -----------------------------------------------------------------------------
+
+template <typename Result, typename Map, typename Combine>
+Result WorldScanner::reduce(const std::vector<std::string>& regions, Result init,
+                            Map map, Combine combine, ScanStats* stats) {
+  // One cache line each, so threads don't contend for them.
+  struct alignas(64) Slot {
+    Result value;
+  };
+  std::vector<Slot> partial(threads(), Slot{init});
+  ScanStats totals = run(regions,
+      [&](unsigned worker, const ChunkInfo& chunk, const Document& doc) {
+        map(partial[worker].value, chunk, doc);
+      });
+  if (stats != nullptr) {
+    *stats = totals;
+  }
+  Result result = std::move(init);
+  for (Slot& part : partial) {
+    combine(result, std::move(part.value));
+  }
+  return result;
+}
+
+
+#endif // NBT_WORLD_HPP
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_WRITER_HPP
+#define NBT_WRITER_HPP
+
+#include <sys/uio.h>
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+
+class Value;
+
+
+/**
+ * Serializes NBT into a growable, contiguous buffer.
+ *
+ * Whole trees are written with writeTag(). Documents can also be streamed out
+ * without building a tree, with the builder calls:
+ *
+ *     NBTWriter writer;
+ *     writer.beginCompound("");
+ *     writer.writeInt("DataVersion", 2586);
+ *     writer.beginList("Pos", TagID::DOUBLE, 3);
+ *     writer.writeDouble("", x);
+ *     ...
+ *     writer.endList();
+ *     writer.endCompound();
+ *
+ * Inside a compound, each call writes the tag's ID and name. Inside a list
+ * only the payload is written, the name is ignored, and the tag's type must
+ * match the list's. Arrays and lists of numbers are copied in with one
+ * memcpy and byte-swapped in place in the buffer.
+ *
+ * With a gather threshold set, array payloads at least that large aren't
+ * copied into the buffer at all. The output becomes a list of segments
+ * (see segments()): runs of the buffer, interleaved with the arrays
+ * themselves, or, where they need byte-swapping (numbers wider than a byte
+ * on a little-endian host), with swapped copies in a scratch area that is
+ * reused across clear(). Referenced arrays must then stay alive and
+ * unchanged until the output has been written.
+ */
+class NBTWriter {
+  public:
+    NBTWriter();
+
+    // no copy
+    NBTWriter(const NBTWriter& other) = delete;
+    NBTWriter& operator=(const NBTWriter& other) = delete;
+
+    // only move
+    NBTWriter(NBTWriter&& other) = default;
+    NBTWriter& operator=(NBTWriter&& other) = default;
+
+    /**
+     * The buffer. Unless arrays have been gathered, this is the whole output.
+     */
+    const char* data() const {
+      return mData.get();
+    }
+
+    /**
+     * Size of the whole output, including gathered arrays.
+     */
+    size_t size() const {
+      return mSize + mGathered;
+    }
+
+    /**
+     * Empties the buffer, keeping its storage and the scratch area, and
+     * forgets any open compounds and lists.
+     */
+    void clear();
+
+    /**
+     * Array payloads of at least bytes bytes written from now on are
+     * gathered instead of copied. 0, the default, turns gathering off.
+     */
+    void setGatherThreshold(size_t bytes) {
+      mGatherThreshold = bytes;
+    }
+
+    /**
+     * The output as a list of iovecs, for writev or for feeding a compressor
+     * piece by piece. Only valid until the next write.
+     */
+    std::vector<struct iovec> segments() const;
+
+    /**
+     * Whether every compound and list begun has been ended.
+     */
+    bool complete() const {
+      return mFrames.empty();
+    }
+
+    void writeTo(std::ostream& out) const;
+    void writeFile(std::string filename) const;
+
+    /**
+     * Writes the output to a file descriptor with writev. Throws NBTException
+     * if it fails.
+     */
+    void writeTo(int fd) const;
+
+    /**
+     * Writes a tag and everything below it.
+     */
+    void writeTag(const TagBase& tag);
+
+    /**
+     * Writes a Value (see nbt_value.hpp) under the given name. Throws
+     * NBTTagException if a list holds an element of the wrong type.
+     */
+    void writeValue(std::string_view name, const Value& value);
+
+    void beginCompound(std::string_view name);
+    void endCompound();
+
+    void beginList(std::string_view name, TagID elementID, int32_t size);
+    void endList();
+
+    void writeByte(std::string_view name, int8_t value);
+    void writeShort(std::string_view name, int16_t value);
+    void writeInt(std::string_view name, int32_t value);
+    void writeLong(std::string_view name, int64_t value);
+    void writeFloat(std::string_view name, float value);
+    void writeDouble(std::string_view name, double value);
+    void writeString(std::string_view name, std::string_view value);
+    void writeByteArray(std::string_view name, const int8_t* values, size_t count);
+    void writeIntArray(std::string_view name, const int32_t* values, size_t count);
+    void writeLongArray(std::string_view name, const int64_t* values, size_t count);
+
+    /*
+     * Building blocks, which write exactly what they're given.
+     */
+    void writeID(TagID id);
+
+    /**
+     * Writes a length-prefixed name or string payload. Throws NBTException
+     * if it's longer than 65535 bytes.
+     */
+    void writeName(std::string_view name);
+
+    template <typename T>
+    void writeNumber(T value);
+
+    template <typename T>
+    void writeNumbers(const T* values, size_t count);
+
+    void writeBytes(const void* data, size_t n);
+
+    /**
+     * Writes bytes that are already encoded NBT, such as tags copied from a
+     * parsed buffer. Runs of at least the gather threshold are referenced
+     * instead of copied, like arrays, and then have to outlive the output.
+     */
+    void writeEncoded(const void* data, size_t n);
+
+    /**
+     * Writes the payload of a tag, without its ID and name.
+     */
+    void writePayload(const TagBase& tag);
+
+    /**
+     * Writes the payload of a Value, without its ID and name.
+     */
+    void writeValuePayload(const Value& value);
+
+  private:
+    struct Frame {
+      TagID id;
+      TagID elementID;
+      int32_t size;
+      int32_t written;
+    };
+
+    /**
+     * Space for n more bytes at the end of the buffer.
+     */
+    char* grow(size_t n) {
+      if (n <= mCapacity - mSize) {
+        char* p = mData.get() + mSize;
+        mSize += n;
+        return p;
+      }
+      return growSlow(n);
+    }
+
+    char* growSlow(size_t n);
+    void header(TagID id, std::string_view name);
+
+    template <typename T>
+    void writeArrayPayload(const T* values, size_t count);
+
+    struct Segment {
+      enum Kind {
+        BUFFER,
+        SCRATCH,
+        EXTERNAL
+      };
+
+      Kind kind;
+      // Offset into the buffer or the scratch area, or an external pointer.
+      // Offsets survive either one being reallocated.
+      size_t offset;
+      const char* external;
+      size_t size;
+    };
+
+    void gather(Segment segment);
+
+    template <typename T>
+    void writeArray(TagID id, std::string_view name, const T* values, size_t count);
+
+    template <typename T>
+    bool writeListIf(const TagBase& tag);
+
+    std::unique_ptr<char[]> mData;
+    size_t mSize;
+    size_t mCapacity;
+    std::vector<Frame> mFrames;
+
+    size_t mGatherThreshold;
+    // Bytes of output in gathered arrays
+    size_t mGathered;
+    // Gathered arrays, and the buffer runs before them
+    std::vector<Segment> mSegments;
+    // End of the buffer run covered by mSegments
+    size_t mCut;
+    std::unique_ptr<char[]> mScratch;
+    size_t mScratchSize;
+    size_t mScratchCapacity;
+};
+
+
+// -----------------------------------------------------------------------------
+
+template <typename T>
+void NBTWriter::writeNumber(T value) {
+  static_assert(std::is_arithmetic<T>::value, "Only numbers are byte-swapped");
+  // loadBigEndian is its own inverse.
+  T swapped = loadBigEndian<T>(reinterpret_cast<const char*>(&value));
+  std::memcpy(grow(sizeof(T)), &swapped, sizeof(T));
+}
+
+template <typename T>
+void NBTWriter::writeNumbers(const T* values, size_t count) {
+  static_assert(std::is_arithmetic<T>::value, "Only numbers are byte-swapped");
+  if (count == 0) {
+    return;
+  }
+  char* dst = grow(count * sizeof(T));
+  std::memcpy(dst, values, count * sizeof(T));
+  // The buffer isn't necessarily aligned for T, which the kernels allow for.
+  if constexpr (sizeof(T) == 2) {
+    swapInPlace16(dst, count);
+  }
+  else if constexpr (sizeof(T) == 4) {
+    swapInPlace32(dst, count);
+  }
+  else if constexpr (sizeof(T) == 8) {
+    swapInPlace64(dst, count);
+  }
+}
+
+
+#endif // NBT_WRITER_HPP
@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <iterator>
+#include <utility>
+
+#include "nbt_cache.hpp"
+
+
+ChunkCache::ChunkCache(size_t budget)
+  : mMutex{},
+    mBudget{budget},
+    mBytes{0},
+    mStats{0, 0, 0},
+    mEntries{},
+    mRegions{},
+    mNames{std::make_shared<NameTable>()}
+{ }
+
+ChunkCache::Region& ChunkCache::region(const std::string& name) {
+  auto found = mRegions.find(name);
+  if (found != mRegions.end()) {
+    return *found->second;
+  }
+  // Mapped before it's added, so a region that can't be read isn't.
+  auto region = std::make_unique<Region>();
+  region->file = std::make_shared<const RegionFile>(name);
+  region->slots.assign(RegionFile::CHUNKS, mEntries.end());
+  return *mRegions.emplace(name, std::move(region)).first->second;
+}
+
+ChunkCache::Handle ChunkCache::get(const std::string& name, int x, int z) {
+  int index = RegionFile::index(x, z);
+  std::shared_ptr<const RegionFile> file;
+  {
+    std::lock_guard<std::mutex> lock{mMutex};
+    Region& r = region(name);
+    EntryIt it = r.slots[index];
+    if (it != mEntries.end()) {
+      mStats.hits++;
+      // Moving a node within the list keeps iterators to it valid.
+      mEntries.splice(mEntries.begin(), mEntries, it);
+      return it->document;
+    }
+    mStats.misses++;
+    file = r.file;
+  }
+  if (!file->contains(x, z)) {
+    return Handle{};
+  }
+
+  auto document = std::make_shared<Document>();
+  document->setNameTable(mNames);
+  NBTReader<InflateInput> reader = file->openChunk(x, z);
+  document->read(reader);
+  size_t bytes = document->memoryUsage();
+
+  std::lock_guard<std::mutex> lock{mMutex};
+  Region& r = region(name);
+  if (r.file != file) {
+    // Refreshed or cleared while we were parsing: the chunk may be stale
+    // already, so it's handed out but not kept.
+    return document;
+  }
+  EntryIt& slot = r.slots[index];
+  if (slot != mEntries.end()) {
+    // Another thread parsed it too, and got here first.
+    mEntries.splice(mEntries.begin(), mEntries, slot);
+    return slot->document;
+  }
+  mEntries.push_front(Entry{&r, index, file->timestamp(x, z), bytes, document});
+  slot = mEntries.begin();
+  mBytes += bytes;
+  evict();
+  return document;
+}
+
+void ChunkCache::erase(EntryIt it) {
+  it->region->slots[it->index] = mEntries.end();
+  mBytes -= it->bytes;
+  mEntries.erase(it);
+}
+
+void ChunkCache::evict() {
+  while (mBytes > mBudget && !mEntries.empty()) {
+    erase(std::prev(mEntries.end()));
+    mStats.evictions++;
+  }
+}
+
+size_t ChunkCache::refresh(Region& r, const std::string& name) {
+  std::shared_ptr<const RegionFile> file;
+  try {
+    file = std::make_shared<const RegionFile>(name);
+  }
+  catch (NBTException&) {
+    for (EntryIt it : r.slots) {
+      if (it != mEntries.end()) {
+        erase(it);
+      }
+    }
+    mRegions.erase(name);
+    throw;
+  }
+  size_t dropped = 0;
+  for (int i = 0; i < RegionFile::CHUNKS; i++) {
+    EntryIt it = r.slots[i];
+    if (it == mEntries.end()) {
+      continue;
+    }
+    int x = i % RegionFile::SIDE;
+    int z = i / RegionFile::SIDE;
+    if (!file->contains(x, z) || file->timestamp(x, z) != it->timestamp) {
+      erase(it);
+      dropped++;
+    }
+  }
+  r.file = std::move(file);
+  return dropped;
+}
+
+size_t ChunkCache::refresh(const std::string& name) {
+  std::lock_guard<std::mutex> lock{mMutex};
+  auto found = mRegions.find(name);
+  if (found == mRegions.end()) {
+    return 0;
+  }
+  return refresh(*found->second, name);
+}
+
+size_t ChunkCache::refresh() {
+  std::lock_guard<std::mutex> lock{mMutex};
+  std::vector<std::string> names;
+  for (const auto& region : mRegions) {
+    names.push_back(region.first);
+  }
+  size_t dropped = 0;
+  for (const std::string& name : names) {
+    dropped += refresh(*mRegions.at(name), name);
+  }
+  return dropped;
+}
+
+void ChunkCache::clear() {
+  std::lock_guard<std::mutex> lock{mMutex};
+  mEntries.clear();
+  mRegions.clear();
+  mBytes = 0;
+}
+
+void ChunkCache::setBudget(size_t budget) {
+  std::lock_guard<std::mutex> lock{mMutex};
+  mBudget = budget;
+  evict();
+}
+
+size_t ChunkCache::budget() const {
+  std::lock_guard<std::mutex> lock{mMutex};
+  return mBudget;
+}
+
+size_t ChunkCache::bytes() const {
+  std::lock_guard<std::mutex> lock{mMutex};
+  return mBytes;
+}
+
+size_t ChunkCache::size() const {
+  std::lock_guard<std::mutex> lock{mMutex};
+  return mEntries.size();
+}
+
+ChunkCache::Stats ChunkCache::stats() const {
+  std::lock_guard<std::mutex> lock{mMutex};
+  return mStats;
+}
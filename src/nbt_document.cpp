@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+
+#include "nbt_document.hpp"
+#include "nbt_names.hpp"
+
+
+Arena::Arena(size_t blockSize) :
+  mBlockSize{blockSize},
+  mBlocks{},
+  mBlock{0},
+  mUsedBefore{0},
+  mCurrent{nullptr},
+  mUsed{0},
+  mCapacity{0}
+{ }
+
+Arena::Arena(Arena&& other) noexcept :
+  mBlockSize{other.mBlockSize},
+  mBlocks{std::move(other.mBlocks)},
+  mBlock{other.mBlock},
+  mUsedBefore{other.mUsedBefore},
+  mCurrent{other.mCurrent},
+  mUsed{other.mUsed},
+  mCapacity{other.mCapacity}
+{
+  other.mBlocks.clear();
+  other.mBlock = 0;
+  other.mUsedBefore = 0;
+  other.mCurrent = nullptr;
+  other.mUsed = 0;
+  other.mCapacity = 0;
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+  std::swap(mBlockSize, other.mBlockSize);
+  std::swap(mBlocks, other.mBlocks);
+  std::swap(mBlock, other.mBlock);
+  std::swap(mUsedBefore, other.mUsedBefore);
+  std::swap(mCurrent, other.mCurrent);
+  std::swap(mUsed, other.mUsed);
+  std::swap(mCapacity, other.mCapacity);
+  return *this;
+}
+
+void Arena::useBlock(size_t index) {
+  mUsedBefore += mUsed;
+  mBlock = index;
+  mCurrent = mBlocks[index].data.get();
+  mUsed = 0;
+  mCapacity = mBlocks[index].size;
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+  // Move on to the next block that's big enough, keeping the ones we skip
+  // for after the next reset().
+  size_t needed = size + align;
+  size_t next = mCurrent == nullptr ? 0 : mBlock + 1;
+  while (next < mBlocks.size() && mBlocks[next].size < needed) {
+    next++;
+  }
+  if (next == mBlocks.size()) {
+    size_t blockSize = std::max(mBlockSize, needed);
+    mBlocks.push_back(Block{std::make_unique<char[]>(blockSize), blockSize});
+  }
+  else if (next != mBlock + 1 && mCurrent != nullptr) {
+    // Keep blocks in the order they're used so reset() can walk them again.
+    std::swap(mBlocks[mBlock + 1], mBlocks[next]);
+    next = mBlock + 1;
+  }
+  useBlock(next);
+  return allocate(size, align);
+}
+
+std::string_view Arena::copy(std::string_view str) {
+  char* dst = allocate<char>(str.size());
+  std::copy(str.begin(), str.end(), dst);
+  return std::string_view{dst, str.size()};
+}
+
+void Arena::reset() {
+  mUsedBefore = 0;
+  mBlock = 0;
+  mUsed = 0;
+  if (mBlocks.empty()) {
+    mCurrent = nullptr;
+    mCapacity = 0;
+  }
+  else {
+    mCurrent = mBlocks[0].data.get();
+    mCapacity = mBlocks[0].size;
+  }
+}
+
+size_t Arena::bytesUsed() const {
+  return mUsedBefore + mUsed;
+}
+
+size_t Arena::bytesReserved() const {
+  size_t total = 0;
+  for (const Block& block : mBlocks) {
+    total += block.size;
+  }
+  return total;
+}
+
+
+const Node& Node::at(size_t i) const {
+  if (!hasChildren()) {
+    throw NBTTagException(mId, "Tag has no children");
+  }
+  if (i >= mSize) {
+    throw std::out_of_range("Node::at");
+  }
+  return mValue.children[i];
+}
+
+const Node* Node::find(std::string_view name) const {
+  if (mId != TagID::COMPOUND) {
+    throw NBTTagException(mId, "Tag is not a compound");
+  }
+  for (const Node& child : *this) {
+    if (child.name() == name) {
+      return &child;
+    }
+  }
+  return nullptr;
+}
+
+const Node* Node::findInterned(std::string_view name) const {
+  if (mId != TagID::COMPOUND) {
+    throw NBTTagException(mId, "Tag is not a compound");
+  }
+  for (const Node& child : *this) {
+    if (child.mName == name.data() && child.mNameSize == name.size()) {
+      return &child;
+    }
+  }
+  return nullptr;
+}
+
+
+Document::Document() :
+  mArena{},
+  mRoot{nullptr},
+  mScratch{},
+  mNames{},
+  mNameBuffer{}
+{ }
+
+const Node& Document::root() const {
+  if (mRoot == nullptr) {
+    throw NBTException{"Document is empty"};
+  }
+  return *mRoot;
+}
+
+void Document::clear() {
+  mArena.reset();
+  mRoot = nullptr;
+  mScratch.clear();
+}
+
+void Document::setNameTable(std::shared_ptr<NameTable> table) {
+  mNames = std::move(table);
+}
+
+std::string_view Document::intern(std::string_view name) {
+  return mNames->intern(name);
+}
+
+size_t Document::memoryUsage() const {
+  return sizeof(Document) + mArena.bytesReserved() + mScratch.capacity() * sizeof(Node);
+}
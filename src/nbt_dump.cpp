@@ -1,16 +1,82 @@
 
 
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
 
 #include "nbt.hpp"
+#include "nbt_world.hpp"
 
 
 const char *USAGE = " input_file [-o output_file]\n"
+"       nbt_dump --world world_directory [-j threads]\n"
 "\n"
 "    input_file                  NBT file\n"
 "\n"
 "    -o, --output output_file    File to which dump NBT structure and\n"
-"                                contents should be dumped (default=stdout)\n";
+"                                contents should be dumped (default=stdout)\n"
+"\n"
+"    --world world_directory     Parse every chunk of every region file in\n"
+"                                the world, in parallel, and print totals\n"
+"\n"
+"    -j, --threads threads       Threads for --world (default=one per core)\n";
+
+
+static size_t countTags(const Node& node) {
+  size_t count = 1;
+  for (const Node& child : node) {
+    count += countTags(child);
+  }
+  return count;
+}
+
+/*
+ * Parses a whole world and reports how much there was and how fast it went.
+ */
+static int scanWorld(const char* directory, unsigned threads) {
+  std::vector<std::string> regions;
+  try {
+    regions = findRegionFiles(directory);
+  }
+  catch (NBTException& e) {
+    std::cerr << directory << ": " << e.what() << std::endl;
+    return 1;
+  }
+
+  WorldScanner scanner{threads};
+  std::mutex errorMutex;
+  scanner.onError([&](const ChunkInfo& chunk, const NBTException& e) {
+    std::lock_guard<std::mutex> lock{errorMutex};
+    std::cerr << chunk.region << ": chunk " << chunk.x << ", " << chunk.z
+              << ": " << e.what() << std::endl;
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  ScanStats stats;
+  size_t tags = scanner.reduce(regions, size_t{0},
+      [](size_t& total, const ChunkInfo&, const Document& doc) {
+        total += countTags(doc.root());
+      },
+      [](size_t& total, size_t part) {
+        total += part;
+      },
+      &stats);
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  double mib = stats.bytes / (1024.0 * 1024.0);
+  std::cout << "regions:    " << stats.regions << "\n"
+            << "chunks:     " << stats.chunks << "\n"
+            << "errors:     " << stats.errors << "\n"
+            << "tags:       " << tags << "\n"
+            << "compressed: " << stats.compressedBytes / (1024.0 * 1024.0) << " MiB\n"
+            << "parsed:     " << mib << " MiB\n"
+            << "threads:    " << scanner.threads() << "\n"
+            << "time:       " << elapsed.count() << " s ("
+            << mib / elapsed.count() << " MiB/s)" << std::endl;
+  return stats.errors == 0 ? 0 : 2;
+}
 
 
 int main(int argc, char* argv[]) {
@@ -20,7 +86,20 @@ int main(int argc, char* argv[]) {
     return 1;
   }
 
-  NBTFile input{argv[1]};
+  if (std::strcmp(argv[1], "--world") == 0) {
+    if (argc < 3) {
+      std::cerr << "Missing world directory" << std::endl << argv[0] << USAGE;
+      return 1;
+    }
+    unsigned threads = 0;
+    if (argc >= 5 && (std::strcmp(argv[3], "-j") == 0 ||
+                      std::strcmp(argv[3], "--threads") == 0)) {
+      threads = static_cast<unsigned>(std::strtoul(argv[4], nullptr, 10));
+    }
+    return scanWorld(argv[2], threads);
+  }
+
+  MappedNBTFile input{argv[1]};
   // Assume the first ID identifies a Compound tag
   //TagID id = input.readID();
 
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <utility>
+
+#include "nbt_inflate.hpp"
+
+
+struct InflateInput::State {
+  enum Mode {
+    UNKNOWN,
+    RAW,
+    INFLATE,
+    DONE
+  };
+
+  State() :
+    mode{UNKNOWN}, fd{-1}, ownsFd{false}, data{nullptr}, size{0}, pos{0},
+    in{nullptr}, out{new char[WINDOW_SIZE]}, deflated{false}, consumed{0}, inflated{0},
+    maxSize{DEFAULT_MAX_SIZE}
+  {
+    std::memset(&stream, 0, sizeof(stream));
+  }
+
+  ~State() {
+    if (deflated) {
+      inflateEnd(&stream);
+    }
+    if (ownsFd) {
+      close(fd);
+    }
+  }
+
+  /**
+   * Makes compressed input available in stream.next_in, returning false once
+   * the source is exhausted.
+   */
+  bool fill() {
+    if (stream.avail_in > 0) {
+      return true;
+    }
+    if (fd < 0) {
+      // Hand zlib the caller's buffer directly, in pieces it can count.
+      size_t n = std::min(size - pos, static_cast<size_t>(UINT_MAX));
+      stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + pos));
+      stream.avail_in = static_cast<uInt>(n);
+      pos += n;
+      return n > 0;
+    }
+    if (!in) {
+      in.reset(new char[WINDOW_SIZE]);
+    }
+    size_t got = readFd(in.get(), WINDOW_SIZE);
+    stream.next_in = reinterpret_cast<Bytef*>(in.get());
+    stream.avail_in = static_cast<uInt>(got);
+    return got > 0;
+  }
+
+  /**
+   * One read() from the descriptor, retried if interrupted. Returns 0 at
+   * the end of the file.
+   */
+  size_t readFd(char* dst, size_t n) {
+    for (;;) {
+      ssize_t got = ::read(fd, dst, n);
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      if (got < 0) {
+        throw NBTException("Unable to read file");
+      }
+      return static_cast<size_t>(got);
+    }
+  }
+
+  /**
+   * Looks at the first bytes: gzip starts with 1f 8b, and zlib with a
+   * CMF/FLG pair that names deflate and is a multiple of 31. Raw NBT starts
+   * with a tag ID, which is neither.
+   */
+  void detect() {
+    if (!fill()) {
+      mode = DONE;
+      return;
+    }
+    // Both magics are two bytes long. A pipe or socket may hand over the
+    // first byte on its own, so wait for the second (or the end of the
+    // data) before deciding. fill() left the byte at the start of in.
+    if (fd >= 0 && stream.avail_in == 1) {
+      stream.avail_in += static_cast<uInt>(readFd(in.get() + 1, WINDOW_SIZE - 1));
+    }
+    const unsigned char* p = stream.next_in;
+    bool gzip = stream.avail_in >= 2 && p[0] == 0x1f && p[1] == 0x8b;
+    bool zlib = stream.avail_in >= 2 && (p[0] & 0x0f) == 8 &&
+                ((p[0] << 8) | p[1]) % 31 == 0;
+    if (gzip || zlib) {
+      // 15 + 32: the largest window, with gzip/zlib header detection.
+      if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+        throw NBTException("Unable to initialize zlib");
+      }
+      mode = INFLATE;
+      deflated = true;
+    }
+    else {
+      mode = RAW;
+    }
+  }
+
+  /**
+   * Refills the output window, returning the number of bytes in it, or 0 at
+   * the end of the data.
+   */
+  size_t refill() {
+    if (mode == UNKNOWN) {
+      detect();
+    }
+    if (mode == RAW) {
+      if (!fill()) {
+        return 0;
+      }
+      size_t n = std::min(static_cast<size_t>(stream.avail_in), WINDOW_SIZE);
+      std::memcpy(out.get(), stream.next_in, n);
+      stream.next_in += n;
+      stream.avail_in -= static_cast<uInt>(n);
+      return n;
+    }
+    while (mode == INFLATE) {
+      if (!fill()) {
+        // Truncated stream
+        mode = DONE;
+        return 0;
+      }
+      stream.next_out = reinterpret_cast<Bytef*>(out.get());
+      stream.avail_out = static_cast<uInt>(WINDOW_SIZE);
+      int ret = inflate(&stream, Z_NO_FLUSH);
+      size_t produced = WINDOW_SIZE - stream.avail_out;
+      if (ret == Z_STREAM_END) {
+        // gzip files may hold several members back to back.
+        if (fill()) {
+          inflateReset(&stream);
+        }
+        else {
+          mode = DONE;
+        }
+      }
+      else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        throw NBTException("Corrupt compressed data");
+      }
+      inflated += produced;
+      if (inflated > maxSize) {
+        throw NBTException("Compressed data inflates to more than the limit");
+      }
+      if (produced > 0) {
+        return produced;
+      }
+    }
+    return 0;
+  }
+
+  Mode mode;
+  int fd;
+  bool ownsFd;
+  const char* data;
+  size_t size;
+  size_t pos;
+  std::unique_ptr<char[]> in;
+  std::unique_ptr<char[]> out;
+  z_stream stream;
+  // Whether the source turned out to be gzip or zlib data
+  bool deflated;
+  // Decompressed bytes before the current window
+  size_t consumed;
+  // Bytes inflated so far, and the most allowed
+  size_t inflated;
+  size_t maxSize;
+};
+
+
+InflateInput::InflateInput(int fd)
+  : mState{new State}, mWindow{nullptr}, mBegin{0}, mEnd{0}
+{
+  mState->fd = fd;
+  mWindow = mState->out.get();
+}
+
+InflateInput::InflateInput(const void* data, size_t size)
+  : mState{new State}, mWindow{nullptr}, mBegin{0}, mEnd{0}
+{
+  mState->data = static_cast<const char*>(data);
+  mState->size = size;
+  mWindow = mState->out.get();
+}
+
+InflateInput::InflateInput(std::string filename)
+  : mState{new State}, mWindow{nullptr}, mBegin{0}, mEnd{0}
+{
+  mState->fd = open(filename.c_str(), O_RDONLY);
+  if (mState->fd < 0) {
+    throw NBTException("Unable to open file");
+  }
+  mState->ownsFd = true;
+  mWindow = mState->out.get();
+}
+
+InflateInput::~InflateInput() = default;
+
+// The window lives in State, so it stays put when the input moves.
+InflateInput::InflateInput(InflateInput&& other) noexcept = default;
+InflateInput& InflateInput::operator=(InflateInput&& other) noexcept = default;
+
+bool InflateInput::compressed() const {
+  return mState->deflated;
+}
+
+size_t InflateInput::position() const {
+  return mState->consumed + mBegin;
+}
+
+void InflateInput::setMaxSize(size_t maxSize) {
+  mState->maxSize = maxSize;
+}
+
+size_t InflateInput::maxSize() const {
+  return mState->maxSize;
+}
+
+/**
+ * Copies (or, with dst null, skips) n bytes that run past the current
+ * window, inflating more as needed.
+ */
+bool InflateInput::readSlow(char* dst, size_t n) {
+  while (n > 0) {
+    size_t available = mEnd - mBegin;
+    if (available == 0) {
+      mState->consumed += mEnd;
+      mBegin = mEnd = 0;
+      mEnd = mState->refill();
+      if (mEnd == 0) {
+        return false;
+      }
+      continue;
+    }
+    size_t count = std::min(available, n);
+    if (dst != nullptr) {
+      std::memcpy(dst, mWindow + mBegin, count);
+      dst += count;
+    }
+    mBegin += count;
+    n -= count;
+  }
+  return true;
+}
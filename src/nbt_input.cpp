@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <utility>
+
+#include "nbt.hpp"
+
+
+StreamInput::StreamInput(std::string filename)
+  : file{filename, std::ios_base::in | std::ios_base::binary}
+{
+  if (!file.is_open()) {
+    throw NBTException("Unable to open file");
+  }
+}
+
+
+MappedFile::MappedFile(std::string filename, Access access)
+  : mData{nullptr}, mSize{0}
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw NBTException("Unable to open file");
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    throw NBTException("Unable to stat file");
+  }
+  mSize = static_cast<size_t>(st.st_size);
+  // mmap refuses zero-length mappings; an empty file is just an empty input.
+  if (mSize > 0) {
+    void* addr = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      close(fd);
+      throw NBTException("Unable to map file");
+    }
+    // Parsers walk the mapping front to back exactly once; readahead only
+    // wastes I/O when hopping between a few parts of a large file.
+    madvise(addr, mSize, access == SEQUENTIAL ? MADV_SEQUENTIAL : MADV_RANDOM);
+    mData = static_cast<const char*>(addr);
+  }
+  // The mapping stays valid after the descriptor is closed.
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (mData != nullptr) {
+    munmap(const_cast<char*>(mData), mSize);
+  }
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : mData{other.mData}, mSize{other.mSize}
+{
+  other.mData = nullptr;
+  other.mSize = 0;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  std::swap(mData, other.mData);
+  std::swap(mSize, other.mSize);
+  return *this;
+}
+
+
+bool FdInput::readSlow(char* dst, size_t n) {
+  // Drain what's left in the buffer first.
+  size_t buffered = mEnd - mBegin;
+  std::memcpy(dst, mBuffer.get() + mBegin, buffered);
+  dst += buffered;
+  n -= buffered;
+  mBegin = mEnd = 0;
+
+  while (n > 0) {
+    // Large reads go straight to the destination; small ones refill the
+    // buffer so that the fields after them are already in memory.
+    bool direct = n >= BUFFER_SIZE;
+    char* target = direct ? dst : mBuffer.get();
+    size_t want = direct ? n : BUFFER_SIZE;
+    ssize_t got = ::read(mFd, target, want);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    size_t count = static_cast<size_t>(got);
+    if (direct) {
+      dst += count;
+      n -= count;
+    }
+    else {
+      size_t used = std::min(count, n);
+      std::memcpy(dst, mBuffer.get(), used);
+      dst += used;
+      n -= used;
+      mBegin = used;
+      mEnd = count;
+    }
+  }
+  return true;
+}
+
+bool FdInput::skipSlow(size_t n) {
+  n -= mEnd - mBegin;
+  mBegin = mEnd = 0;
+
+  // Regular files can be seeked over, as long as that doesn't run past the
+  // end; lseek itself would happily go there.
+  struct stat st;
+  if (fstat(mFd, &st) == 0 && S_ISREG(st.st_mode)) {
+    off_t pos = lseek(mFd, 0, SEEK_CUR);
+    if (pos >= 0) {
+      if (n > static_cast<size_t>(st.st_size - pos)) {
+        return false;
+      }
+      return lseek(mFd, static_cast<off_t>(n), SEEK_CUR) >= 0;
+    }
+  }
+
+  // Pipes and sockets have to be read. Whatever the last read brings in
+  // past the skipped bytes stays buffered.
+  while (n > 0) {
+    ssize_t got = ::read(mFd, mBuffer.get(), BUFFER_SIZE);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    size_t count = static_cast<size_t>(got);
+    if (count > n) {
+      mBegin = n;
+      mEnd = count;
+      return true;
+    }
+    n -= count;
+  }
+  return true;
+}
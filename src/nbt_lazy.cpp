@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <string>
+
+#include "nbt_lazy.hpp"
+#include "nbt_writer.hpp"
+
+
+LazyCompound::LazyCompound()
+  : mName{}, mEntries{}, mChanged{false}
+{ }
+
+size_t LazyCompound::indexOf(std::string_view name) const {
+  for (size_t i = 0; i < mEntries.size(); i++) {
+    if (mEntries[i].name == name) {
+      return i;
+    }
+  }
+  return npos;
+}
+
+/**
+ * The child's current value. Children are decoded once and cached, except
+ * compounds with changes made through editCompound(), which are decoded
+ * from those changes every time, leaving the nested compound alone.
+ */
+std::shared_ptr<TagBase> LazyCompound::materialize(const Entry& entry) const {
+  if (entry.compound != nullptr && entry.compound->modified()) {
+    NBTWriter writer;
+    entry.compound->writePayload(writer);
+    NBTReader<BufferInput> reader{BufferInput{writer.data(), writer.size()}};
+    return reader.readPayload(entry.id, std::string{entry.name});
+  }
+  if (entry.tag == nullptr) {
+    NBTReader<BufferInput> reader{BufferInput{entry.payload, entry.size}};
+    entry.tag = reader.readPayload(entry.id, std::string{entry.name});
+  }
+  return entry.tag;
+}
+
+std::shared_ptr<TagBase> LazyCompound::at(size_t i) const {
+  return materialize(mEntries.at(i));
+}
+
+std::shared_ptr<TagBase> LazyCompound::find(std::string_view name) const {
+  size_t i = indexOf(name);
+  return i == npos ? nullptr : at(i);
+}
+
+LazyCompound* LazyCompound::scanCompound(size_t i) const {
+  const Entry& entry = mEntries[i];
+  if (entry.dirty) {
+    throw NBTException("Compound has been edited as a tag");
+  }
+  if (entry.compound == nullptr) {
+    NBTReader<BufferInput> reader{BufferInput{entry.payload, entry.size}};
+    auto nested = std::make_unique<LazyCompound>();
+    nested->read(reader, entry.name);
+    entry.compound = std::move(nested);
+  }
+  return entry.compound.get();
+}
+
+const LazyCompound* LazyCompound::compound(std::string_view name) const {
+  size_t i = indexOf(name);
+  if (i == npos || mEntries[i].id != TagID::COMPOUND) {
+    return nullptr;
+  }
+  return scanCompound(i);
+}
+
+std::shared_ptr<TagBase> LazyCompound::edit(size_t i) {
+  const Entry& entry = mEntries.at(i);
+  // From here on the tag holds the value, edits through editCompound()
+  // included.
+  entry.tag = materialize(entry);
+  entry.compound.reset();
+  entry.dirty = true;
+  return entry.tag;
+}
+
+LazyCompound* LazyCompound::editCompound(std::string_view name) {
+  size_t i = indexOf(name);
+  if (i == npos || mEntries[i].id != TagID::COMPOUND) {
+    return nullptr;
+  }
+  return scanCompound(i);
+}
+
+void LazyCompound::set(std::shared_ptr<TagBase> tag) {
+  // The entry's name points into the tag, which it keeps alive.
+  std::string_view name = tag->name();
+  Entry entry{tag->id(), name, nullptr, nullptr, 0, std::move(tag), nullptr, true};
+  size_t i = indexOf(name);
+  if (i == npos) {
+    mEntries.push_back(std::move(entry));
+  }
+  else {
+    mEntries[i] = std::move(entry);
+  }
+  mChanged = true;
+}
+
+bool LazyCompound::erase(std::string_view name) {
+  size_t i = indexOf(name);
+  if (i == npos) {
+    return false;
+  }
+  mEntries.erase(mEntries.begin() + i);
+  mChanged = true;
+  return true;
+}
+
+bool LazyCompound::modified() const {
+  if (mChanged) {
+    return true;
+  }
+  for (const Entry& entry : mEntries) {
+    if (entry.dirty || (entry.compound != nullptr && entry.compound->modified())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LazyCompound::write(NBTWriter& writer) const {
+  writer.writeID(TagID::COMPOUND);
+  writer.writeName(mName);
+  writePayload(writer);
+}
+
+void LazyCompound::writePayload(NBTWriter& writer) const {
+  // Unchanged children that were next to each other in the source are
+  // copied in one go.
+  const char* run = nullptr;
+  size_t runSize = 0;
+  for (const Entry& entry : mEntries) {
+    if (entry.dirty) {
+      writer.writeEncoded(run, runSize);
+      runSize = 0;
+      writer.writeTag(*entry.tag);
+    }
+    else if (entry.compound != nullptr && entry.compound->modified()) {
+      writer.writeEncoded(run, runSize);
+      runSize = 0;
+      writer.writeID(TagID::COMPOUND);
+      writer.writeName(entry.name);
+      entry.compound->writePayload(writer);
+    }
+    else {
+      size_t size = entry.payload + entry.size - entry.source;
+      if (runSize > 0 && run + runSize == entry.source) {
+        runSize += size;
+      }
+      else {
+        writer.writeEncoded(run, runSize);
+        run = entry.source;
+        runSize = size;
+      }
+    }
+  }
+  writer.writeEncoded(run, runSize);
+  writer.writeID(TagID::END);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+#include "nbt_names.hpp"
+
+
+// Interned so that it's the same non-null pointer every time.
+static const char EMPTY_NAME[] = "";
+
+static std::atomic<uint64_t> nextTableId{1};
+
+namespace {
+
+/**
+ * Names this thread interned recently, by hash, so that repeated names
+ * don't take a shard's lock. Tied to one table at a time by its ID, which,
+ * unlike its address, is never reused.
+ */
+struct NameCache {
+  static constexpr size_t SIZE = 256;
+
+  uint64_t table = 0;
+  std::array<std::string_view, SIZE> names{};
+};
+
+thread_local NameCache nameCache;
+
+}
+
+
+NameTable::NameTable() :
+  mId{nextTableId++},
+  mShards{}
+{ }
+
+NameTable::Shard& NameTable::shard(std::string_view name) {
+  return mShards[std::hash<std::string_view>{}(name) % SHARDS];
+}
+
+const NameTable::Shard& NameTable::shard(std::string_view name) const {
+  return mShards[std::hash<std::string_view>{}(name) % SHARDS];
+}
+
+std::string_view NameTable::intern(std::string_view name) {
+  if (name.empty()) {
+    return std::string_view{EMPTY_NAME, 0};
+  }
+  // FNV-1a; names are short.
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  if (nameCache.table != mId) {
+    nameCache.table = mId;
+    nameCache.names.fill(std::string_view{});
+  }
+  std::string_view& cached = nameCache.names[hash % NameCache::SIZE];
+  if (cached.data() != nullptr && cached == name) {
+    return cached;
+  }
+
+  Shard& s = shard(name);
+  std::lock_guard<std::mutex> lock{s.mutex};
+  auto found = s.names.find(name);
+  if (found != s.names.end()) {
+    cached = *found;
+  }
+  else {
+    cached = s.arena.copy(name);
+    s.names.insert(cached);
+  }
+  return cached;
+}
+
+std::string_view NameTable::find(std::string_view name) const {
+  if (name.empty()) {
+    return std::string_view{EMPTY_NAME, 0};
+  }
+  const Shard& s = shard(name);
+  std::lock_guard<std::mutex> lock{s.mutex};
+  auto found = s.names.find(name);
+  return found != s.names.end() ? *found : std::string_view{};
+}
+
+size_t NameTable::size() const {
+  size_t total = 0;
+  for (const Shard& s : mShards) {
+    std::lock_guard<std::mutex> lock{s.mutex};
+    total += s.names.size();
+  }
+  return total;
+}
+
+size_t NameTable::memoryUsage() const {
+  size_t total = sizeof(NameTable);
+  for (const Shard& s : mShards) {
+    std::lock_guard<std::mutex> lock{s.mutex};
+    total += s.arena.bytesReserved() +
+             s.names.bucket_count() * sizeof(void*) +
+             s.names.size() * (sizeof(std::string_view) + 2 * sizeof(void*));
+  }
+  return total;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <algorithm>
+
+#include "nbt_pool.hpp"
+
+
+namespace {
+// The pool and index of the worker running on this thread, if any
+thread_local const WorkStealingPool* currentPool = nullptr;
+thread_local unsigned currentWorker = 0;
+}
+
+
+WorkStealingPool::WorkStealingPool(unsigned threads)
+  : mWorkers{},
+    mMutex{},
+    mWake{},
+    mDone{},
+    mQueued{0},
+    mPending{0},
+    mNext{0},
+    mStop{false},
+    mError{}
+{
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    mWorkers.push_back(std::make_unique<Worker>());
+  }
+  // Only start them once every deque exists, since they steal from each other.
+  for (unsigned i = 0; i < threads; i++) {
+    mWorkers[i]->thread = std::thread{&WorkStealingPool::run, this, i};
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock{mMutex};
+    mStop = true;
+  }
+  mWake.notify_all();
+  for (auto& worker : mWorkers) {
+    worker->thread.join();
+  }
+}
+
+void WorkStealingPool::submit(Task task) {
+  unsigned index = currentPool == this ? currentWorker
+                                       : mNext.fetch_add(1) % size();
+  mPending++;
+  {
+    Worker& worker = *mWorkers[index];
+    std::lock_guard<std::mutex> lock{worker.mutex};
+    worker.tasks.push_back(std::move(task));
+  }
+  {
+    // Counted under mMutex, so a worker about to sleep either sees the task
+    // or gets the notification.
+    std::lock_guard<std::mutex> lock{mMutex};
+    mQueued++;
+  }
+  mWake.notify_one();
+}
+
+void WorkStealingPool::wait() {
+  std::unique_lock<std::mutex> lock{mMutex};
+  mDone.wait(lock, [this]() { return mPending == 0; });
+  if (mError) {
+    std::exception_ptr error = mError;
+    mError = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+bool WorkStealingPool::take(unsigned index, Task& task) {
+  {
+    // Own deque: newest first
+    Worker& own = *mWorkers[index];
+    std::lock_guard<std::mutex> lock{own.mutex};
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (unsigned i = 1; i < size(); i++) {
+    // Others' deques: oldest first, which tends to be the biggest piece of
+    // work left, so steals are rare.
+    Worker& victim = *mWorkers[(index + i) % size()];
+    std::lock_guard<std::mutex> lock{victim.mutex};
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingPool::execute(unsigned index, Task& task) {
+  mQueued--;
+  try {
+    task(index);
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    if (!mError) {
+      mError = std::current_exception();
+    }
+  }
+  task = nullptr;
+  if (--mPending == 0) {
+    std::lock_guard<std::mutex> lock{mMutex};
+    mDone.notify_all();
+  }
+}
+
+void WorkStealingPool::run(unsigned index) {
+  currentPool = this;
+  currentWorker = index;
+  Task task;
+  while (true) {
+    if (take(index, task)) {
+      execute(index, task);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock{mMutex};
+    mWake.wait(lock, [this]() { return mQueued > 0 || mStop; });
+    if (mStop && mQueued <= 0) {
+      return;
+    }
+  }
+}
+
+void WorkStealingPool::parallelFor(
+    size_t count, size_t batches,
+    const std::function<void(size_t begin, size_t end, unsigned worker)>& f) {
+  if (count == 0) {
+    return;
+  }
+  batches = std::max<size_t>(std::min(batches, count), 1);
+
+  struct Progress {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining;
+    std::exception_ptr error;
+  } progress;
+  progress.remaining = batches;
+
+  for (size_t i = 0; i < batches; i++) {
+    size_t begin = count * i / batches;
+    size_t end = count * (i + 1) / batches;
+    submit([&progress, &f, begin, end](unsigned worker) {
+      std::exception_ptr error;
+      try {
+        f(begin, end, worker);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+      // Counted down under the lock, so the caller can't return (and
+      // destroy progress) until we're done with it.
+      std::lock_guard<std::mutex> lock{progress.mutex};
+      if (error && !progress.error) {
+        progress.error = error;
+      }
+      if (--progress.remaining == 0) {
+        progress.done.notify_all();
+      }
+    });
+  }
+
+  std::unique_lock<std::mutex> lock{progress.mutex};
+  if (currentPool == this) {
+    // Blocking here could leave every worker waiting on tasks that no one
+    // is left to run, so help out until our ranges are done.
+    Task task;
+    while (progress.remaining > 0) {
+      lock.unlock();
+      if (take(currentWorker, task)) {
+        execute(currentWorker, task);
+      }
+      else {
+        std::this_thread::yield();
+      }
+      lock.lock();
+    }
+  }
+  else {
+    progress.done.wait(lock, [&progress]() { return progress.remaining == 0; });
+  }
+  if (progress.error) {
+    std::rethrow_exception(progress.error);
+  }
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include "nbt_query.hpp"
+
+
+std::vector<PathStep> parsePath(std::string_view path) {
+  if (path.empty()) {
+    throw NBTException{"Empty path"};
+  }
+  std::vector<PathStep> steps;
+  size_t i = 0;
+  while (i < path.size()) {
+    if (path[i] == '[') {
+      size_t close = path.find(']', i);
+      if (close == std::string_view::npos) {
+        throw NBTException{"Unterminated subscript in path"};
+      }
+      std::string_view subscript = path.substr(i + 1, close - i - 1);
+      if (subscript == "*") {
+        steps.push_back(PathStep{PathStep::ALL, "", 0});
+      }
+      else {
+        if (subscript.empty() || subscript.size() > 10) {
+          throw NBTException{"Invalid subscript in path"};
+        }
+        int64_t index = 0;
+        for (char c : subscript) {
+          if (c < '0' || c > '9') {
+            throw NBTException{"Invalid subscript in path"};
+          }
+          index = index * 10 + (c - '0');
+        }
+        if (index > INT32_MAX) {
+          throw NBTException{"Invalid subscript in path"};
+        }
+        steps.push_back(PathStep{PathStep::INDEX, "", static_cast<int32_t>(index)});
+      }
+      i = close + 1;
+    }
+    else {
+      size_t end = path.find_first_of(".[", i);
+      if (end == std::string_view::npos) {
+        end = path.size();
+      }
+      if (end == i) {
+        throw NBTException{"Empty name in path"};
+      }
+      steps.push_back(PathStep{PathStep::NAME, std::string{path.substr(i, end - i)}, 0});
+      i = end;
+    }
+    // A step is followed by a subscript, a dot and a name, or the end.
+    if (i < path.size() && path[i] == '.') {
+      i++;
+      if (i == path.size() || path[i] == '[' || path[i] == '.') {
+        throw NBTException{"Empty name in path"};
+      }
+    }
+  }
+  return steps;
+}
+
+
+Query::Query(std::initializer_list<std::string_view> paths)
+  : mNodes{}, mPaths{0}
+{
+  mNodes.push_back(Node{PathStep{PathStep::NAME, "", 0}, NO_MATCH, {}});
+  for (std::string_view path : paths) {
+    add(path);
+  }
+}
+
+Query::Query(const std::vector<std::string>& paths)
+  : mNodes{}, mPaths{0}
+{
+  mNodes.push_back(Node{PathStep{PathStep::NAME, "", 0}, NO_MATCH, {}});
+  for (const std::string& path : paths) {
+    add(path);
+  }
+}
+
+void Query::add(std::string_view path) {
+  uint32_t node = 0;
+  for (PathStep& step : parsePath(path)) {
+    if (mNodes[node].match != NO_MATCH) {
+      throw NBTException{"A path is a prefix of another"};
+    }
+    uint32_t next = NO_MATCH;
+    for (uint32_t child : mNodes[node].children) {
+      const PathStep& other = mNodes[child].step;
+      if (other == step) {
+        next = child;
+        break;
+      }
+      bool subscripts = step.kind != PathStep::NAME && other.kind != PathStep::NAME;
+      if (subscripts && (step.kind == PathStep::ALL || other.kind == PathStep::ALL)) {
+        throw NBTException{"A list is subscripted with both '*' and an index"};
+      }
+    }
+    if (next == NO_MATCH) {
+      next = static_cast<uint32_t>(mNodes.size());
+      mNodes.push_back(Node{std::move(step), NO_MATCH, {}});
+      mNodes[node].children.push_back(next);
+    }
+    node = next;
+  }
+  if (mNodes[node].match != NO_MATCH || !mNodes[node].children.empty()) {
+    throw NBTException{"A path is a prefix of another"};
+  }
+  mNodes[node].match = static_cast<uint32_t>(mPaths++);
+}
+
+uint32_t Query::findChild(const Node& node, std::string_view name) const {
+  for (uint32_t child : node.children) {
+    const PathStep& step = mNodes[child].step;
+    if (step.kind == PathStep::NAME && step.name == name) {
+      return child;
+    }
+  }
+  return NO_MATCH;
+}
+
+uint32_t Query::findChild(const Node& node, int32_t index) const {
+  for (uint32_t child : node.children) {
+    const PathStep& step = mNodes[child].step;
+    if (step.kind == PathStep::ALL ||
+        (step.kind == PathStep::INDEX && step.index == index)) {
+      return child;
+    }
+  }
+  return NO_MATCH;
+}
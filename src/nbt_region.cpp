@@ -0,0 +1,498 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <utility>
+
+#include "nbt_region.hpp"
+#include "nbt_writer.hpp"
+
+
+namespace {
+
+/**
+ * Flushes the directory holding filename, so that renames and new entries
+ * in it survive a crash.
+ */
+void syncDirectory(const std::string& filename) {
+  std::string directory = std::filesystem::path{filename}.parent_path().string();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    throw NBTException("Unable to open directory");
+  }
+  int result = ::fsync(fd);
+  ::close(fd);
+  if (result < 0) {
+    throw NBTException("Unable to sync directory");
+  }
+}
+
+void storeBigEndian(char* p, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = static_cast<char>(value >> (24 - 8 * i));
+  }
+}
+
+/**
+ * Reads up to size bytes at offset, returning how many there were.
+ */
+size_t readAt(int fd, void* data, size_t size, size_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pread(fd, static_cast<char*>(data) + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw NBTException("Unable to read region file");
+    }
+    if (n == 0) {
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+  return done;
+}
+
+} // namespace
+
+
+RegionFile::RegionFile(std::string filename)
+  : mFile{std::in_place, std::move(filename), MappedFile::RANDOM},
+    mData{mFile->data()},
+    mSize{mFile->size()},
+    mLocations(CHUNKS),
+    mTimestamps(CHUNKS)
+{
+  readHeader();
+}
+
+RegionFile::RegionFile(const void* data, size_t size)
+  : mFile{},
+    mData{static_cast<const char*>(data)},
+    mSize{size},
+    mLocations(CHUNKS),
+    mTimestamps(CHUNKS)
+{
+  readHeader();
+}
+
+void RegionFile::readHeader() {
+  // The game treats an empty file as a region with no chunks yet.
+  if (mSize == 0) {
+    std::fill(mLocations.begin(), mLocations.end(), Location{0, 0});
+    std::fill(mTimestamps.begin(), mTimestamps.end(), 0);
+    return;
+  }
+  if (mSize < HEADER_SIZE) {
+    throw NBTException("Region file header is truncated");
+  }
+  for (int i = 0; i < CHUNKS; i++) {
+    // 3 bytes of sector offset, then 1 byte of sector count
+    uint32_t entry = loadBigEndian<uint32_t>(mData + i * 4);
+    mLocations[i] = Location{entry >> 8, entry & 0xff};
+    mTimestamps[i] = loadBigEndian<uint32_t>(mData + SECTOR_SIZE + i * 4);
+  }
+}
+
+size_t RegionFile::chunkCount() const {
+  return std::count_if(mLocations.begin(), mLocations.end(),
+                       [](const Location& l) { return l.sectors != 0; });
+}
+
+RegionFile::ChunkData RegionFile::chunkData(int x, int z) const {
+  const Location& location = mLocations[index(x, z)];
+  if (location.sectors == 0) {
+    throw NBTException("Chunk is not in the region");
+  }
+  size_t begin = static_cast<size_t>(location.offset) * SECTOR_SIZE;
+  // The data is preceded by its length (including the compression byte) and
+  // the compression byte. The sector count isn't checked against the
+  // length, as some tools write it inaccurately; the file size is what
+  // matters for safety.
+  if (location.offset < 2 || begin > mSize || mSize - begin < 5) {
+    throw NBTException("Chunk lies outside the region file");
+  }
+  uint32_t length = loadBigEndian<uint32_t>(mData + begin);
+  if (length == 0 || length - 1 > mSize - begin - 5) {
+    throw NBTException("Chunk lies outside the region file");
+  }
+  uint8_t compression = static_cast<uint8_t>(mData[begin + 4]);
+  if (compression & 0x80) {
+    throw NBTException("Chunk is stored in a separate file");
+  }
+  return ChunkData{compression, mData + begin + 5, length - 1};
+}
+
+NBTReader<InflateInput> RegionFile::openChunk(int x, int z) const {
+  ChunkData chunk = chunkData(x, z);
+  if (chunk.compression != GZIP && chunk.compression != ZLIB && chunk.compression != NONE) {
+    throw NBTException("Unsupported chunk compression");
+  }
+  // InflateInput tells the three apart by itself: uncompressed NBT starts
+  // with a compound's ID, which is neither a gzip nor a zlib header.
+  InflateInput input{chunk.data, chunk.size};
+  input.setMaxSize(MAX_INFLATED_SIZE);
+  return NBTReader<InflateInput>{std::move(input)};
+}
+
+CompoundTag RegionFile::readChunk(int x, int z) const {
+  NBTReader<InflateInput> reader = openChunk(x, z);
+  TagID id = reader.readID();
+  if (id != TagID::COMPOUND) {
+    throw NBTTagException(id, "Chunk is not a compound");
+  }
+  return reader.readCompoundTag();
+}
+
+
+struct RegionWriter::State {
+  State() : initialized{false}, buffer{}, writer{} { }
+
+  ~State() {
+    if (initialized) {
+      deflateEnd(&stream);
+    }
+  }
+
+  /**
+   * Compresses segments as zlib data into the buffer, after room for the
+   * chunk header, and returns the compressed size.
+   */
+  size_t deflateInto(const std::vector<struct iovec>& segments);
+
+  z_stream stream;
+  bool initialized;
+  // The chunk being stored: its 5 header bytes, data and padding
+  std::vector<char> buffer;
+  // For serializing trees
+  NBTWriter writer;
+};
+
+size_t RegionWriter::State::deflateInto(const std::vector<struct iovec>& segments) {
+  if (!initialized) {
+    stream = z_stream{};
+    if (deflateInit(&stream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+      throw NBTException("Unable to initialize zlib");
+    }
+    initialized = true;
+  }
+  else {
+    deflateReset(&stream);
+  }
+  size_t total = 0;
+  for (const struct iovec& segment : segments) {
+    total += segment.iov_len;
+  }
+  // Compressing into deflateBound's worth of space can't run out of room.
+  buffer.resize(5 + deflateBound(&stream, total));
+  stream.next_out = reinterpret_cast<Bytef*>(buffer.data() + 5);
+  stream.avail_out = static_cast<uInt>(buffer.size() - 5);
+  for (const struct iovec& segment : segments) {
+    stream.next_in = static_cast<Bytef*>(segment.iov_base);
+    stream.avail_in = static_cast<uInt>(segment.iov_len);
+    if (deflate(&stream, Z_NO_FLUSH) != Z_OK || stream.avail_in != 0) {
+      throw NBTException("Unable to compress chunk");
+    }
+  }
+  if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+    throw NBTException("Unable to compress chunk");
+  }
+  return stream.total_out;
+}
+
+
+RegionWriter::RegionWriter(std::string filename)
+  : mFilename{std::move(filename)},
+    mFd{-1},
+    mLocations(RegionFile::CHUNKS),
+    mTimestamps(RegionFile::CHUNKS),
+    mUsed{},
+    mInPlace{false},
+    mState{std::make_unique<State>()}
+{
+  mFd = ::open(mFilename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (mFd < 0) {
+    throw NBTException("Unable to open file");
+  }
+  try {
+    readHeader();
+  }
+  catch (...) {
+    ::close(mFd);
+    throw;
+  }
+}
+
+RegionWriter::~RegionWriter() {
+  if (mFd >= 0) {
+    ::close(mFd);
+  }
+}
+
+RegionWriter::RegionWriter(RegionWriter&& other) noexcept
+  : mFilename{std::move(other.mFilename)},
+    mFd{other.mFd},
+    mLocations{std::move(other.mLocations)},
+    mTimestamps{std::move(other.mTimestamps)},
+    mUsed{std::move(other.mUsed)},
+    mInPlace{other.mInPlace},
+    mState{std::move(other.mState)}
+{
+  other.mFd = -1;
+}
+
+RegionWriter& RegionWriter::operator=(RegionWriter&& other) noexcept {
+  std::swap(mFilename, other.mFilename);
+  std::swap(mFd, other.mFd);
+  std::swap(mLocations, other.mLocations);
+  std::swap(mTimestamps, other.mTimestamps);
+  std::swap(mUsed, other.mUsed);
+  std::swap(mInPlace, other.mInPlace);
+  std::swap(mState, other.mState);
+  return *this;
+}
+
+void RegionWriter::readHeader() {
+  struct stat st;
+  if (fstat(mFd, &st) < 0) {
+    throw NBTException("Unable to stat file");
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  std::vector<char> header(RegionFile::HEADER_SIZE);
+  if (size == 0) {
+    writeAt(mFd, header.data(), header.size(), 0);
+    size = header.size();
+  }
+  else if (readAt(mFd, header.data(), header.size(), 0) < header.size()) {
+    throw NBTException("Region file header is truncated");
+  }
+  // A partial last sector still counts; appending starts after it.
+  mUsed.assign((size + RegionFile::SECTOR_SIZE - 1) / RegionFile::SECTOR_SIZE, false);
+  mUsed[0] = mUsed[1] = true;
+  for (int i = 0; i < RegionFile::CHUNKS; i++) {
+    uint32_t entry = loadBigEndian<uint32_t>(header.data() + i * 4);
+    Location location{entry >> 8, entry & 0xff};
+    mTimestamps[i] = loadBigEndian<uint32_t>(header.data() + RegionFile::SECTOR_SIZE + i * 4);
+    if (location.sectors == 0 || location.offset < 2 ||
+        location.offset + location.sectors > mUsed.size()) {
+      location = Location{0, 0};
+    }
+    mLocations[i] = location;
+    std::fill_n(mUsed.begin() + location.offset, location.sectors, true);
+  }
+}
+
+size_t RegionWriter::chunkCount() const {
+  return std::count_if(mLocations.begin(), mLocations.end(),
+                       [](const Location& l) { return l.sectors != 0; });
+}
+
+size_t RegionWriter::freeSectors() const {
+  return std::count(mUsed.begin(), mUsed.end(), false);
+}
+
+void RegionWriter::writeChunk(int x, int z, const TagBase& chunk, uint32_t timestamp) {
+  NBTWriter& writer = mState->writer;
+  writer.clear();
+  writer.writeTag(chunk);
+  writeChunk(x, z, writer, timestamp);
+}
+
+void RegionWriter::writeChunk(int x, int z, const NBTWriter& chunk, uint32_t timestamp) {
+  size_t size = mState->deflateInto(chunk.segments());
+  store(RegionFile::index(x, z), RegionFile::ZLIB, size, timestamp);
+}
+
+void RegionWriter::writeChunkData(int x, int z, uint8_t compression, const void* data,
+                                  size_t size, uint32_t timestamp) {
+  std::vector<char>& buffer = mState->buffer;
+  buffer.resize(5 + size);
+  std::memcpy(buffer.data() + 5, data, size);
+  store(RegionFile::index(x, z), compression, size, timestamp);
+}
+
+void RegionWriter::store(int index, uint8_t compression, size_t size, uint32_t timestamp) {
+  size_t sectors = (5 + size + RegionFile::SECTOR_SIZE - 1) / RegionFile::SECTOR_SIZE;
+  if (sectors > MAX_CHUNK_SECTORS) {
+    throw NBTException("Chunk is too large for a region file");
+  }
+  std::vector<char>& buffer = mState->buffer;
+  storeBigEndian(buffer.data(), static_cast<uint32_t>(size + 1));
+  buffer[4] = static_cast<char>(compression);
+  // Whole sectors, so the file never ends partway through one
+  buffer.resize(sectors * RegionFile::SECTOR_SIZE);
+  std::fill(buffer.begin() + 5 + size, buffer.end(), 0);
+
+  Location old = mLocations[index];
+  Location location{0, static_cast<uint32_t>(sectors)};
+  // Sectors to free once the table no longer points at them
+  Location freed = old;
+  if (mInPlace && old.sectors >= sectors) {
+    location.offset = old.offset;
+    freed = Location{old.offset + location.sectors, old.sectors - location.sectors};
+  }
+  else {
+    // The old copy stays intact until the table points elsewhere.
+    location.offset = allocate(location.sectors);
+  }
+  writeAt(mFd, buffer.data(), buffer.size(), location.offset * RegionFile::SECTOR_SIZE);
+
+  if (timestamp == 0) {
+    timestamp = static_cast<uint32_t>(std::time(nullptr));
+  }
+  char entry[4];
+  storeBigEndian(entry, location.offset << 8 | location.sectors);
+  writeAt(mFd, entry, 4, index * 4);
+  storeBigEndian(entry, timestamp);
+  writeAt(mFd, entry, 4, RegionFile::SECTOR_SIZE + index * 4);
+  mLocations[index] = location;
+  mTimestamps[index] = timestamp;
+  release(freed.offset, freed.sectors);
+}
+
+void RegionWriter::removeChunk(int x, int z) {
+  int index = RegionFile::index(x, z);
+  Location old = mLocations[index];
+  if (old.sectors == 0) {
+    return;
+  }
+  char entry[4] = {0, 0, 0, 0};
+  writeAt(mFd, entry, 4, index * 4);
+  writeAt(mFd, entry, 4, RegionFile::SECTOR_SIZE + index * 4);
+  mLocations[index] = Location{0, 0};
+  mTimestamps[index] = 0;
+  release(old.offset, old.sectors);
+}
+
+uint32_t RegionWriter::allocate(uint32_t sectors) {
+  // First fit among the free sectors...
+  size_t run = 0;
+  for (size_t i = 2; i < mUsed.size(); i++) {
+    run = mUsed[i] ? 0 : run + 1;
+    if (run == sectors) {
+      size_t start = i + 1 - sectors;
+      std::fill_n(mUsed.begin() + start, sectors, true);
+      return static_cast<uint32_t>(start);
+    }
+  }
+  // ...or at the end of the file, taking in any free sectors already there.
+  size_t start = mUsed.size() - run;
+  if (start > 0xffffff) {
+    throw NBTException("Region file is full");
+  }
+  mUsed.resize(start + sectors, false);
+  std::fill_n(mUsed.begin() + start, sectors, true);
+  return static_cast<uint32_t>(start);
+}
+
+void RegionWriter::release(uint32_t offset, uint32_t sectors) {
+  std::fill_n(mUsed.begin() + offset, sectors, false);
+}
+
+void RegionWriter::writeAt(int fd, const void* data, size_t size, size_t offset) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = ::pwrite(fd, static_cast<const char*>(data) + done, size - done, offset + done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      throw NBTException("Unable to write region file");
+    }
+    done += static_cast<size_t>(n);
+  }
+}
+
+void RegionWriter::compact() {
+  std::string temporary = mFilename + ".compact";
+  int fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw NBTException("Unable to open file");
+  }
+  std::vector<Location> locations(RegionFile::CHUNKS, Location{0, 0});
+  uint32_t next = 2;
+  try {
+    std::vector<char>& buffer = mState->buffer;
+    for (int i = 0; i < RegionFile::CHUNKS; i++) {
+      Location old = mLocations[i];
+      if (old.sectors == 0) {
+        continue;
+      }
+      buffer.resize(old.sectors * RegionFile::SECTOR_SIZE);
+      size_t n = readAt(mFd, buffer.data(), buffer.size(), old.offset * RegionFile::SECTOR_SIZE);
+      std::fill(buffer.begin() + n, buffer.end(), 0);
+      // Trim sectors the chunk doesn't use, if its length makes sense.
+      uint32_t sectors = old.sectors;
+      if (n >= 4) {
+        size_t length = loadBigEndian<uint32_t>(buffer.data());
+        size_t needed = (4 + length + RegionFile::SECTOR_SIZE - 1) / RegionFile::SECTOR_SIZE;
+        sectors = static_cast<uint32_t>(std::min<size_t>(needed, sectors));
+      }
+      writeAt(fd, buffer.data(), sectors * RegionFile::SECTOR_SIZE, next * RegionFile::SECTOR_SIZE);
+      locations[i] = Location{next, sectors};
+      next += sectors;
+    }
+
+    std::vector<char> header(RegionFile::HEADER_SIZE);
+    for (int i = 0; i < RegionFile::CHUNKS; i++) {
+      storeBigEndian(header.data() + i * 4, locations[i].offset << 8 | locations[i].sectors);
+      storeBigEndian(header.data() + RegionFile::SECTOR_SIZE + i * 4, mTimestamps[i]);
+    }
+    writeAt(fd, header.data(), header.size(), 0);
+    // The new file has to be on disk before it replaces the old one.
+    if (::fsync(fd) < 0) {
+      throw NBTException("Unable to write region file");
+    }
+    if (std::rename(temporary.c_str(), mFilename.c_str()) < 0) {
+      throw NBTException("Unable to replace region file");
+    }
+  }
+  catch (...) {
+    ::close(fd);
+    ::unlink(temporary.c_str());
+    throw;
+  }
+  ::close(mFd);
+  mFd = fd;
+  mLocations = std::move(locations);
+  mUsed.assign(next, true);
+  // The rename itself is only durable once the directory is synced.
+  syncDirectory(mFilename);
+}
+
+void RegionWriter::sync() {
+  if (::fsync(mFd) < 0) {
+    throw NBTException("Unable to write region file");
+  }
+}
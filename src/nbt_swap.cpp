@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+/*
+ * Bulk byte swaps for array payloads.
+ *
+ * On x86 there are SSSE3 and AVX2 shuffle kernels next to the scalar loops.
+ * The best one the CPU supports is picked the first time each function is
+ * called.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#include "nbt.hpp"
+#include "nbt_swap.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NBT_SWAP_X86 1
+#endif
+
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+template <typename T>
+static inline T bswap(T x);
+
+template <>
+inline uint16_t bswap(uint16_t x) {
+  return __builtin_bswap16(x);
+}
+
+template <>
+inline uint32_t bswap(uint32_t x) {
+  return __builtin_bswap32(x);
+}
+
+template <>
+inline uint64_t bswap(uint64_t x) {
+  return __builtin_bswap64(x);
+}
+
+/**
+ * Swaps count values of type T starting at data. Goes through memcpy so data
+ * doesn't need to be aligned.
+ */
+template <typename T>
+static void swapScalar(char* data, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    T value;
+    std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+    value = bswap(value);
+    std::memcpy(data + i * sizeof(T), &value, sizeof(T));
+  }
+}
+
+
+#ifdef NBT_SWAP_X86
+
+/**
+ * pshufb control that reverses each sizeof(T)-byte lane of a 16-byte block.
+ */
+template <size_t width>
+static inline __attribute__((target("ssse3"))) __m128i reverseMask128() {
+  alignas(16) char mask[16];
+  for (size_t i = 0; i < 16; i++) {
+    mask[i] = static_cast<char>((i / width) * width + (width - 1 - i % width));
+  }
+  return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+template <typename T>
+static __attribute__((target("ssse3"))) void swapSSSE3(char* data, size_t count) {
+  const __m128i mask = reverseMask128<sizeof(T)>();
+  size_t bytes = count * sizeof(T);
+  size_t i = 0;
+  for (; i + 32 <= bytes; i += 32) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(a, mask));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i + 16), _mm_shuffle_epi8(b, mask));
+  }
+  for (; i + 16 <= bytes; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), _mm_shuffle_epi8(a, mask));
+  }
+  swapScalar<T>(data + i, (bytes - i) / sizeof(T));
+}
+
+template <typename T>
+static __attribute__((target("avx2"))) void swapAVX2(char* data, size_t count) {
+  // vpshufb shuffles within each 128-bit half, so the same 16-byte control
+  // goes in both halves.
+  const __m256i mask = _mm256_broadcastsi128_si256(reverseMask128<sizeof(T)>());
+  size_t bytes = count * sizeof(T);
+  size_t i = 0;
+  for (; i + 64 <= bytes; i += 64) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_shuffle_epi8(a, mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i + 32), _mm256_shuffle_epi8(b, mask));
+  }
+  for (; i + 32 <= bytes; i += 32) {
+    __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(data + i), _mm256_shuffle_epi8(a, mask));
+  }
+  swapScalar<T>(data + i, (bytes - i) / sizeof(T));
+}
+
+#endif // NBT_SWAP_X86
+
+
+typedef void (*SwapKernel)(char*, size_t);
+
+template <typename T>
+static SwapKernel selectKernel() {
+#ifdef NBT_SWAP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return swapAVX2<T>;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return swapSSSE3<T>;
+  }
+#endif
+  return swapScalar<T>;
+}
+
+/*
+ * The kernel for T, picked on first use. A function-local static is
+ * initialized exactly once even when several threads get here together, and
+ * works when called during static initialization of another translation
+ * unit.
+ */
+template <typename T>
+static SwapKernel kernel() {
+  static const SwapKernel k = selectKernel<T>();
+  return k;
+}
+
+void swapInPlace16(void* data, size_t count) {
+  kernel<uint16_t>()(static_cast<char*>(data), count);
+}
+
+void swapInPlace32(void* data, size_t count) {
+  kernel<uint32_t>()(static_cast<char*>(data), count);
+}
+
+void swapInPlace64(void* data, size_t count) {
+  kernel<uint64_t>()(static_cast<char*>(data), count);
+}
+
+/*
+ * Wraps a char* kernel in the void* signature swapInPlace has.
+ */
+template <void (*swap)(char*, size_t)>
+static void swapVoid(void* data, size_t count) {
+  swap(static_cast<char*>(data), count);
+}
+
+std::vector<SwapKernels> availableSwapKernels() {
+  std::vector<SwapKernels> kernels;
+  kernels.push_back(SwapKernels{"scalar",
+      swapVoid<swapScalar<uint16_t>>,
+      swapVoid<swapScalar<uint32_t>>,
+      swapVoid<swapScalar<uint64_t>>});
+#ifdef NBT_SWAP_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("ssse3")) {
+    kernels.push_back(SwapKernels{"ssse3",
+        swapVoid<swapSSSE3<uint16_t>>,
+        swapVoid<swapSSSE3<uint32_t>>,
+        swapVoid<swapSSSE3<uint64_t>>});
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back(SwapKernels{"avx2",
+        swapVoid<swapAVX2<uint16_t>>,
+        swapVoid<swapAVX2<uint32_t>>,
+        swapVoid<swapAVX2<uint64_t>>});
+  }
+#endif
+  return kernels;
+}
+
+#elif __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+
+// File order is host order, so there's nothing to do.
+
+void swapInPlace16(void*, size_t) { }
+
+void swapInPlace32(void*, size_t) { }
+
+void swapInPlace64(void*, size_t) { }
+
+std::vector<SwapKernels> availableSwapKernels() {
+  return {SwapKernels{"none", swapInPlace16, swapInPlace32, swapInPlace64}};
+}
+
+#else
+#error "Unsupported host byte order"
+#endif
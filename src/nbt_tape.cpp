@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <limits>
+
+#include "nbt_tape.hpp"
+
+
+TapeRef TapeRef::at(size_t i) const {
+  if (!hasChildren()) {
+    throw NBTTagException(id(), "Tag has no children");
+  }
+  const TapeEntry& e = entry();
+  if (i >= e.high()) {
+    throw std::out_of_range("TapeRef::at");
+  }
+  switch (e.elementID()) {
+    case TagID::BYTE:
+    case TagID::SHORT:
+    case TagID::INT:
+    case TagID::LONG:
+    case TagID::FLOAT:
+    case TagID::DOUBLE:
+    case TagID::STRING:
+    case TagID::BYTE_ARRAY:
+    case TagID::INT_ARRAY:
+    case TagID::LONG_ARRAY:
+      if (e.id() == TagID::LIST) {
+        // One entry per element
+        return TapeRef{mTape, mIndex + 1 + static_cast<uint32_t>(i)};
+      }
+      break;
+    default:
+      break;
+  }
+  iterator it = begin();
+  for (size_t skipped = 0; skipped < i; skipped++) {
+    ++it;
+  }
+  return *it;
+}
+
+TapeRef TapeRef::find(std::string_view name) const {
+  if (id() != TagID::COMPOUND) {
+    throw NBTTagException(id(), "Tag is not a compound");
+  }
+  for (TapeRef child : *this) {
+    if (child.name() == name) {
+      return child;
+    }
+  }
+  return TapeRef{mTape, NONE};
+}
+
+
+Tape::Tape() :
+  mEntries{},
+  mData{nullptr},
+  mSize{0},
+  mParsed{0}
+{ }
+
+TapeRef Tape::root() const {
+  if (mEntries.empty()) {
+    throw NBTException{"Tape is empty"};
+  }
+  return TapeRef{this, 0};
+}
+
+uint32_t Tape::offsetOf(const char* ptr) const {
+  return static_cast<uint32_t>(ptr - mData);
+}
+
+void Tape::parse(const void* data, size_t size) {
+  mEntries.clear();
+  mData = static_cast<const char*>(data);
+  mSize = size;
+  mParsed = 0;
+  if (size >= std::numeric_limits<uint32_t>::max()) {
+    throw NBTException{"Input is too large for a tape"};
+  }
+
+  NBTReader<BufferInput> reader{BufferInput{data, size}};
+  TapeEntry root{};
+  root.setID(reader.readID());
+  root.setElementID(TagID::END);
+  if (root.id() != TagID::END) {
+    std::string_view name = reader.readNameView();
+    root.nameOffset = offsetOf(name.data());
+    root.nameSize = static_cast<uint16_t>(name.size());
+  }
+  mEntries.push_back(root);
+  try {
+    if (root.id() != TagID::END) {
+      parsePayload(reader, 0, 0);
+    }
+  }
+  catch (...) {
+    mEntries.clear();
+    throw;
+  }
+  mParsed = reader.position();
+}
+
+/**
+ * Fills in the value of the entry at index, whose ID and name are already
+ * set, and appends entries for its children.
+ */
+void Tape::parsePayload(NBTReader<BufferInput>& reader, uint32_t index, int depth) {
+  // mEntries grows while children are parsed, so look the entry up by index
+  // rather than holding a reference.
+  TagID id = mEntries[index].id();
+  uint64_t value = 0;
+  switch (id) {
+    case TagID::BYTE:
+      value = static_cast<uint64_t>(static_cast<int64_t>(reader.readNumber<int8_t>()));
+      break;
+    case TagID::SHORT:
+      value = static_cast<uint64_t>(static_cast<int64_t>(reader.readNumber<int16_t>()));
+      break;
+    case TagID::INT:
+      value = static_cast<uint64_t>(static_cast<int64_t>(reader.readNumber<int32_t>()));
+      break;
+    case TagID::LONG:
+      value = static_cast<uint64_t>(reader.readNumber<int64_t>());
+      break;
+    case TagID::FLOAT:
+      value = reader.readNumber<uint32_t>();
+      break;
+    case TagID::DOUBLE:
+      value = reader.readNumber<uint64_t>();
+      break;
+    case TagID::STRING:
+      {
+        size_t length = reader.readNumber<uint16_t>();
+        const char* str = reader.readView(length);
+        value = offsetOf(str) | static_cast<uint64_t>(length) << 32;
+      }
+      break;
+    case TagID::BYTE_ARRAY:
+    case TagID::INT_ARRAY:
+    case TagID::LONG_ARRAY:
+      {
+        int32_t count = reader.readSize();
+        if (count < 0) {
+          throw NBTException{"Negative array size"};
+        }
+        size_t width = id == TagID::BYTE_ARRAY ? 1 : id == TagID::INT_ARRAY ? 4 : 8;
+        const char* payload = reader.readView(static_cast<size_t>(count) * width);
+        value = offsetOf(payload) | static_cast<uint64_t>(count) << 32;
+      }
+      break;
+    case TagID::LIST:
+      {
+        if (depth >= MAX_DEPTH) {
+          throw NBTException{"Tags are nested too deeply"};
+        }
+        TagID elementID = reader.readID();
+        int32_t count = reader.readSize();
+        if (count < 0) {
+          throw NBTException{"Negative list size"};
+        }
+        if (count > 0 && elementID == TagID::END) {
+          throw NBTTagException(elementID, "Unrecognized tag in list");
+        }
+        mEntries[index].setElementID(elementID);
+        for (int32_t i = 0; i < count; i++) {
+          TapeEntry element{};
+          element.setID(elementID);
+          element.setElementID(TagID::END);
+          uint32_t elementIndex = static_cast<uint32_t>(mEntries.size());
+          mEntries.push_back(element);
+          parsePayload(reader, elementIndex, depth + 1);
+        }
+        value = static_cast<uint32_t>(mEntries.size()) |
+          static_cast<uint64_t>(count) << 32;
+      }
+      break;
+    case TagID::COMPOUND:
+      {
+        if (depth >= MAX_DEPTH) {
+          throw NBTException{"Tags are nested too deeply"};
+        }
+        uint32_t count = 0;
+        TagID childID;
+        while ((childID = reader.readID()) != TagID::END) {
+          TapeEntry child{};
+          child.setID(childID);
+          child.setElementID(TagID::END);
+          std::string_view name = reader.readNameView();
+          child.nameOffset = offsetOf(name.data());
+          child.nameSize = static_cast<uint16_t>(name.size());
+          uint32_t childIndex = static_cast<uint32_t>(mEntries.size());
+          mEntries.push_back(child);
+          parsePayload(reader, childIndex, depth + 1);
+          count++;
+        }
+        value = static_cast<uint32_t>(mEntries.size()) |
+          static_cast<uint64_t>(count) << 32;
+      }
+      break;
+    default:
+      throw NBTTagException(id, "Unrecognized tag");
+  }
+  mEntries[index].value = value;
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "nbt_value.hpp"
+#include "nbt_writer.hpp"
+
+
+Value* ValueCompound::find(std::string_view name) {
+  for (Member& member : members) {
+    if (member.first == name) {
+      return &member.second;
+    }
+  }
+  return nullptr;
+}
+
+const Value* ValueCompound::find(std::string_view name) const {
+  return const_cast<ValueCompound*>(this)->find(name);
+}
+
+void ValueCompound::set(std::string name, Value value) {
+  Value* existing = find(name);
+  if (existing != nullptr) {
+    *existing = std::move(value);
+  }
+  else {
+    members.emplace_back(std::move(name), std::move(value));
+  }
+}
+
+Value toValue(const TagBase& tag) {
+  // The tag classes only agree on their encoding, so go through it.
+  NBTWriter writer;
+  writer.writePayload(tag);
+  NBTReader<BufferInput> reader{BufferInput{writer.data(), writer.size()}};
+  return readValue(reader, tag.id());
+}
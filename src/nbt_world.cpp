@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#include <system_error>
+
+#include "nbt_input.hpp"
+#include "nbt_pool.hpp"
+#include "nbt_region.hpp"
+#include "nbt_world.hpp"
+
+
+namespace {
+
+/**
+ * Region coordinates from a file name like r.-1.2.mca.
+ */
+bool regionCoordinates(const std::filesystem::path& path, int& x, int& z) {
+  std::string name = path.filename().string();
+  int length = 0;
+  return std::sscanf(name.c_str(), "r.%d.%d.mca%n", &x, &z, &length) == 2 &&
+         static_cast<size_t>(length) == name.size();
+}
+
+/**
+ * What a thread keeps between chunks.
+ */
+struct WorkerState {
+  WorkerState() : initialized{false}, buffer(1 << 20), doc{}, stats{} { }
+
+  ~WorkerState() {
+    if (initialized) {
+      inflateEnd(&stream);
+    }
+  }
+
+  /**
+   * Decompresses a chunk into the buffer, or hands back uncompressed data
+   * as it is.
+   */
+  BufferInput inflateChunk(const RegionFile::ChunkData& chunk);
+
+  z_stream stream;
+  bool initialized;
+  std::vector<char> buffer;
+  Document doc;
+  ScanStats stats;
+};
+
+BufferInput WorkerState::inflateChunk(const RegionFile::ChunkData& chunk) {
+  if (chunk.compression == RegionFile::NONE) {
+    stats.bytes += chunk.size;
+    return BufferInput{chunk.data, chunk.size};
+  }
+  if (chunk.compression != RegionFile::GZIP && chunk.compression != RegionFile::ZLIB) {
+    throw NBTException("Unsupported chunk compression");
+  }
+  // 15 + 32: either a zlib or a gzip header, whatever the byte says
+  if (!initialized) {
+    stream = z_stream{};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+      throw NBTException("Unable to initialize zlib");
+    }
+    initialized = true;
+  }
+  else {
+    inflateReset(&stream);
+  }
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(chunk.data));
+  stream.avail_in = static_cast<uInt>(chunk.size);
+  size_t size = 0;
+  while (true) {
+    if (size == buffer.size()) {
+      if (size >= RegionFile::MAX_INFLATED_SIZE) {
+        throw NBTException("Chunk inflates to more than the limit");
+      }
+      buffer.resize(std::min(buffer.size() * 2, RegionFile::MAX_INFLATED_SIZE));
+    }
+    stream.next_out = reinterpret_cast<Bytef*>(buffer.data() + size);
+    stream.avail_out = static_cast<uInt>(std::min<size_t>(buffer.size() - size, UINT_MAX));
+    int ret = inflate(&stream, Z_NO_FLUSH);
+    size = reinterpret_cast<char*>(stream.next_out) - buffer.data();
+    if (ret == Z_STREAM_END) {
+      break;
+    }
+    if (ret == Z_BUF_ERROR && stream.avail_in == 0) {
+      throw NBTException("Compressed data ends early");
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+      throw NBTException("Corrupt compressed data");
+    }
+  }
+  stats.bytes += size;
+  return BufferInput{buffer.data(), size};
+}
+
+} // namespace
+
+
+std::vector<std::string> findRegionFiles(const std::string& directory) {
+  namespace fs = std::filesystem;
+  std::error_code error;
+  if (!fs::is_directory(directory, error)) {
+    throw NBTException("Not a directory");
+  }
+  std::vector<std::string> files;
+  fs::path root{directory};
+  auto options = fs::directory_options::skip_permission_denied;
+  for (fs::recursive_directory_iterator it{root, options, error}, end;
+       !error && it != end; it.increment(error)) {
+    const fs::path& path = it->path();
+    int x, z;
+    if (!it->is_regular_file(error) || !regionCoordinates(path, x, z)) {
+      continue;
+    }
+    // Entity and POI files are region files too, but don't hold chunks.
+    fs::path parent = path.parent_path();
+    if (parent.filename() == "region" || parent == root) {
+      files.push_back(path.string());
+    }
+  }
+  if (error) {
+    throw NBTException("Unable to read directory");
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+
+struct WorldScanner::State {
+  explicit State(unsigned threads) : pool{threads}, workers{}, failed{false} {
+    for (unsigned i = 0; i < pool.size(); i++) {
+      workers.push_back(std::make_unique<WorkerState>());
+    }
+  }
+
+  void scanRegion(std::string_view path, unsigned worker,
+                  const WorkerCallback& callback, const ErrorCallback& onError);
+
+  void scanRow(const std::shared_ptr<RegionFile>& region, std::string_view path,
+               int regionX, int regionZ, int z, unsigned worker,
+               const WorkerCallback& callback, const ErrorCallback& onError);
+
+  WorkStealingPool pool;
+  // Separately allocated, so threads don't share cache lines
+  std::vector<std::unique_ptr<WorkerState>> workers;
+  // Set once a callback has thrown, to drop the rest of the scan
+  std::atomic<bool> failed;
+};
+
+void WorldScanner::State::scanRegion(std::string_view path, unsigned worker,
+                                     const WorkerCallback& callback,
+                                     const ErrorCallback& onError) {
+  if (failed) {
+    return;
+  }
+  int regionX = 0, regionZ = 0;
+  regionCoordinates(std::filesystem::path{path}, regionX, regionZ);
+  std::shared_ptr<RegionFile> region;
+  try {
+    region = std::make_shared<RegionFile>(std::string{path});
+  }
+  catch (NBTException& e) {
+    workers[worker]->stats.errors++;
+    if (onError) {
+      onError(ChunkInfo{path, regionX * RegionFile::SIDE, regionZ * RegionFile::SIDE, 0, 0}, e);
+    }
+    return;
+  }
+  workers[worker]->stats.regions++;
+  // These land on this worker's own deque; it works through them newest
+  // first while idle workers steal the oldest.
+  for (int z = 0; z < RegionFile::SIDE; z++) {
+    bool any = false;
+    for (int x = 0; x < RegionFile::SIDE && !any; x++) {
+      any = region->contains(x, z);
+    }
+    if (any) {
+      pool.submit([this, region, path, regionX, regionZ, z, &callback, &onError](unsigned w) {
+        scanRow(region, path, regionX, regionZ, z, w, callback, onError);
+      });
+    }
+  }
+}
+
+void WorldScanner::State::scanRow(const std::shared_ptr<RegionFile>& region,
+                                  std::string_view path, int regionX, int regionZ,
+                                  int z, unsigned worker,
+                                  const WorkerCallback& callback,
+                                  const ErrorCallback& onError) {
+  WorkerState& state = *workers[worker];
+  for (int x = 0; x < RegionFile::SIDE && !failed; x++) {
+    if (!region->contains(x, z)) {
+      continue;
+    }
+    ChunkInfo info{path, regionX * RegionFile::SIDE + x, regionZ * RegionFile::SIDE + z,
+                   region->timestamp(x, z), 0};
+    try {
+      RegionFile::ChunkData data = region->chunkData(x, z);
+      info.size = data.size;
+      NBTReader reader{state.inflateChunk(data)};
+      // Names and strings point into the buffer, which stays put until the
+      // next chunk.
+      state.doc.read(reader, true);
+    }
+    catch (NBTException& e) {
+      state.stats.errors++;
+      if (onError) {
+        onError(info, e);
+      }
+      continue;
+    }
+    state.stats.chunks++;
+    state.stats.compressedBytes += info.size;
+    try {
+      callback(worker, info, state.doc);
+    }
+    catch (...) {
+      failed = true;
+      throw;
+    }
+  }
+}
+
+
+WorldScanner::WorldScanner(unsigned threads)
+  : mState{std::make_unique<State>(threads)}, mOnError{}
+{ }
+
+WorldScanner::~WorldScanner() = default;
+
+unsigned WorldScanner::threads() const {
+  return mState->pool.size();
+}
+
+ScanStats WorldScanner::scan(const std::vector<std::string>& regions,
+                             const Callback& callback) {
+  return run(regions, [&](unsigned, const ChunkInfo& chunk, const Document& doc) {
+    callback(chunk, doc);
+  });
+}
+
+ScanStats WorldScanner::run(const std::vector<std::string>& regions,
+                            const WorkerCallback& callback) {
+  State& state = *mState;
+  state.failed = false;
+  for (auto& worker : state.workers) {
+    worker->stats = ScanStats{};
+  }
+  const ErrorCallback& onError = mOnError;
+  for (const std::string& path : regions) {
+    std::string_view view{path};
+    state.pool.submit([&state, view, &callback, &onError](unsigned worker) {
+      state.scanRegion(view, worker, callback, onError);
+    });
+  }
+  state.pool.wait();
+
+  ScanStats totals{};
+  for (auto& worker : state.workers) {
+    totals.regions += worker->stats.regions;
+    totals.chunks += worker->stats.chunks;
+    totals.errors += worker->stats.errors;
+    totals.compressedBytes += worker->stats.compressedBytes;
+    totals.bytes += worker->stats.bytes;
+  }
+  return totals;
+}
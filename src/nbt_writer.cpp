@@ -0,0 +1,475 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <limits.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+
+#include "nbt_value.hpp"
+#include "nbt_writer.hpp"
+
+
+NBTWriter::NBTWriter()
+  : mData{}, mSize{0}, mCapacity{0}, mFrames{},
+    mGatherThreshold{0}, mGathered{0}, mSegments{}, mCut{0},
+    mScratch{}, mScratchSize{0}, mScratchCapacity{0}
+{ }
+
+void NBTWriter::clear() {
+  mSize = 0;
+  mFrames.clear();
+  mGathered = 0;
+  mSegments.clear();
+  mCut = 0;
+  mScratchSize = 0;
+}
+
+char* NBTWriter::growSlow(size_t n) {
+  size_t capacity = std::max({mCapacity * 2, mSize + n, size_t{4096}});
+  std::unique_ptr<char[]> data{new char[capacity]};
+  if (mSize > 0) {
+    std::memcpy(data.get(), mData.get(), mSize);
+  }
+  mData = std::move(data);
+  mCapacity = capacity;
+  char* p = mData.get() + mSize;
+  mSize += n;
+  return p;
+}
+
+/**
+ * Ends the current run of the buffer and appends segment after it.
+ */
+void NBTWriter::gather(Segment segment) {
+  if (mSize > mCut) {
+    mSegments.push_back(Segment{Segment::BUFFER, mCut, nullptr, mSize - mCut});
+    mCut = mSize;
+  }
+  mGathered += segment.size;
+  mSegments.push_back(segment);
+}
+
+/**
+ * Writes the payload of an array or list of numbers, gathering it if it is
+ * large enough.
+ */
+template <typename T>
+void NBTWriter::writeArrayPayload(const T* values, size_t count) {
+  size_t bytes = count * sizeof(T);
+  if (mGatherThreshold == 0 || bytes < mGatherThreshold) {
+    writeNumbers(values, count);
+    return;
+  }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if constexpr (sizeof(T) > 1) {
+    if (bytes > mScratchCapacity - mScratchSize) {
+      size_t capacity = std::max(mScratchCapacity * 2, mScratchSize + bytes);
+      std::unique_ptr<char[]> scratch{new char[capacity]};
+      if (mScratchSize > 0) {
+        std::memcpy(scratch.get(), mScratch.get(), mScratchSize);
+      }
+      mScratch = std::move(scratch);
+      mScratchCapacity = capacity;
+    }
+    char* dst = mScratch.get() + mScratchSize;
+    std::memcpy(dst, values, bytes);
+    if constexpr (sizeof(T) == 2) {
+      swapInPlace16(dst, count);
+    }
+    else if constexpr (sizeof(T) == 4) {
+      swapInPlace32(dst, count);
+    }
+    else {
+      swapInPlace64(dst, count);
+    }
+    gather(Segment{Segment::SCRATCH, mScratchSize, nullptr, bytes});
+    mScratchSize += bytes;
+    return;
+  }
+#endif
+  gather(Segment{Segment::EXTERNAL, 0, reinterpret_cast<const char*>(values), bytes});
+}
+
+std::vector<struct iovec> NBTWriter::segments() const {
+  std::vector<struct iovec> iov;
+  iov.reserve(mSegments.size() + 1);
+  for (const Segment& segment : mSegments) {
+    const char* base = segment.kind == Segment::BUFFER ? mData.get() + segment.offset :
+                       segment.kind == Segment::SCRATCH ? mScratch.get() + segment.offset :
+                       segment.external;
+    iov.push_back(iovec{const_cast<char*>(base), segment.size});
+  }
+  if (mSize > mCut) {
+    iov.push_back(iovec{mData.get() + mCut, mSize - mCut});
+  }
+  return iov;
+}
+
+void NBTWriter::writeTo(std::ostream& out) const {
+  for (const struct iovec& segment : segments()) {
+    out.write(static_cast<const char*>(segment.iov_base),
+              static_cast<std::streamsize>(segment.iov_len));
+  }
+}
+
+void NBTWriter::writeTo(int fd) const {
+  std::vector<struct iovec> iov = segments();
+  size_t first = 0;
+  while (first < iov.size()) {
+    int count = static_cast<int>(std::min(iov.size() - first, size_t{IOV_MAX}));
+    ssize_t written = ::writev(fd, iov.data() + first, count);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written < 0) {
+      throw NBTException("Unable to write file");
+    }
+    // Step over what was written; a short write can end mid-segment.
+    size_t done = static_cast<size_t>(written);
+    while (first < iov.size() && done >= iov[first].iov_len) {
+      done -= iov[first].iov_len;
+      first++;
+    }
+    if (done > 0) {
+      iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + done;
+      iov[first].iov_len -= done;
+    }
+  }
+}
+
+void NBTWriter::writeFile(std::string filename) const {
+  std::ofstream file{filename, std::ios_base::out | std::ios_base::binary};
+  if (!file.is_open()) {
+    throw NBTException("Unable to open file");
+  }
+  writeTo(file);
+  if (!file) {
+    throw NBTException("Unable to write file");
+  }
+}
+
+
+void NBTWriter::writeID(TagID id) {
+  *grow(1) = static_cast<char>(id);
+}
+
+void NBTWriter::writeName(std::string_view name) {
+  if (name.size() > UINT16_MAX) {
+    throw NBTException("Name or string is too long");
+  }
+  writeNumber(static_cast<uint16_t>(name.size()));
+  writeBytes(name.data(), name.size());
+}
+
+void NBTWriter::writeBytes(const void* data, size_t n) {
+  if (n > 0) {
+    std::memcpy(grow(n), data, n);
+  }
+}
+
+void NBTWriter::writeEncoded(const void* data, size_t n) {
+  if (mGatherThreshold == 0 || n < mGatherThreshold) {
+    writeBytes(data, n);
+    return;
+  }
+  gather(Segment{Segment::EXTERNAL, 0, static_cast<const char*>(data), n});
+}
+
+/**
+ * Starts a tag: its ID and name inside a compound or at the top level, or
+ * nothing but a type check inside a list.
+ */
+void NBTWriter::header(TagID id, std::string_view name) {
+  if (!mFrames.empty() && mFrames.back().id == TagID::LIST) {
+    Frame& list = mFrames.back();
+    if (id != list.elementID) {
+      throw NBTTagException(id, "List element has a different type");
+    }
+    if (list.written == list.size) {
+      throw NBTException("More list elements than the list's size");
+    }
+    list.written++;
+    return;
+  }
+  writeID(id);
+  writeName(name);
+}
+
+
+void NBTWriter::beginCompound(std::string_view name) {
+  header(TagID::COMPOUND, name);
+  mFrames.push_back(Frame{TagID::COMPOUND, TagID::END, 0, 0});
+}
+
+void NBTWriter::endCompound() {
+  if (mFrames.empty() || mFrames.back().id != TagID::COMPOUND) {
+    throw NBTException("endCompound without beginCompound");
+  }
+  mFrames.pop_back();
+  writeID(TagID::END);
+}
+
+void NBTWriter::beginList(std::string_view name, TagID elementID, int32_t size) {
+  if (size < 0) {
+    throw NBTException("Negative list size");
+  }
+  header(TagID::LIST, name);
+  writeID(elementID);
+  writeNumber(size);
+  mFrames.push_back(Frame{TagID::LIST, elementID, size, 0});
+}
+
+void NBTWriter::endList() {
+  if (mFrames.empty() || mFrames.back().id != TagID::LIST) {
+    throw NBTException("endList without beginList");
+  }
+  if (mFrames.back().written != mFrames.back().size) {
+    throw NBTException("Fewer list elements than the list's size");
+  }
+  mFrames.pop_back();
+}
+
+void NBTWriter::writeByte(std::string_view name, int8_t value) {
+  header(TagID::BYTE, name);
+  writeNumber(value);
+}
+
+void NBTWriter::writeShort(std::string_view name, int16_t value) {
+  header(TagID::SHORT, name);
+  writeNumber(value);
+}
+
+void NBTWriter::writeInt(std::string_view name, int32_t value) {
+  header(TagID::INT, name);
+  writeNumber(value);
+}
+
+void NBTWriter::writeLong(std::string_view name, int64_t value) {
+  header(TagID::LONG, name);
+  writeNumber(value);
+}
+
+void NBTWriter::writeFloat(std::string_view name, float value) {
+  header(TagID::FLOAT, name);
+  writeNumber(value);
+}
+
+void NBTWriter::writeDouble(std::string_view name, double value) {
+  header(TagID::DOUBLE, name);
+  writeNumber(value);
+}
+
+void NBTWriter::writeString(std::string_view name, std::string_view value) {
+  header(TagID::STRING, name);
+  writeName(value);
+}
+
+template <typename T>
+void NBTWriter::writeArray(TagID id, std::string_view name, const T* values, size_t count) {
+  if (count > INT32_MAX) {
+    throw NBTException("Array is too long");
+  }
+  header(id, name);
+  writeNumber(static_cast<int32_t>(count));
+  writeArrayPayload(values, count);
+}
+
+void NBTWriter::writeByteArray(std::string_view name, const int8_t* values, size_t count) {
+  writeArray(TagID::BYTE_ARRAY, name, values, count);
+}
+
+void NBTWriter::writeIntArray(std::string_view name, const int32_t* values, size_t count) {
+  writeArray(TagID::INT_ARRAY, name, values, count);
+}
+
+void NBTWriter::writeLongArray(std::string_view name, const int64_t* values, size_t count) {
+  writeArray(TagID::LONG_ARRAY, name, values, count);
+}
+
+
+void NBTWriter::writeTag(const TagBase& tag) {
+  header(tag.id(), tag.name());
+  writePayload(tag);
+}
+
+/**
+ * Writes the payload of tag if it is a ListTag<T>.
+ */
+template <typename T>
+bool NBTWriter::writeListIf(const TagBase& tag) {
+  const ListTag<T>* list = dynamic_cast<const ListTag<T>*>(&tag);
+  if (list == nullptr) {
+    return false;
+  }
+  if constexpr (std::is_same<T, EndTag>::value) {
+    writeID(TagID::END);
+    writeNumber(list->size());
+  }
+  else {
+    const auto& values = list->value();
+    if (values.size() > INT32_MAX) {
+      throw NBTException("List is too long");
+    }
+    writeID(getTagID<T>());
+    writeNumber(static_cast<int32_t>(values.size()));
+    if constexpr (std::is_same<T, CompoundTag>::value) {
+      for (const CompoundTag& compound : values) {
+        writePayload(compound);
+      }
+    }
+    else if constexpr (std::is_same<T, StringTag>::value) {
+      for (const std::string& str : values) {
+        writeName(str);
+      }
+    }
+    else if constexpr (is_array_tag<T>::value) {
+      for (const auto& array : values) {
+        writeNumber(static_cast<int32_t>(array.size()));
+        writeArrayPayload(array.data(), array.size());
+      }
+    }
+    else {
+      writeArrayPayload(values.data(), values.size());
+    }
+  }
+  return true;
+}
+
+void NBTWriter::writePayload(const TagBase& tag) {
+  switch (tag.id()) {
+    case TagID::BYTE:
+      writeNumber(static_cast<const ByteTag&>(tag).value());
+      break;
+    case TagID::SHORT:
+      writeNumber(static_cast<const ShortTag&>(tag).value());
+      break;
+    case TagID::INT:
+      writeNumber(static_cast<const IntTag&>(tag).value());
+      break;
+    case TagID::LONG:
+      writeNumber(static_cast<const LongTag&>(tag).value());
+      break;
+    case TagID::FLOAT:
+      writeNumber(static_cast<const FloatTag&>(tag).value());
+      break;
+    case TagID::DOUBLE:
+      writeNumber(static_cast<const DoubleTag&>(tag).value());
+      break;
+    case TagID::STRING:
+      writeName(static_cast<const StringTag&>(tag).value());
+      break;
+    case TagID::BYTE_ARRAY:
+      {
+        const std::vector<int8_t>& values = static_cast<const ByteArrayTag&>(tag).value();
+        writeNumber(static_cast<int32_t>(values.size()));
+        writeArrayPayload(values.data(), values.size());
+      }
+      break;
+    case TagID::INT_ARRAY:
+      {
+        const std::vector<int32_t>& values = static_cast<const IntArrayTag&>(tag).value();
+        writeNumber(static_cast<int32_t>(values.size()));
+        writeArrayPayload(values.data(), values.size());
+      }
+      break;
+    case TagID::LONG_ARRAY:
+      {
+        const std::vector<int64_t>& values = static_cast<const LongArrayTag&>(tag).value();
+        writeNumber(static_cast<int32_t>(values.size()));
+        writeArrayPayload(values.data(), values.size());
+      }
+      break;
+    case TagID::LIST:
+      if (!(writeListIf<CompoundTag>(tag) ||
+            writeListIf<ByteTag>(tag) ||
+            writeListIf<ShortTag>(tag) ||
+            writeListIf<IntTag>(tag) ||
+            writeListIf<LongTag>(tag) ||
+            writeListIf<FloatTag>(tag) ||
+            writeListIf<DoubleTag>(tag) ||
+            writeListIf<StringTag>(tag) ||
+            writeListIf<ByteArrayTag>(tag) ||
+            writeListIf<IntArrayTag>(tag) ||
+            writeListIf<LongArrayTag>(tag) ||
+            writeListIf<EndTag>(tag))) {
+        throw NBTTagException(tag.id(), "Unsupported list type");
+      }
+      break;
+    case TagID::COMPOUND:
+      for (const std::shared_ptr<TagBase>& child : static_cast<const CompoundTag&>(tag).value()) {
+        writeID(child->id());
+        writeName(child->name());
+        writePayload(*child);
+      }
+      writeID(TagID::END);
+      break;
+    default:
+      throw NBTTagException(tag.id(), "Unrecognized tag");
+  }
+}
+
+void NBTWriter::writeValue(std::string_view name, const Value& value) {
+  header(value.id(), name);
+  writeValuePayload(value);
+}
+
+void NBTWriter::writeValuePayload(const Value& value) {
+  value.visit([this](const auto& v) {
+    using V = std::decay_t<decltype(v)>;
+    if constexpr (std::is_arithmetic<V>::value) {
+      writeNumber(v);
+    }
+    else if constexpr (std::is_same<V, std::string>::value) {
+      writeName(v);
+    }
+    else if constexpr (std::is_same<V, ValueList>::value) {
+      if (v.elements.size() > INT32_MAX) {
+        throw NBTException("List is too long");
+      }
+      writeID(v.elementID);
+      writeNumber(static_cast<int32_t>(v.elements.size()));
+      for (const Value& element : v.elements) {
+        if (element.id() != v.elementID) {
+          throw NBTTagException(element.id(), "List element has a different type");
+        }
+        writeValuePayload(element);
+      }
+    }
+    else if constexpr (std::is_same<V, ValueCompound>::value) {
+      for (const ValueCompound::Member& member : v.members) {
+        writeID(member.second.id());
+        writeName(member.first);
+        writeValuePayload(member.second);
+      }
+      writeID(TagID::END);
+    }
+    else if constexpr (!std::is_same<V, std::monostate>::value) {
+      // Arrays
+      if (v.size() > INT32_MAX) {
+        throw NBTException("Array is too long");
+      }
+      writeNumber(static_cast<int32_t>(v.size()));
+      writeArrayPayload(v.data(), v.size());
+    }
+  });
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_cache.hpp"
+#include "nbt_region.hpp"
+
+
+/*
+ * A chunk with some bulk: {"xPos": x, "zPos": z, "Data": [size ints]}
+ */
+static CompoundTag makeChunk(int x, int z, size_t size = 1000) {
+  CompoundTag chunk{""};
+  chunk.push_back(IntTag{"xPos", x});
+  chunk.push_back(IntTag{"zPos", z});
+  chunk.push_back(IntArrayTag{"Data", std::vector<int32_t>(size, x * 100 + z)});
+  return chunk;
+}
+
+
+TEST_CASE("Caching chunks", "[cache]") {
+  char path[] = "/tmp/nbt_cache_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+  std::string region{path};
+  {
+    RegionWriter writer{region};
+    for (int i = 0; i < 10; i++) {
+      writer.writeChunk(i, 0, makeChunk(i, 0), 1000 + i);
+    }
+  }
+
+  SECTION("Hits share one document") {
+    ChunkCache cache{64 << 20};
+    ChunkCache::Handle first = cache.get(region, 3, 0);
+    REQUIRE(first);
+    REQUIRE(first->root().find("xPos")->value<IntTag>() == 3);
+    REQUIRE(first->root().find("Data")->value<IntArrayTag>()[999] == 300);
+    ChunkCache::Handle second = cache.get(region, 3, 0);
+    REQUIRE(second == first);
+    // Absolute chunk coordinates land on the same slot.
+    REQUIRE(cache.get(region, 32 + 3, -32) == first);
+    REQUIRE(cache.stats().hits == 2);
+    REQUIRE(cache.stats().misses == 1);
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.bytes() == first->memoryUsage());
+
+    REQUIRE(!cache.get(region, 20, 20));
+    REQUIRE(cache.size() == 1);
+    REQUIRE_THROWS_AS(cache.get("/nonexistent/r.0.0.mca", 0, 0), NBTException);
+  }
+  SECTION("Chunks share interned names") {
+    ChunkCache cache{64 << 20};
+    ChunkCache::Handle first = cache.get(region, 3, 0);
+    ChunkCache::Handle other = cache.get(region, 4, 0);
+    REQUIRE(other->root().at(0).name().data() == first->root().at(0).name().data());
+    std::string_view xPos = cache.nameTable()->intern("xPos");
+    REQUIRE(first->root().findInterned(xPos)->value<IntTag>() == 3);
+    REQUIRE(other->root().findInterned(xPos)->value<IntTag>() == 4);
+  }
+  SECTION("Evicting least recently used bytes") {
+    ChunkCache probe{64 << 20};
+    size_t chunkBytes = probe.get(region, 0, 0)->memoryUsage();
+
+    ChunkCache cache{chunkBytes * 3 + chunkBytes / 2};
+    ChunkCache::Handle zero = cache.get(region, 0, 0);
+    cache.get(region, 1, 0);
+    cache.get(region, 2, 0);
+    // Touch 0, so 1 is the oldest.
+    cache.get(region, 0, 0);
+    cache.get(region, 3, 0);
+    REQUIRE(cache.size() == 3);
+    REQUIRE(cache.stats().evictions == 1);
+    REQUIRE(cache.bytes() <= cache.budget());
+    size_t misses = cache.stats().misses;
+    REQUIRE(cache.get(region, 0, 0) == zero);
+    REQUIRE(cache.get(region, 2, 0));
+    REQUIRE(cache.stats().misses == misses);
+    cache.get(region, 1, 0);
+    REQUIRE(cache.stats().misses == misses + 1);
+
+    // Handles outlive eviction.
+    cache.setBudget(0);
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.bytes() == 0);
+    REQUIRE(zero->root().find("xPos")->value<IntTag>() == 0);
+  }
+  SECTION("Refreshing after writes") {
+    ChunkCache cache{64 << 20};
+    ChunkCache::Handle five = cache.get(region, 5, 0);
+    ChunkCache::Handle six = cache.get(region, 6, 0);
+    cache.get(region, 7, 0);
+    {
+      RegionWriter writer{region};
+      writer.writeChunk(5, 0, makeChunk(5, 0, 10), 2000);
+      writer.removeChunk(7, 0);
+    }
+    // Nothing changes until the region is refreshed.
+    REQUIRE(cache.get(region, 5, 0) == five);
+    REQUIRE(cache.refresh(region) == 2);
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.get(region, 6, 0) == six);
+    ChunkCache::Handle updated = cache.get(region, 5, 0);
+    REQUIRE(updated != five);
+    REQUIRE(updated->root().find("Data")->size() == 10);
+    REQUIRE(!cache.get(region, 7, 0));
+    REQUIRE(cache.refresh() == 0);
+    REQUIRE(cache.refresh("/not/cached.mca") == 0);
+
+    unlink(path);
+    REQUIRE_THROWS_AS(cache.refresh(region), NBTException);
+    REQUIRE(cache.size() == 0);
+  }
+  SECTION("Concurrent lookups") {
+    ChunkCache cache{64 << 20};
+    std::atomic<int> wrong{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+      threads.emplace_back([&cache, &region, &wrong, t]() {
+        for (int i = 0; i < 200; i++) {
+          int x = (i * 7 + t) % 10;
+          ChunkCache::Handle chunk = cache.get(region, x, 0);
+          if (!chunk || chunk->root().find("xPos")->value<IntTag>() != x) {
+            wrong++;
+          }
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(cache.size() == 10);
+    REQUIRE(cache.stats().hits + cache.stats().misses == 800);
+  }
+  unlink(path);
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "catch2/catch.hpp"
+
+#include "nbt_cursor.hpp"
+#include "test_util.hpp"
+
+
+/*
+ * Walks list_compound_tag.dat, reading some tags and skipping the rest.
+ */
+template <typename Input>
+static void walkListCompound(NBTCursor<Input>& cursor) {
+  REQUIRE(cursor.next());
+  REQUIRE(cursor.tagId() == TagID::LIST);
+  REQUIRE(cursor.name() == "listof compound");
+  cursor.enter();
+  REQUIRE(cursor.depth() == 1);
+  REQUIRE(cursor.elementID() == TagID::COMPOUND);
+  REQUIRE(cursor.listSize() == 2);
+
+  REQUIRE(cursor.next());
+  REQUIRE(cursor.tagId() == TagID::COMPOUND);
+  REQUIRE(cursor.name() == "");
+  cursor.enter();
+  REQUIRE(cursor.next());
+  REQUIRE(cursor.tagId() == TagID::STRING);
+  REQUIRE(cursor.name() == "string child");
+  REQUIRE(cursor.readString() == "asdfsdfg");
+  REQUIRE(cursor.next());
+  REQUIRE(cursor.tagId() == TagID::LONG_ARRAY);
+  REQUIRE(cursor.name() == "long array child");
+  REQUIRE(cursor.skip() == 4 + 2 * 8);
+  REQUIRE(!cursor.next());
+  REQUIRE(cursor.tagId() == TagID::END);
+  cursor.leave();
+  REQUIRE(cursor.tagId() == TagID::COMPOUND);
+  REQUIRE(cursor.depth() == 1);
+
+  REQUIRE(cursor.next());
+  cursor.enter();
+  REQUIRE(cursor.next());
+  REQUIRE(cursor.name() == "int child");
+  REQUIRE_THROWS_AS(cursor.template read<ShortTag>(), NBTTagException);
+  REQUIRE(cursor.template read<IntTag>() == 0x01020304);
+  REQUIRE_THROWS_AS(cursor.template read<IntTag>(), NBTTagException);
+  // Skips both short children
+  cursor.leave();
+  REQUIRE(!cursor.next());
+  cursor.leave();
+  REQUIRE(cursor.depth() == 0);
+  REQUIRE(!cursor.next());
+}
+
+
+TEST_CASE("Pull cursor", "[cursor]") {
+  SECTION("From a stream") {
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    NBTCursor cursor{file};
+    walkListCompound(cursor);
+    REQUIRE_THROWS(file.readID());
+  }
+  SECTION("From a buffer") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    NBTCursor cursor{reader};
+    walkListCompound(cursor);
+    REQUIRE(reader.position() == bytes.size());
+  }
+  SECTION("Stopping early") {
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    NBTCursor cursor{file};
+    REQUIRE(cursor.next());
+    cursor.enter();
+    REQUIRE(cursor.next());
+    cursor.enter();
+    cursor.leave();
+    cursor.leave();
+    REQUIRE(cursor.depth() == 0);
+    REQUIRE_THROWS_AS(cursor.leave(), NBTException);
+    REQUIRE(!cursor.next());
+  }
+  SECTION("Materializing tags") {
+    // compound_tag.dat leaves out the root's (empty) name
+    std::vector<char> bytes = slurp("./test/data/compound_tag.dat");
+    bytes.insert(bytes.begin() + 1, 2, '\0');
+    NBTReader reader{BufferInput{bytes}};
+    NBTCursor cursor{reader};
+    REQUIRE(cursor.next());
+    REQUIRE_THROWS_AS(cursor.readString(), NBTTagException);
+    cursor.enter();
+    std::vector<std::string> names;
+    while (cursor.next()) {
+      names.emplace_back(cursor.name());
+      if (cursor.tagId() == TagID::LIST) {
+        auto list = std::dynamic_pointer_cast<ListTag<DoubleTag>>(cursor.readTag());
+        REQUIRE(list != nullptr);
+        REQUIRE(list->name() == "list child");
+        REQUIRE(list->value() == std::vector<double>{21.33, 13.37});
+      }
+    }
+    REQUIRE(names == std::vector<std::string>{
+      "string child", "long child", "int array child", "list child"});
+    REQUIRE_THROWS_AS(cursor.enter(), NBTTagException);
+  }
+  SECTION("Lists of ends") {
+    std::vector<char> bytes{0x09, 0x00, 0x00, 0x00, 0x7f, char(0xff), char(0xff), char(0xff)};
+    NBTReader reader{BufferInput{bytes}};
+    NBTCursor cursor{reader};
+    REQUIRE(cursor.next());
+    cursor.enter();
+    REQUIRE(!cursor.next());
+    cursor.leave();
+    REQUIRE(reader.position() == bytes.size());
+  }
+  SECTION("Truncated input") {
+    NBTFile file{"./test/data/ends_unexpectedly_compound.dat"};
+    NBTCursor cursor{file};
+    auto walk = [&]() {
+      cursor.next();
+      cursor.enter();
+      cursor.leave();
+    };
+    REQUIRE_THROWS_AS(walk(), NBTException);
+  }
+}
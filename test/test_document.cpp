@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <sstream>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_document.hpp"
+#include "test_util.hpp"
+
+
+/*
+ * The same checks against list_compound_tag.dat, however it was parsed.
+ */
+static void checkListCompound(const Document& doc) {
+  const Node& list = doc.root();
+  REQUIRE(list.id() == TagID::LIST);
+  REQUIRE(list.name() == "listof compound");
+  REQUIRE(list.elementID() == TagID::COMPOUND);
+  REQUIRE(list.size() == 2);
+
+  const Node& first = list.at(0);
+  REQUIRE(first.id() == TagID::COMPOUND);
+  REQUIRE(first.name() == "");
+  REQUIRE(first.size() == 2);
+  REQUIRE(first.at(0).name() == "string child");
+  REQUIRE(first.at(0).value<StringTag>() == "asdfsdfg");
+  ArrayRef<int64_t> longs = first.find("long array child")->value<LongArrayTag>();
+  REQUIRE(longs.size() == 2);
+  REQUIRE(longs[0] == 0x0001020304050607);
+  REQUIRE(longs[1] == 0x08090a0b0c0d0e0f);
+
+  const Node& second = list.at(1);
+  REQUIRE(second.size() == 3);
+  REQUIRE(second.find("int child")->value<IntTag>() == 0x01020304);
+  REQUIRE(second.find("short child")->value<ShortTag>() == 0x0506);
+  REQUIRE(second.find("short child2")->value<ShortTag>() == 0x0708);
+  REQUIRE(second.find("missing") == nullptr);
+}
+
+
+TEST_CASE("Arena-allocated documents", "[document]") {
+  SECTION("Compound") {
+    // compound_tag.dat leaves out the root's (empty) name
+    std::vector<char> bytes = slurp("./test/data/compound_tag.dat");
+    bytes.insert(bytes.begin() + 1, 2, '\0');
+    NBTReader reader{BufferInput{bytes}};
+    Document doc = readDocument(reader);
+    const Node& root = doc.root();
+    REQUIRE(root.id() == TagID::COMPOUND);
+    REQUIRE(root.size() == 4);
+
+    REQUIRE(root.at(0).value<StringTag>() == "Hello world");
+    REQUIRE(root.at(1).value<LongTag>() == 0x7766554433221100);
+    std::vector<int32_t> ints{0x33221100, 0x00112233};
+    ArrayRef<int32_t> intArray = root.at(2).value<IntArrayTag>();
+    REQUIRE(std::vector<int32_t>(intArray.begin(), intArray.end()) == ints);
+
+    const Node& list = root.at(3);
+    REQUIRE(list.name() == "list child");
+    REQUIRE(list.elementID() == TagID::DOUBLE);
+    REQUIRE(list.size() == 2);
+    REQUIRE(list.at(0).value<DoubleTag>() == 21.33);
+    REQUIRE(list.at(1).value<DoubleTag>() == 13.37);
+
+    REQUIRE_THROWS_AS(root.at(0).value<IntTag>(), NBTTagException);
+    REQUIRE_THROWS(root.at(4));
+  }
+  SECTION("List of compounds from a stream") {
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    Document doc = readDocument(file);
+    checkListCompound(doc);
+  }
+  SECTION("Borrowing from the input buffer") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    Document doc = readDocument(reader, true);
+    checkListCompound(doc);
+    const char* name = doc.root().at(0).at(0).name().data();
+    REQUIRE(name >= bytes.data());
+    REQUIRE(name < bytes.data() + bytes.size());
+  }
+  SECTION("Scalars and byte arrays") {
+    {
+      MappedNBTFile file{"./test/data/float_tag.dat"};
+      Document doc = readDocument(file);
+      REQUIRE(doc.root().name() == "float tag");
+      REQUIRE(doc.root().value<FloatTag>() == 64.0f);
+    }
+    {
+      MappedNBTFile file{"./test/data/byte_array_tag.dat"};
+      Document doc = readDocument(file, true);
+      ArrayRef<int8_t> bytes = doc.root().value<ByteArrayTag>();
+      std::vector<int8_t> expected{0x12, 0x23, 0x34, 0x45};
+      REQUIRE(std::vector<int8_t>(bytes.begin(), bytes.end()) == expected);
+    }
+  }
+  SECTION("Reusing a document") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    Document doc;
+    REQUIRE(doc.empty());
+    {
+      NBTReader reader{BufferInput{bytes}};
+      doc.read(reader);
+    }
+    size_t used = doc.arena().bytesUsed();
+    size_t reserved = doc.arena().bytesReserved();
+    REQUIRE(used > 0);
+    for (int i = 0; i < 10; i++) {
+      NBTReader reader{BufferInput{bytes}};
+      doc.read(reader);
+      checkListCompound(doc);
+    }
+    REQUIRE(doc.arena().bytesUsed() == used);
+    REQUIRE(doc.arena().bytesReserved() == reserved);
+  }
+  SECTION("Truncated input") {
+    MappedNBTFile file{"./test/data/ends_unexpectedly_compound.dat"};
+    Document doc;
+    REQUIRE_THROWS(doc.read(file));
+    REQUIRE(doc.empty());
+  }
+  SECTION("Corrupt sizes") {
+    // Unnamed tags claiming 0x7fffffff elements, followed by nothing: the
+    // reader has to run out of input before it runs out of memory.
+    std::vector<std::string> inputs{
+      std::string{"\x0b\x00\x00\x7f\xff\xff\xff", 7},
+      std::string{"\x0c\x00\x00\x7f\xff\xff\xff", 7},
+      std::string{"\x07\x00\x00\x7f\xff\xff\xff", 7},
+      std::string{"\x09\x00\x00\x0a\x7f\xff\xff\xff", 8},
+      std::string{"\x09\x00\x00\x01\x7f\xff\xff\xff\x01", 9},
+    };
+    for (const std::string& bytes : inputs) {
+      {
+        NBTReader reader{BufferInput{bytes.data(), bytes.size()}};
+        Document doc;
+        REQUIRE_THROWS_AS(doc.read(reader), NBTException);
+      }
+      {
+        std::istringstream stream{bytes};
+        NBTReader reader{IStreamInput{stream}};
+        Document doc;
+        REQUIRE_THROWS_AS(doc.read(reader), NBTException);
+      }
+    }
+  }
+  SECTION("Long lists and arrays from a stream") {
+    // Big enough to be read in steps rather than allocated up front
+    constexpr int32_t count = 1 << 19;
+    std::string bytes{"\x0a\x00\x00", 3};
+    bytes += std::string{"\x09\x00\x01" "l\x01\x00\x08\x00\x00", 9};
+    for (int32_t i = 0; i < count; i++) {
+      bytes += static_cast<char>(i);
+    }
+    bytes += std::string{"\x0b\x00\x01" "a\x00\x08\x00\x00", 8};
+    for (int32_t i = 0; i < count; i++) {
+      bytes += std::string{"\x00\x00", 2};
+      bytes += static_cast<char>(i >> 8);
+      bytes += static_cast<char>(i);
+    }
+    bytes += '\x00';
+    std::istringstream stream{bytes};
+    NBTReader reader{IStreamInput{stream}};
+    Document doc = readDocument(reader);
+    const Node& list = *doc.root().find("l");
+    REQUIRE(list.size() == count);
+    REQUIRE(list.at(0).value<ByteTag>() == 0);
+    REQUIRE(list.at(count - 1).value<ByteTag>() == -1);
+    ArrayRef<int32_t> values = doc.root().find("a")->value<IntArrayTag>();
+    REQUIRE(values.size() == count);
+    REQUIRE(values[1000] == 1000);
+    REQUIRE(values[count - 1] == 0xffff);
+  }
+}
+
+
+TEST_CASE("Arena allocation", "[document][arena]") {
+  Arena arena{128};
+  REQUIRE(arena.bytesUsed() == 0);
+
+  int64_t* longs = arena.allocate<int64_t>(4);
+  REQUIRE(reinterpret_cast<uintptr_t>(longs) % alignof(int64_t) == 0);
+  char* chars = arena.allocate<char>(3);
+  int32_t* ints = arena.allocate<int32_t>(1);
+  REQUIRE(reinterpret_cast<uintptr_t>(ints) % alignof(int32_t) == 0);
+  REQUIRE(chars + 3 <= reinterpret_cast<char*>(ints));
+
+  // Bigger than a block
+  char* big = arena.allocate<char>(1000);
+  std::fill(big, big + 1000, 'x');
+  REQUIRE(arena.bytesReserved() >= 1000 + 128);
+
+  std::string_view copy = arena.copy("hello");
+  REQUIRE(copy == "hello");
+
+  size_t reserved = arena.bytesReserved();
+  arena.reset();
+  REQUIRE(arena.bytesUsed() == 0);
+  arena.allocate<char>(1000);
+  arena.allocate<char>(100);
+  REQUIRE(arena.bytesReserved() == reserved);
+}
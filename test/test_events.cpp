@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <sstream>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_events.hpp"
+#include "test_util.hpp"
+
+
+/*
+ * Writes every event down as a line of text.
+ */
+class Recorder {
+  public:
+    void beginCompound(std::string_view name) {
+      add("{ " + std::string{name});
+    }
+
+    void endCompound() {
+      add("}");
+    }
+
+    void beginList(std::string_view name, TagID elementID, int32_t size) {
+      add("[ " + std::string{name} + " " +
+          std::to_string(static_cast<int>(elementID)) + " " + std::to_string(size));
+    }
+
+    void endList() {
+      add("]");
+    }
+
+    template <typename T>
+    void value(std::string_view name, T value) {
+      std::ostringstream out;
+      out << name << " = ";
+      if constexpr (sizeof(T) == 1) {
+        out << static_cast<int>(value);
+      }
+      else {
+        out << value;
+      }
+      add(out.str());
+    }
+
+    template <typename T>
+    void array(std::string_view name, ArrayRef<T> values) {
+      std::ostringstream out;
+      out << name << " =";
+      for (T v : values) {
+        out << " " << static_cast<int64_t>(v);
+      }
+      add(out.str());
+    }
+
+    std::vector<std::string> events;
+
+  private:
+    void add(std::string event) {
+      events.push_back(std::move(event));
+    }
+};
+
+/*
+ * Only counts ints, relying on NBTVisitor for the rest.
+ */
+struct IntCounter : NBTVisitor {
+  using NBTVisitor::value;
+
+  void value(std::string_view, int32_t) {
+    ints++;
+  }
+
+  int ints = 0;
+};
+
+
+TEST_CASE("Event parsing", "[events]") {
+  std::vector<std::string> expected{
+    "[ listof compound 10 2",
+    "{ ",
+    "string child = asdfsdfg",
+    "long array child = 283686952306183 579005069656919567",
+    "}",
+    "{ ",
+    "int child = 16909060",
+    "short child = 1286",
+    "short child2 = 1800",
+    "}",
+    "]",
+  };
+
+  SECTION("From a buffer") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    Recorder recorder;
+    parseEvents(reader, recorder);
+    REQUIRE(recorder.events == expected);
+    REQUIRE(reader.position() == bytes.size());
+  }
+  SECTION("From a stream") {
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    Recorder recorder;
+    parseEvents(file, recorder);
+    REQUIRE(recorder.events == expected);
+  }
+  SECTION("Scalars, strings and arrays") {
+    EventParser parser;
+    Recorder recorder;
+    for (const char* name : {"byte_tag", "double_tag", "string_tag", "int_array_tag"}) {
+      NBTFile file{std::string{"./test/data/"} + name + ".dat"};
+      parser.parse(file, recorder);
+    }
+    std::vector<char> bytes = slurp("./test/data/int_array_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    parser.parse(reader, recorder);
+    REQUIRE(recorder.events.size() == 5);
+    REQUIRE(recorder.events[0] == "byte tag = 64");
+    REQUIRE(recorder.events[3] == "int array tag = 287454020 573785173 860116326 1146447479");
+    REQUIRE(recorder.events[1] == "double tag = 64");
+    REQUIRE(recorder.events[2] == "string tag = The quick brown fox jumped over the lazy dog");
+    REQUIRE(recorder.events[3] == recorder.events[4]);
+  }
+  SECTION("Default handlers") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    IntCounter counter;
+    parseEvents(reader, counter);
+    REQUIRE(counter.ints == 1);
+  }
+  SECTION("Truncated input") {
+    NBTFile file{"./test/data/ends_unexpectedly_list.dat"};
+    Recorder recorder;
+    REQUIRE_THROWS_AS(parseEvents(file, recorder), NBTException);
+  }
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_inflate.hpp"
+#include "test_util.hpp"
+
+
+/*
+ * Writes bytes to a temporary file and returns its descriptor, positioned at
+ * the start.
+ */
+static int temporaryFile(const std::vector<char>& bytes) {
+  FILE* file = tmpfile();
+  REQUIRE(file != nullptr);
+  int fd = dup(fileno(file));
+  fclose(file);
+  REQUIRE(write(fd, bytes.data(), bytes.size()) == static_cast<ssize_t>(bytes.size()));
+  REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+  return fd;
+}
+
+/*
+ * A big compound, so that it spans many output windows:
+ * {"longs": [200000 longs], "after": 7}
+ */
+static std::vector<char> makeLarge() {
+  std::vector<char> bytes{0x0a, 0x00, 0x00, 0x0c, 0x00, 0x05, 'l', 'o', 'n', 'g', 's'};
+  int32_t count = 200000;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    bytes.push_back(static_cast<char>(count >> shift));
+  }
+  for (int32_t i = 0; i < count; i++) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      bytes.push_back(static_cast<char>((static_cast<int64_t>(i) * 12345) >> shift));
+    }
+  }
+  std::vector<char> tail{0x03, 0x00, 0x05, 'a', 'f', 't', 'e', 'r', 0, 0, 0, 7, 0x00};
+  bytes.insert(bytes.end(), tail.begin(), tail.end());
+  return bytes;
+}
+
+static void checkLarge(CompoundTag& root) {
+  std::vector<int64_t>& longs = root.get<LongArrayTag>("longs")->value();
+  REQUIRE(longs.size() == 200000);
+  REQUIRE(longs[0] == 0);
+  REQUIRE(longs[199999] == 199999ll * 12345);
+  REQUIRE(root.get<IntTag>("after")->value() == 7);
+}
+
+
+TEST_CASE("Decompressing input", "[inflate]") {
+  std::vector<char> raw = slurp("./test/data/list_compound_tag.dat");
+
+  SECTION("gzip, zlib and raw buffers") {
+    for (int windowBits : {31, 15, 0}) {
+      INFO(windowBits);
+      std::vector<char> bytes = windowBits ? deflateBytes(raw, windowBits) : raw;
+      NBTReader reader{InflateInput{bytes.data(), bytes.size()}};
+      REQUIRE(reader.readID() == TagID::LIST);
+      ListTag<CompoundTag> list = reader.readTagList<CompoundTag>();
+      REQUIRE(list.name() == "listof compound");
+      REQUIRE(list.value().size() == 2);
+      REQUIRE(list.at(1).get<IntTag>("int child")->value() == 0x01020304);
+      REQUIRE_THROWS(reader.readID());
+    }
+  }
+  SECTION("Large data from a file descriptor") {
+    std::vector<char> large = makeLarge();
+    std::vector<char> gzip = deflateBytes(large, 31);
+    REQUIRE(gzip.size() < large.size());
+    int fd = temporaryFile(gzip);
+    InflateInput input{fd};
+    REQUIRE(!input.compressed());
+    NBTReader reader{std::move(input)};
+    REQUIRE(reader.readID() == TagID::COMPOUND);
+    CompoundTag root = reader.readCompoundTag();
+    checkLarge(root);
+    close(fd);
+  }
+  SECTION("gzip from a pipe, a byte at a time at first") {
+    std::vector<char> gzip = deflateBytes(raw, 31);
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    // The first read sees just the first byte of the magic.
+    REQUIRE(write(fds[1], gzip.data(), 1) == 1);
+    std::thread writer{[&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      ssize_t written = write(fds[1], gzip.data() + 1, gzip.size() - 1);
+      (void)written;
+      close(fds[1]);
+    }};
+    InflateInput input{fds[0]};
+    NBTReader reader{std::move(input)};
+    REQUIRE(reader.readID() == TagID::LIST);
+    ListTag<CompoundTag> list = reader.readTagList<CompoundTag>();
+    REQUIRE(list.name() == "listof compound");
+    writer.join();
+    close(fds[0]);
+  }
+  SECTION("Empty input") {
+    InflateInput input{raw.data(), 0};
+    char byte;
+    REQUIRE(!input.read(&byte, 1));
+    REQUIRE(!input.compressed());
+    REQUIRE(input.position() == 0);
+  }
+  SECTION("Skipping and positions") {
+    std::vector<char> large = makeLarge();
+    std::vector<char> zlib = deflateBytes(large, 15);
+    InflateInput input{zlib.data(), zlib.size()};
+    char header[3];
+    REQUIRE(input.read(header, sizeof(header)));
+    REQUIRE(input.compressed());
+    REQUIRE(input.skip(large.size() - 4));
+    REQUIRE(input.position() == large.size() - 1);
+    char end;
+    REQUIRE(input.read(&end, 1));
+    REQUIRE(end == 0);
+    REQUIRE(!input.read(&end, 1));
+  }
+  SECTION("Concatenated gzip members") {
+    std::vector<char> first = slurp("./test/data/int_tag.dat");
+    std::vector<char> second = slurp("./test/data/string_tag.dat");
+    std::vector<char> gzip = deflateBytes(first, 31);
+    std::vector<char> more = deflateBytes(second, 31);
+    gzip.insert(gzip.end(), more.begin(), more.end());
+    NBTReader reader{InflateInput{gzip.data(), gzip.size()}};
+    REQUIRE(reader.readID() == TagID::INT);
+    REQUIRE(reader.readTag<IntTag>().name() == "int tag");
+    REQUIRE(reader.readID() == TagID::STRING);
+    REQUIRE(reader.readTag<StringTag>().value() ==
+            "The quick brown fox jumped over the lazy dog");
+  }
+  SECTION("Truncated and corrupt data") {
+    std::vector<char> gzip = deflateBytes(raw, 31);
+    {
+      NBTReader reader{InflateInput{gzip.data(), gzip.size() / 2}};
+      REQUIRE_THROWS_AS(reader.readID() == TagID::LIST &&
+                        reader.readTagList<CompoundTag>().size() == 2, NBTException);
+    }
+    {
+      std::vector<char> corrupt = gzip;
+      for (size_t i = 12; i < corrupt.size(); i++) {
+        corrupt[i] = static_cast<char>(0xff);
+      }
+      NBTReader reader{InflateInput{corrupt.data(), corrupt.size()}};
+      REQUIRE_THROWS_AS(reader.readID() == TagID::LIST &&
+                        reader.readTagList<CompoundTag>().size() == 2, NBTException);
+    }
+  }
+  SECTION("Size limit") {
+    std::vector<char> large = makeLarge();
+    std::vector<char> zlib = deflateBytes(large, 15);
+    {
+      InflateInput input{zlib.data(), zlib.size()};
+      REQUIRE(input.maxSize() == InflateInput::DEFAULT_MAX_SIZE);
+      input.setMaxSize(large.size());
+      REQUIRE(input.skip(large.size()));
+    }
+    {
+      InflateInput input{zlib.data(), zlib.size()};
+      input.setMaxSize(large.size() - 1);
+      REQUIRE_THROWS_AS(input.skip(large.size()), NBTException);
+    }
+    {
+      // Only inflated data counts
+      InflateInput input{large.data(), large.size()};
+      input.setMaxSize(1);
+      REQUIRE(input.skip(large.size()));
+    }
+  }
+  SECTION("Compressed files") {
+    std::vector<char> large = makeLarge();
+    char path[] = "/tmp/nbt_inflate_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    std::vector<char> gzip = deflateBytes(large, 31);
+    REQUIRE(write(fd, gzip.data(), gzip.size()) == static_cast<ssize_t>(gzip.size()));
+    close(fd);
+    {
+      CompressedNBTFile file{path};
+      REQUIRE(file.readID() == TagID::COMPOUND);
+      CompoundTag root = file.readCompoundTag();
+      checkLarge(root);
+    }
+    unlink(path);
+    REQUIRE_THROWS_AS(CompressedNBTFile{path}, NBTException);
+  }
+}
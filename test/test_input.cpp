@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <span>
+#include <sstream>
+
+#include "catch2/catch.hpp"
+
+#include "nbt.hpp"
+#include "test_util.hpp"
+
+
+/*
+ * The same checks against list_compound_tag.dat, whatever the input.
+ */
+template <typename Input>
+static void checkListCompound(NBTReader<Input>& reader) {
+  REQUIRE(reader.readID() == TagID::LIST);
+  ListTag<CompoundTag> tag = reader.template readTagList<CompoundTag>();
+  REQUIRE(tag.name() == "listof compound");
+  REQUIRE(tag.size() == 2);
+
+  std::shared_ptr<LongArrayTag> pLongArray =
+    std::dynamic_pointer_cast<LongArrayTag>(tag.at(0).at(1));
+  REQUIRE(pLongArray->name() == "long array child");
+  REQUIRE(pLongArray->at(1) == 0x08090a0b0c0d0e0f);
+
+  std::shared_ptr<ShortTag> pShort =
+    std::dynamic_pointer_cast<ShortTag>(tag.at(1).at(2));
+  REQUIRE(pShort->name() == "short child2");
+  REQUIRE(pShort->value() == 0x0708);
+}
+
+
+TEST_CASE("Reading from in-memory inputs", "[input]") {
+  SECTION("BufferInput") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    NBTReader<BufferInput> reader{BufferInput{bytes.data(), bytes.size()}};
+    checkListCompound(reader);
+  }
+  SECTION("BufferInput from a vector") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    checkListCompound(reader);
+  }
+  SECTION("BufferInput from a span") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    NBTReader reader{BufferInput{std::as_bytes(std::span{bytes})}};
+    checkListCompound(reader);
+  }
+  SECTION("BufferInput reports truncation") {
+    std::vector<char> bytes = slurp("./test/data/ends_unexpectedly_list.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::LIST);
+    std::string name = reader.readName();
+    TagID childID = reader.readID();
+    REQUIRE(childID == TagID::INT);
+    REQUIRE_THROWS(reader.readTagList<IntTag>(childID, name));
+  }
+  SECTION("IStreamInput") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    std::istringstream stream{std::string{bytes.data(), bytes.size()}};
+    NBTReader reader{IStreamInput{stream}};
+    checkListCompound(reader);
+  }
+  SECTION("FdInput") {
+    int fd = open("./test/data/list_compound_tag.dat", O_RDONLY);
+    REQUIRE(fd >= 0);
+    NBTReader reader{FdInput{fd}};
+    checkListCompound(reader);
+    close(fd);
+  }
+  SECTION("FdInput from a pipe") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    REQUIRE(write(fds[1], bytes.data(), bytes.size()) ==
+            static_cast<ssize_t>(bytes.size()));
+    close(fds[1]);
+    NBTReader reader{FdInput{fds[0]}};
+    checkListCompound(reader);
+    close(fds[0]);
+  }
+  SECTION("FdInput reports truncation") {
+    int fd = open("./test/data/ends_unexpectedly_compound.dat", O_RDONLY);
+    REQUIRE(fd >= 0);
+    NBTReader reader{FdInput{fd}};
+    REQUIRE(reader.readID() == TagID::COMPOUND);
+    REQUIRE_THROWS(reader.readCompoundTag(""));
+    close(fd);
+  }
+}
+
+
+TEST_CASE("Zero-copy views", "[input][view]") {
+  auto inside = [](const std::vector<char>& bytes, const char* p) {
+    return p >= bytes.data() && p < bytes.data() + bytes.size();
+  };
+
+  REQUIRE(is_contiguous_input<BufferInput>::value);
+  REQUIRE(is_contiguous_input<MappedInput>::value);
+  REQUIRE_FALSE(is_contiguous_input<FdInput>::value);
+  REQUIRE_FALSE(is_contiguous_input<IStreamInput>::value);
+
+  SECTION("StringTag") {
+    std::vector<char> bytes = slurp("./test/data/string_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::STRING);
+    TagView<StringTag> tag = reader.readTagView<StringTag>();
+    REQUIRE(tag.id() == TagID::STRING);
+    REQUIRE(tag.name() == "string tag");
+    REQUIRE(tag.value() == "The quick brown fox jumped over the lazy dog");
+    REQUIRE(inside(bytes, tag.name().data()));
+    REQUIRE(inside(bytes, tag.value().data()));
+
+    StringTag copy = tag.toTag();
+    REQUIRE(copy.name() == "string tag");
+    REQUIRE(copy.value() == tag.value());
+  }
+  SECTION("ByteArrayTag") {
+    std::vector<char> bytes = slurp("./test/data/byte_array_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::BYTE_ARRAY);
+    TagView<ByteArrayTag> tag = reader.readTagView<ByteArrayTag>();
+    REQUIRE(tag.name() == "byte array tag");
+    REQUIRE(inside(bytes, tag.value().data()));
+    std::vector<int8_t> expected{0x12, 0x23, 0x34, 0x45};
+    REQUIRE(tag.value().toVector() == expected);
+    REQUIRE(tag.value()[3] == 0x45);
+  }
+  SECTION("LongArrayTag") {
+    std::vector<char> bytes = slurp("./test/data/long_array_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::LONG_ARRAY);
+    TagView<LongArrayTag> tag = reader.readTagView<LongArrayTag>();
+    REQUIRE(tag.name() == "long array tag");
+    REQUIRE(tag.value().size() == 4);
+    REQUIRE(tag.value()[0] == 0x1122334455667708);
+    REQUIRE(tag.value().at(3) == 0x445566778899aa0b);
+    REQUIRE_THROWS(tag.value().at(4));
+    std::vector<int64_t> expected{
+      0x1122334455667708, 0x2233445566778809,
+      0x334455667788990a, 0x445566778899aa0b
+    };
+    REQUIRE(tag.toTag().value() == expected);
+  }
+  SECTION("Numbers") {
+    std::vector<char> bytes = slurp("./test/data/double_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::DOUBLE);
+    TagView<DoubleTag> tag = reader.readTagView<DoubleTag>();
+    REQUIRE(tag.name() == "double tag");
+    REQUIRE(tag.value() == 64.0);
+  }
+  SECTION("Memory-mapped") {
+    MappedNBTFile file{"./test/data/string_tag.dat"};
+    REQUIRE(file.readID() == TagID::STRING);
+    TagView<StringTag> tag = file.readTagView<StringTag>();
+    REQUIRE(tag.name() == "string tag");
+    REQUIRE(tag.value() == "The quick brown fox jumped over the lazy dog");
+  }
+  SECTION("Truncated input") {
+    std::vector<char> bytes = slurp("./test/data/ends_unexpectedly_long_array.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::LONG_ARRAY);
+    REQUIRE_THROWS(reader.readTagView<LongArrayTag>());
+  }
+}
+
+
+/*
+ * An input with only read(), so skipping has to go through a scratch buffer.
+ */
+class ReadOnlyInput {
+  public:
+    explicit ReadOnlyInput(const std::vector<char>& bytes) :
+      mBuffer{bytes}
+    { }
+
+    bool read(void* dst, size_t n) {
+      return mBuffer.read(dst, n);
+    }
+
+  private:
+    BufferInput mBuffer;
+};
+
+/*
+ * Skips the tag in reader and checks that exactly size bytes were consumed.
+ */
+template <typename Input>
+static void checkSkip(NBTReader<Input>& reader, size_t size) {
+  TagID id = reader.readID();
+  REQUIRE(reader.skipTag(id) == size - 1);
+  REQUIRE_THROWS(reader.readID());
+}
+
+
+TEST_CASE("Skipping tags", "[input][skip]") {
+  REQUIRE(has_skip<BufferInput>::value);
+  REQUIRE(has_skip<FdInput>::value);
+  REQUIRE_FALSE(has_skip<ReadOnlyInput>::value);
+
+  SECTION("Every tag type") {
+    // compound_tag.dat is left out because it has no root name.
+    for (const char* filename : {
+        "byte_tag", "short_tag", "int_tag", "long_tag", "float_tag",
+        "double_tag", "string_tag", "byte_array_tag", "int_array_tag",
+        "long_array_tag", "list_byte_tag", "list_string_tag",
+        "list_compound_tag"}) {
+      std::string path = std::string{"./test/data/"} + filename + ".dat";
+      INFO(path);
+      std::vector<char> bytes = slurp(path);
+      {
+        NBTReader reader{BufferInput{bytes}};
+        checkSkip(reader, bytes.size());
+      }
+      {
+        NBTReader reader{ReadOnlyInput{bytes}};
+        checkSkip(reader, bytes.size());
+      }
+      {
+        NBTFile file{path};
+        checkSkip(file, bytes.size());
+      }
+      {
+        int fd = open(path.c_str(), O_RDONLY);
+        REQUIRE(fd >= 0);
+        NBTReader reader{FdInput{fd}};
+        checkSkip(reader, bytes.size());
+        close(fd);
+      }
+    }
+  }
+  SECTION("Payloads") {
+    // compound_tag.dat leaves out the root's name
+    std::vector<char> bytes = slurp("./test/data/compound_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::COMPOUND);
+    REQUIRE(reader.skipPayload(TagID::COMPOUND) == bytes.size() - 1);
+    REQUIRE(reader.position() == bytes.size());
+    REQUIRE(reader.skipTag(TagID::END) == 0);
+  }
+  SECTION("Lists of ends") {
+    // Ends have no payload, so a huge size costs nothing to skip.
+    std::vector<char> bytes{0x00, 0x7f, char(0xff), char(0xff), char(0xff), 0x01};
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.skipPayload(TagID::LIST) == 5);
+    REQUIRE(reader.readID() == TagID::BYTE);
+  }
+  SECTION("Skipped tags are stepped over") {
+    std::vector<char> bytes = slurp("./test/data/long_array_tag.dat");
+    std::vector<char> twice = slurp("./test/data/int_tag.dat");
+    twice.insert(twice.begin(), bytes.begin(), bytes.end());
+    std::istringstream stream{std::string{twice.data(), twice.size()}};
+    NBTReader reader{IStreamInput{stream}};
+    REQUIRE(reader.skipTag(reader.readID()) == bytes.size() - 1);
+    REQUIRE(reader.readID() == TagID::INT);
+    REQUIRE(reader.readTag<IntTag>().name() == "int tag");
+  }
+  SECTION("FdInput from a pipe") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    REQUIRE(write(fds[1], bytes.data(), bytes.size()) ==
+            static_cast<ssize_t>(bytes.size()));
+    close(fds[1]);
+    NBTReader reader{FdInput{fds[0]}};
+    checkSkip(reader, bytes.size());
+    close(fds[0]);
+  }
+  SECTION("Truncated input") {
+    for (const char* filename : {
+        "ends_unexpectedly_compound", "ends_unexpectedly_int",
+        "ends_unexpectedly_list", "ends_unexpectedly_long_array",
+        "ends_unexpectedly_name"}) {
+      std::string path = std::string{"./test/data/"} + filename + ".dat";
+      INFO(path);
+      std::vector<char> bytes = slurp(path);
+      {
+        NBTReader reader{BufferInput{bytes}};
+        REQUIRE_THROWS_AS(reader.skipTag(reader.readID()), NBTException);
+      }
+      {
+        int fd = open(path.c_str(), O_RDONLY);
+        REQUIRE(fd >= 0);
+        NBTReader reader{FdInput{fd}};
+        REQUIRE_THROWS_AS(reader.skipTag(reader.readID()), NBTException);
+        close(fd);
+      }
+    }
+  }
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_lazy.hpp"
+#include "nbt_writer.hpp"
+#include "test_util.hpp"
+
+
+static std::vector<char> output(const NBTWriter& writer) {
+  std::vector<char> bytes;
+  for (const struct iovec& segment : writer.segments()) {
+    const char* base = static_cast<const char*>(segment.iov_base);
+    bytes.insert(bytes.end(), base, base + segment.iov_len);
+  }
+  return bytes;
+}
+
+
+TEST_CASE("Lazily decoded compounds", "[lazy]") {
+  // compound_tag.dat leaves out the root's (empty) name
+  std::vector<char> compound = slurp("./test/data/compound_tag.dat");
+
+  SECTION("Children are decoded on access") {
+    std::vector<char> bytes = compound;
+    bytes.insert(bytes.begin() + 1, 2, '\0');
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::COMPOUND);
+    LazyCompound root = readLazyCompound(reader);
+    REQUIRE(reader.position() == bytes.size());
+
+    REQUIRE(root.name() == "");
+    REQUIRE(root.size() == 4);
+    REQUIRE(root.id(0) == TagID::STRING);
+    REQUIRE(root.id(2) == TagID::INT_ARRAY);
+    REQUIRE(root.name(3) == "list child");
+    // Element ID, size and two doubles
+    REQUIRE(root.payloadSize(3) == 1 + 4 + 2 * 8);
+    for (size_t i = 0; i < root.size(); i++) {
+      REQUIRE(!root.decoded(i));
+    }
+
+    std::shared_ptr<LongTag> longTag = root.get<LongTag>(root.name(1));
+    REQUIRE(longTag != nullptr);
+    REQUIRE(longTag->value() == 0x7766554433221100);
+    REQUIRE(root.decoded(1));
+    REQUIRE(!root.decoded(0));
+    REQUIRE(root.get<LongTag>(root.name(1)) == longTag);
+
+    std::shared_ptr<ListTag<DoubleTag>> list = root.get<ListTag<DoubleTag>>("list child");
+    REQUIRE(list != nullptr);
+    REQUIRE(list->name() == "list child");
+    REQUIRE(list->value() == std::vector<double>{21.33, 13.37});
+
+    REQUIRE(root.get<IntTag>(root.name(0)) == nullptr);
+    REQUIRE(root.get<ListTag<IntTag>>("list child") == nullptr);
+    REQUIRE(root.find("missing") == nullptr);
+    REQUIRE(root.compound("list child") == nullptr);
+    REQUIRE(!root.decoded(0));
+  }
+  SECTION("Nested compounds are scanned on access") {
+    // {"inner": <compound_tag.dat>, "x": 42}
+    std::vector<char> bytes{0x0a, 0x00, 0x00, 0x0a, 0x00, 0x05, 'i', 'n', 'n', 'e', 'r'};
+    bytes.insert(bytes.end(), compound.begin() + 1, compound.end());
+    std::vector<char> tail{0x03, 0x00, 0x01, 'x', 0x00, 0x00, 0x00, 0x2a, 0x00};
+    bytes.insert(bytes.end(), tail.begin(), tail.end());
+    NBTReader reader{BufferInput{bytes}};
+    reader.readID();
+    LazyCompound root = readLazyCompound(reader);
+    REQUIRE(root.size() == 2);
+    REQUIRE(root.get<IntTag>("x")->value() == 42);
+    REQUIRE(!root.decoded(0));
+
+    const LazyCompound* inner = root.compound("inner");
+    REQUIRE(inner != nullptr);
+    REQUIRE(inner->name() == "inner");
+    REQUIRE(inner->size() == 4);
+    REQUIRE(root.compound("inner") == inner);
+    REQUIRE(inner->get<StringTag>(inner->name(0))->value() == "Hello world");
+    REQUIRE(!root.decoded(0));
+
+    std::shared_ptr<CompoundTag> decoded = root.get<CompoundTag>("inner");
+    REQUIRE(decoded != nullptr);
+    REQUIRE(decoded->size() == 4);
+  }
+  SECTION("Truncated input") {
+    NBTReader reader{BufferInput{compound.data(), compound.size() - 3}};
+    reader.readID();
+    REQUIRE_THROWS_AS(LazyCompound{}.read(reader), NBTException);
+  }
+}
+
+TEST_CASE("Editing lazy compounds", "[lazy]") {
+  // {"inner": <compound_tag.dat>, "x": 42}
+  std::vector<char> compound = slurp("./test/data/compound_tag.dat");
+  std::vector<char> bytes{0x0a, 0x00, 0x00, 0x0a, 0x00, 0x05, 'i', 'n', 'n', 'e', 'r'};
+  bytes.insert(bytes.end(), compound.begin() + 1, compound.end());
+  std::vector<char> tail{0x03, 0x00, 0x01, 'x', 0x00, 0x00, 0x00, 0x2a, 0x00};
+  bytes.insert(bytes.end(), tail.begin(), tail.end());
+
+  NBTReader reader{BufferInput{bytes}};
+  reader.readID();
+  LazyCompound root = readLazyCompound(reader);
+
+  // The same document, fully decoded, to make the same changes to
+  NBTReader fullReader{BufferInput{bytes}};
+  fullReader.readID();
+  CompoundTag full = fullReader.readCompoundTag();
+  CompoundTag& fullInner = *full.get<CompoundTag>("inner");
+
+  NBTWriter writer;
+  NBTWriter expected;
+
+  SECTION("Unchanged compounds are copied verbatim") {
+    REQUIRE(root.compound("inner")->get<StringTag>(root.compound("inner")->name(0)) != nullptr);
+    REQUIRE(root.get<IntTag>("x") != nullptr);
+    REQUIRE(!root.modified());
+    root.write(writer);
+    REQUIRE(output(writer) == bytes);
+  }
+  SECTION("Nested edits re-encode only their path") {
+    LazyCompound* inner = root.editCompound("inner");
+    REQUIRE(inner != nullptr);
+    REQUIRE(root.editCompound("x") == nullptr);
+    std::string longName{inner->name(1)};
+    inner->edit<LongTag>(longName)->value() = 5;
+    REQUIRE(inner->dirty(1));
+    REQUIRE(!inner->dirty(0));
+    REQUIRE(!root.dirty(0));
+    REQUIRE(root.modified());
+    REQUIRE(!root.decoded(0));
+
+    fullInner.get<LongTag>(longName)->value() = 5;
+    root.write(writer);
+    expected.writeTag(full);
+    REQUIRE(output(writer) == output(expected));
+
+    // Decoding the parent picks up the change, and leaves the nested
+    // compound to edit.
+    REQUIRE(root.get<CompoundTag>("inner")->get<LongTag>(longName)->value() == 5);
+    REQUIRE(!root.dirty(0));
+    REQUIRE(root.editCompound("inner") == inner);
+    writer.clear();
+    root.write(writer);
+    REQUIRE(output(writer) == output(expected));
+
+    // Editing it as a tag takes the nested changes along.
+    root.edit<CompoundTag>("inner")->get<LongTag>(longName)->value()++;
+    REQUIRE(root.dirty(0));
+    REQUIRE_THROWS_AS(root.compound("inner"), NBTException);
+    fullInner.get<LongTag>(longName)->value()++;
+    writer.clear();
+    expected.clear();
+    root.write(writer);
+    expected.writeTag(full);
+    REQUIRE(output(writer) == output(expected));
+  }
+  SECTION("Reading doesn't invalidate compounds being edited") {
+    LazyCompound* inner = root.editCompound("inner");
+    root.set(std::make_shared<IntTag>("y", 1));
+    std::shared_ptr<TagBase> snapshot = root.find("inner");
+    REQUIRE(snapshot != nullptr);
+    inner->set(std::make_shared<IntTag>("z", 2));
+    REQUIRE(root.get<CompoundTag>("inner")->get<IntTag>("z")->value() == 2);
+    REQUIRE(std::static_pointer_cast<CompoundTag>(snapshot)->get<IntTag>("z") == nullptr);
+
+    fullInner.push_back(IntTag{"z", 2});
+    full.push_back(IntTag{"y", 1});
+    root.write(writer);
+    expected.writeTag(full);
+    REQUIRE(output(writer) == output(expected));
+  }
+  SECTION("Children can be replaced, added and removed") {
+    root.set(std::make_shared<IntTag>("x", 7));
+    root.set(std::make_shared<StringTag>("new", "value"));
+    REQUIRE(root.size() == 3);
+    REQUIRE(root.dirty(1));
+    REQUIRE(root.get<IntTag>("x")->value() == 7);
+    REQUIRE(root.erase("inner"));
+    REQUIRE(!root.erase("inner"));
+    REQUIRE(root.edit<StringTag>("x") == nullptr);
+
+    CompoundTag changed{""};
+    changed.push_back(IntTag{"x", 7});
+    changed.push_back(StringTag{"new", "value"});
+    root.write(writer);
+    expected.writeTag(changed);
+    REQUIRE(output(writer) == output(expected));
+  }
+  SECTION("Large unchanged runs are referenced, not copied") {
+    root.edit<IntTag>("x")->value() = 43;
+    writer.setGatherThreshold(16);
+    root.write(writer);
+    std::vector<struct iovec> segments = writer.segments();
+    REQUIRE(std::any_of(segments.begin(), segments.end(), [&](const struct iovec& segment) {
+      return segment.iov_base == bytes.data() + 3;
+    }));
+
+    full.get<IntTag>("x")->value() = 43;
+    expected.writeTag(full);
+    REQUIRE(output(writer) == output(expected));
+  }
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_names.hpp"
+#include "test_util.hpp"
+
+
+
+TEST_CASE("Interning names", "[names]") {
+  SECTION("Equal names share storage") {
+    NameTable table;
+    std::string level{"Level"};
+    std::string_view interned = table.intern(level);
+    REQUIRE(interned == "Level");
+    REQUIRE(interned.data() != level.data());
+    REQUIRE(table.intern(std::string{"Level"}).data() == interned.data());
+    REQUIRE(NameTable::same(table.intern("Level"), interned));
+    REQUIRE(!NameTable::same(table.intern("Sections"), interned));
+    REQUIRE(table.find("Level").data() == interned.data());
+    REQUIRE(table.find("Palette").data() == nullptr);
+    REQUIRE(table.size() == 2);
+    REQUIRE(NameTable::same(table.intern(""), table.find("")));
+    REQUIRE(table.intern("").data() != nullptr);
+
+    // Another table has its own copies, however the thread caches them.
+    NameTable other;
+    REQUIRE(other.intern("Level").data() != interned.data());
+    REQUIRE(table.intern("Level").data() == interned.data());
+  }
+  SECTION("Sharing a table between threads") {
+    NameTable table;
+    std::vector<std::string> names;
+    for (int i = 0; i < 500; i++) {
+      names.push_back("name" + std::to_string(i));
+    }
+    std::vector<std::vector<std::string_view>> seen(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < seen.size(); t++) {
+      threads.emplace_back([&, t]() {
+        for (int round = 0; round < 3; round++) {
+          for (const std::string& name : names) {
+            seen[t].push_back(table.intern(name));
+          }
+        }
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    REQUIRE(table.size() == names.size());
+    for (size_t t = 0; t < seen.size(); t++) {
+      REQUIRE(seen[t].size() == 3 * names.size());
+      for (size_t i = 0; i < seen[t].size(); i++) {
+        REQUIRE(seen[t][i] == names[i % names.size()]);
+        REQUIRE(seen[t][i].data() == seen[0][i].data());
+      }
+    }
+  }
+  SECTION("Documents") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    auto table = std::make_shared<NameTable>();
+
+    Document first;
+    first.setNameTable(table);
+    NBTReader reader{BufferInput{bytes}};
+    first.read(reader, true);
+    // Names come from the table even when the rest is borrowed.
+    const Node& element = first.root().at(0);
+    std::string_view name = element.at(0).name();
+    REQUIRE(name == "string child");
+    REQUIRE(name.data() == table->find("string child").data());
+    REQUIRE(first.root().name().data() == table->find("listof compound").data());
+
+    Document second;
+    second.setNameTable(table);
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    second.read(file);
+    REQUIRE(second.root().at(0).at(0).name().data() == name.data());
+    REQUIRE(second.root().at(1).findInterned(table->intern("short child2"))
+            ->value<ShortTag>() == 0x0708);
+    REQUIRE(second.root().at(1).findInterned(std::string{"short child2"}) == nullptr);
+    REQUIRE(second.root().at(1).findInterned(table->intern("missing")) == nullptr);
+
+    Document plain;
+    NBTReader plainReader{BufferInput{bytes}};
+    plain.read(plainReader);
+    REQUIRE(plain.root().at(0).at(0).name() == "string child");
+    REQUIRE(plain.root().at(0).at(0).name().data() != name.data());
+    REQUIRE(plain.arena().bytesUsed() > second.arena().bytesUsed());
+  }
+}
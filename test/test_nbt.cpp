@@ -124,6 +124,16 @@ TEST_CASE("Reading from test files", "[nbtfile]") {
       std::string expected{"The quick brown fox jumped over the lazy dog"};
       REQUIRE(tag.value() == expected);
     }
+    SECTION("Strings longer than 32767 bytes") {
+      // The length is an unsigned short, so 40000 has its top bit set.
+      std::vector<uint8_t> bytes{0x0a, 0x00, 0x00, 0x08, 0x00, 0x01, 's', 0x9c, 0x40};
+      bytes.resize(bytes.size() + 40000, 'x');
+      bytes.push_back(0x00);
+      NBTReader reader{BufferInput{bytes}};
+      REQUIRE(reader.readID() == TagID::COMPOUND);
+      CompoundTag root = reader.readCompoundTag();
+      REQUIRE(root.get<StringTag>("s")->value() == std::string(40000, 'x'));
+    }
     SECTION("ListTag<ByteTag>") {
       NBTFile file{"./test/data/list_byte_tag.dat"};
       TagID id = file.readID();
@@ -187,6 +197,16 @@ TEST_CASE("Reading from test files", "[nbtfile]") {
         std::vector<int32_t> expected{0x33221100, 0x00112233};
         REQUIRE(child.value() == expected);
       }
+
+      { // ListTag<DoubleTag>
+        REQUIRE(tag.at(3)->id() == TagID::LIST);
+        std::shared_ptr<ListTag<DoubleTag>> child =
+          std::dynamic_pointer_cast<ListTag<DoubleTag>>(tag.at(3));
+        REQUIRE(child != nullptr);
+        REQUIRE(child->name() == "list child");
+        std::vector<double> expected{21.33, 13.37};
+        REQUIRE(child->value() == expected);
+      }
     }
     SECTION("ListTag") {
       /*
@@ -287,5 +307,218 @@ TEST_CASE("Reading from test files", "[nbtfile]") {
       REQUIRE(file.readID() == TagID::LONG_ARRAY);
       REQUIRE_THROWS(file.readName());
     }
+    SECTION("Tags nested too deeply") {
+      constexpr int maxDepth = NBTReader<BufferInput>::MAX_DEPTH;
+      // count compounds, each the only child of the one before
+      auto nested = [](int count) {
+        std::vector<uint8_t> bytes{0x0a, 0x00, 0x00};
+        for (int i = 1; i < count; i++) {
+          bytes.insert(bytes.end(), {0x0a, 0x00, 0x00});
+        }
+        bytes.insert(bytes.end(), count, 0x00);
+        return bytes;
+      };
+      {
+        std::vector<uint8_t> bytes = nested(maxDepth + 1);
+        NBTReader reader{BufferInput{bytes}};
+        REQUIRE(reader.readID() == TagID::COMPOUND);
+        REQUIRE_NOTHROW(reader.readCompoundTag());
+      }
+      {
+        std::vector<uint8_t> bytes = nested(maxDepth + 2);
+        NBTReader reader{BufferInput{bytes}};
+        REQUIRE(reader.readID() == TagID::COMPOUND);
+        REQUIRE_THROWS_AS(reader.readCompoundTag(), NBTException);
+      }
+      {
+        // Lists of one compound holding the next list
+        std::vector<uint8_t> bytes{0x09, 0x00, 0x00};
+        for (int i = 0; i < 100000; i++) {
+          bytes.insert(bytes.end(), {0x0a, 0x00, 0x00, 0x00, 0x01, 0x09, 0x00, 0x00});
+        }
+        NBTReader reader{BufferInput{bytes}};
+        REQUIRE(reader.readID() == TagID::LIST);
+        REQUIRE(reader.readName() == "");
+        REQUIRE_THROWS_AS(reader.readPayload(TagID::LIST, ""), NBTException);
+      }
+    }
+  }
+}
+
+TEST_CASE("Reading from memory-mapped test files", "[nbtfile][mmap]") {
+  SECTION("Primitive tags") {
+    MappedNBTFile file{"./test/data/long_tag.dat"};
+    REQUIRE(file.readID() == TagID::LONG);
+    LongTag tag = file.readTag<LongTag>();
+    REQUIRE(tag.name() == "long tag");
+    REQUIRE(tag.value() == 0x4000000030000000);
+  }
+  SECTION("LongArrayTag") {
+    MappedNBTFile file{"./test/data/long_array_tag.dat"};
+    REQUIRE(file.readID() == TagID::LONG_ARRAY);
+    LongArrayTag tag = file.readTag<LongArrayTag>();
+    REQUIRE(tag.name() == "long array tag");
+    std::vector<int64_t> expected{
+      0x1122334455667708, 0x2233445566778809,
+      0x334455667788990a, 0x445566778899aa0b
+    };
+    REQUIRE(tag.value() == expected);
+  }
+  SECTION("CompoundTag") {
+    MappedNBTFile file{"./test/data/compound_tag.dat"};
+    REQUIRE(file.readID() == TagID::COMPOUND);
+    CompoundTag tag{file.readCompoundTag("")};
+    REQUIRE(tag.size() == 4);
+    REQUIRE(tag.at(0)->id() == TagID::STRING);
+    REQUIRE(std::dynamic_pointer_cast<StringTag>(tag.at(0))->value() == "Hello world");
+    REQUIRE(tag.at(2)->id() == TagID::INT_ARRAY);
+    std::vector<int32_t> expected{0x33221100, 0x00112233};
+    REQUIRE(std::dynamic_pointer_cast<IntArrayTag>(tag.at(2))->value() == expected);
+  }
+  SECTION("ListTag<CompoundTag>") {
+    MappedNBTFile file{"./test/data/list_compound_tag.dat"};
+    REQUIRE(file.readID() == TagID::LIST);
+    ListTag<CompoundTag> tag = file.readTagList<CompoundTag>();
+    REQUIRE(tag.name() == "listof compound");
+    REQUIRE(tag.size() == 2);
+    std::shared_ptr<ShortTag> pShort =
+      std::dynamic_pointer_cast<ShortTag>(tag.at(1).at(2));
+    REQUIRE(pShort->name() == "short child2");
+    REQUIRE(pShort->value() == 0x0708);
+  }
+  SECTION("Error conditions") {
+    auto constructFile = []() {
+      MappedNBTFile file{"./file/doesnt/exist.dat"};
+    };
+    REQUIRE_THROWS(constructFile());
+    {
+      MappedNBTFile file{"./test/data/ends_unexpectedly_int.dat"};
+      REQUIRE(file.readID() == TagID::INT);
+      std::string name = file.readName();
+      REQUIRE(name == "bad int");
+      REQUIRE_THROWS(file.readTag<IntTag>(name));
+    }
+    {
+      MappedNBTFile file{"./test/data/ends_unexpectedly_compound.dat"};
+      REQUIRE(file.readID() == TagID::COMPOUND);
+      REQUIRE_THROWS(file.readCompoundTag(""));
+    }
+    {
+      MappedNBTFile file{"./test/data/ends_unexpectedly_name.dat"};
+      REQUIRE(file.readID() == TagID::INT_ARRAY);
+      REQUIRE_THROWS(file.readName());
+    }
+  }
+}
+
+TEST_CASE("Reading large arrays", "[nbtfile][array]") {
+  // LONG_ARRAY "big" with more elements than fit in one read step
+  const int32_t count = 300000;
+  std::vector<uint8_t> bytes{0x0c, 0x00, 0x03, 'b', 'i', 'g'};
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    bytes.push_back(static_cast<uint8_t>(count >> shift));
+  }
+  for (int32_t i = 0; i < count; i++) {
+    uint64_t value = static_cast<uint64_t>(i) << 32 | static_cast<uint32_t>(i);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      bytes.push_back(static_cast<uint8_t>(value >> shift));
+    }
+  }
+
+  SECTION("Whole array") {
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::LONG_ARRAY);
+    LongArrayTag tag = reader.readTag<LongArrayTag>();
+    REQUIRE(tag.name() == "big");
+    REQUIRE(tag.size() == static_cast<size_t>(count));
+    for (int32_t i = 0; i < count; i++) {
+      int64_t expected = static_cast<int64_t>(i) << 32 | static_cast<uint32_t>(i);
+      if (tag.at(i) != expected) {
+        FAIL("Mismatch at index " << i);
+      }
+    }
+  }
+  SECTION("Truncated array") {
+    bytes.resize(bytes.size() - 1);
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::LONG_ARRAY);
+    REQUIRE_THROWS(reader.readTag<LongArrayTag>());
+  }
+  SECTION("Negative size") {
+    std::vector<uint8_t> negative{0x0b, 0x00, 0x01, 'n', 0xff, 0xff, 0xff, 0xfe};
+    NBTReader reader{BufferInput{negative}};
+    REQUIRE(reader.readID() == TagID::INT_ARRAY);
+    REQUIRE_THROWS(reader.readTag<IntArrayTag>());
+  }
+  SECTION("Corrupt list sizes") {
+    REQUIRE_THROWS_AS((ListTag<StringTag>{"", -1}), NBTException);
+    REQUIRE_THROWS_AS((ListTag<CompoundTag>{"", TagID::COMPOUND, -1}), NBTException);
+
+    std::vector<uint8_t> negative{0x09, 0x00, 0x01, 'l', 0x08, 0xff, 0xff, 0xff, 0xfe};
+    NBTReader negativeReader{BufferInput{negative}};
+    REQUIRE(negativeReader.readID() == TagID::LIST);
+    REQUIRE_THROWS_AS(negativeReader.readTagList<StringTag>(), NBTException);
+
+    // Far more elements than there are bytes, which must not be reserved
+    // up front
+    std::vector<uint8_t> huge{0x09, 0x00, 0x01, 'l', 0x0a, 0x7f, 0xff, 0xff, 0xff, 0x00};
+    NBTReader hugeReader{BufferInput{huge}};
+    REQUIRE(hugeReader.readID() == TagID::LIST);
+    REQUIRE_THROWS_AS(hugeReader.readTagList<CompoundTag>(), NBTException);
+  }
+}
+
+TEST_CASE("Looking up compound children by name", "[compound]") {
+  SECTION("Small compound") {
+    NBTFile file{"./test/data/compound_tag.dat"};
+    REQUIRE(file.readID() == TagID::COMPOUND);
+    CompoundTag tag{file.readCompoundTag("")};
+
+    std::shared_ptr<TagBase> child = tag.find("long child");
+    REQUIRE(child != nullptr);
+    REQUIRE(child->name() == "long child");
+    REQUIRE(tag.get<LongTag>("long child")->value() == 0x7766554433221100);
+    REQUIRE(tag.get<StringTag>("string child")->value() == "Hello world");
+    REQUIRE(tag.get<ListTag<DoubleTag>>("list child")->size() == 2);
+
+    REQUIRE(tag.find("missing") == nullptr);
+    REQUIRE(tag.get<IntTag>("long child") == nullptr);
+    REQUIRE(tag.get<ListTag<IntTag>>("list child") == nullptr);
+  }
+  SECTION("Indexed compound") {
+    CompoundTag tag{"big"};
+    for (int i = 0; i < 100; i++) {
+      tag.push_back(IntTag{"int " + std::to_string(i), i});
+    }
+    tag.push_back(StringTag{"string", "value"});
+    // Duplicate names resolve to the first one
+    tag.push_back(IntTag{"int 5", -1});
+
+    for (int i = 0; i < 100; i++) {
+      std::shared_ptr<IntTag> child = tag.get<IntTag>("int " + std::to_string(i));
+      REQUIRE(child != nullptr);
+      REQUIRE(child->value() == i);
+    }
+    REQUIRE(tag.get<StringTag>("string")->value() == "value");
+    REQUIRE(tag.get<IntTag>("string") == nullptr);
+    REQUIRE(tag.find("int 100") == nullptr);
+    REQUIRE(tag.find("") == nullptr);
+  }
+  SECTION("Children added through value()") {
+    CompoundTag tag;
+    for (int i = 0; i < 10; i++) {
+      tag.push_back(ByteTag{"byte " + std::to_string(i), static_cast<int8_t>(i)});
+    }
+    tag.value().push_back(std::make_shared<ShortTag>("late", 7));
+    REQUIRE(tag.get<ShortTag>("late")->value() == 7);
+
+    tag.push_back(ShortTag{"later", 8});
+    REQUIRE(tag.get<ShortTag>("later")->value() == 8);
+    REQUIRE(tag.get<ByteTag>("byte 9")->value() == 9);
+
+    tag.value()[0] = std::make_shared<ShortTag>("replaced", 9);
+    tag.reindex();
+    REQUIRE(tag.find("byte 0") == nullptr);
+    REQUIRE(tag.get<ShortTag>("replaced")->value() == 9);
   }
 }
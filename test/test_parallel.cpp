@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_parallel.hpp"
+#include "nbt_writer.hpp"
+
+
+/*
+ * A list of count entity-like compounds, preceded by its ID and name:
+ * "Entities": [{"id": "minecraft:pig", "Pos": [x, y, z], "Health": i, ...}]
+ */
+static std::vector<char> makeEntities(int32_t count) {
+  NBTWriter writer;
+  writer.writeID(TagID::LIST);
+  writer.writeName("Entities");
+  writer.writeID(TagID::COMPOUND);
+  writer.writeNumber<int32_t>(count);
+  for (int32_t i = 0; i < count; i++) {
+    writer.writeString("id", i % 3 ? "minecraft:pig" : "minecraft:zombie_villager");
+    writer.beginList("Pos", TagID::DOUBLE, 3);
+    writer.writeDouble("", i * 0.5);
+    writer.writeDouble("", 64.0);
+    writer.writeDouble("", -i * 0.25);
+    writer.endList();
+    writer.writeFloat("Health", static_cast<float>(i % 20));
+    if (i % 7 == 0) {
+      writer.beginCompound("Brain");
+      writer.beginList("Memories", TagID::INT, 2);
+      writer.writeInt("", i);
+      writer.writeInt("", -i);
+      writer.endList();
+      writer.endCompound();
+    }
+    int64_t uuid[2] = {i * 1234567ll, ~static_cast<int64_t>(i)};
+    writer.writeLongArray("UUID", uuid, 2);
+    writer.writeID(TagID::END);
+  }
+  return std::vector<char>{writer.data(), writer.data() + writer.size()};
+}
+
+static std::vector<char> serialize(const ListTag<CompoundTag>& list) {
+  NBTWriter writer;
+  writer.writeTag(list);
+  return std::vector<char>{writer.data(), writer.data() + writer.size()};
+}
+
+
+TEST_CASE("Moving lists of compounds", "[parallel]") {
+  CompoundTag element{"element"};
+  element.push_back(IntTag{"value", 42});
+  ListTag<CompoundTag> list{"list", TagID::COMPOUND, 1};
+  list.push_back(std::move(element));
+  // Moved, not copied: the children were taken over.
+  REQUIRE(element.size() == 0);
+  REQUIRE(list.at(0).get<IntTag>("value")->value() == 42);
+
+  const TagBase* child = list.at(0).at(0).get();
+  ListTag<CompoundTag> moved{std::move(list)};
+  REQUIRE(moved.name() == "list");
+  REQUIRE(moved.size() == 1);
+  REQUIRE(moved.at(0).at(0).get() == child);
+  REQUIRE(serialize(moved).size() > 0);
+}
+
+TEST_CASE("Decoding lists of compounds in parallel", "[parallel]") {
+  WorkStealingPool pool{4};
+
+  for (int32_t count : {0, 1, 15, 1000}) {
+    INFO(count);
+    std::vector<char> bytes = makeEntities(count);
+    NBTReader serialReader{BufferInput{bytes}};
+    REQUIRE(serialReader.readID() == TagID::LIST);
+    ListTag<CompoundTag> serial = serialReader.readTagList<CompoundTag>();
+
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE(reader.readID() == TagID::LIST);
+    ListTag<CompoundTag> parallel = readCompoundListParallel(reader, pool);
+    REQUIRE(reader.position() == bytes.size());
+    REQUIRE(parallel.name() == "Entities");
+    REQUIRE(parallel.value().size() == static_cast<size_t>(count));
+    REQUIRE(serialize(parallel) == serialize(serial));
+  }
+
+  SECTION("From inside a task") {
+    std::vector<char> bytes = makeEntities(500);
+    std::atomic<int> ok{0};
+    for (int t = 0; t < 8; t++) {
+      pool.submit([&](unsigned) {
+        NBTReader reader{BufferInput{bytes}};
+        reader.readID();
+        ListTag<CompoundTag> list = readCompoundListParallel(reader, pool);
+        if (list.value().size() == 500 &&
+            list.at(499).get<FloatTag>("Health")->value() == 499 % 20) {
+          ok++;
+        }
+      });
+    }
+    pool.wait();
+    REQUIRE(ok == 8);
+  }
+  SECTION("Empty and mistyped lists") {
+    std::vector<char> empty{0x09, 0x00, 0x01, 'e', 0x00, 0x00, 0x00, 0x00, 0x00};
+    NBTReader reader{BufferInput{empty}};
+    REQUIRE(reader.readID() == TagID::LIST);
+    REQUIRE(readCompoundListParallel(reader, pool).value().empty());
+
+    std::vector<char> ints{0x09, 0x00, 0x01, 'i', 0x03, 0x00, 0x00, 0x00, 0x00};
+    NBTReader intReader{BufferInput{ints}};
+    REQUIRE(intReader.readID() == TagID::LIST);
+    REQUIRE_THROWS_AS(readCompoundListParallel(intReader, pool), NBTTagException);
+  }
+  SECTION("Truncated and corrupt lists") {
+    std::vector<char> bytes = makeEntities(100);
+    std::vector<char> truncated{bytes.begin(), bytes.begin() + bytes.size() / 2};
+    NBTReader reader{BufferInput{truncated}};
+    reader.readID();
+    REQUIRE_THROWS_AS(readCompoundListParallel(reader, pool), NBTException);
+
+    // A huge size is caught by the scan, before anything is allocated for it.
+    std::vector<char> huge = makeEntities(1);
+    huge[12] = 0x7f;
+    NBTReader hugeReader{BufferInput{huge}};
+    hugeReader.readID();
+    REQUIRE_THROWS_AS(readCompoundListParallel(hugeReader, pool), NBTException);
+
+    // Negative sizes are rejected, as by the serial reader.
+    std::vector<char> negative = makeEntities(1);
+    negative[12] = static_cast<char>(0xff);
+    NBTReader serialReader{BufferInput{negative}};
+    serialReader.readID();
+    REQUIRE_THROWS_AS(serialReader.readTagList<CompoundTag>(), NBTException);
+    NBTReader negativeReader{BufferInput{negative}};
+    negativeReader.readID();
+    REQUIRE_THROWS_AS(readCompoundListParallel(negativeReader, pool), NBTException);
+  }
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include "nbt_query.hpp"
+#include "test_util.hpp"
+
+
+
+
+TEST_CASE("Parsing paths", "[query]") {
+  std::vector<PathStep> steps = parsePath("Level.Sections[*].BlockStates");
+  REQUIRE(steps.size() == 4);
+  REQUIRE(steps[0] == PathStep{PathStep::NAME, "Level", 0});
+  REQUIRE(steps[1] == PathStep{PathStep::NAME, "Sections", 0});
+  REQUIRE(steps[2] == PathStep{PathStep::ALL, "", 0});
+  REQUIRE(steps[3] == PathStep{PathStep::NAME, "BlockStates", 0});
+
+  steps = parsePath("[1][20].list child");
+  REQUIRE(steps.size() == 3);
+  REQUIRE(steps[0] == PathStep{PathStep::INDEX, "", 1});
+  REQUIRE(steps[1] == PathStep{PathStep::INDEX, "", 20});
+  REQUIRE(steps[2] == PathStep{PathStep::NAME, "list child", 0});
+
+  for (const char* bad : {"", ".a", "a.", "a..b", "a.[0]", "a[", "a[]",
+                          "a[x]", "a[-1]", "a[99999999999]"}) {
+    INFO(bad);
+    REQUIRE_THROWS_AS(parsePath(bad), NBTException);
+  }
+
+  REQUIRE_THROWS_AS((Query{"a.b", "a"}), NBTException);
+  REQUIRE_THROWS_AS((Query{"a", "a.b"}), NBTException);
+  REQUIRE_THROWS_AS((Query{"a", "a"}), NBTException);
+  REQUIRE_THROWS_AS((Query{"a[*].b", "a[0].c"}), NBTException);
+  REQUIRE_NOTHROW(Query{"a[1].b", "a[0].c", "a.d"});
+}
+
+
+TEST_CASE("Streaming path queries", "[query]") {
+  SECTION("List of compounds") {
+    Query query{"[*].short child", "[*].long array child", "[*].int child"};
+    REQUIRE(query.size() == 3);
+    std::vector<std::pair<size_t, std::shared_ptr<TagBase>>> matches;
+    auto collect = [&](size_t path, std::shared_ptr<TagBase> tag) {
+      matches.emplace_back(path, std::move(tag));
+    };
+
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    REQUIRE(query.run(file, collect) == 3);
+    REQUIRE(matches.size() == 3);
+    REQUIRE(matches[0].first == 1);
+    auto longs = std::dynamic_pointer_cast<LongArrayTag>(matches[0].second);
+    REQUIRE(longs != nullptr);
+    REQUIRE(longs->name() == "long array child");
+    REQUIRE(longs->value() == std::vector<int64_t>{0x0001020304050607, 0x08090a0b0c0d0e0f});
+    REQUIRE(matches[1].first == 2);
+    REQUIRE(std::dynamic_pointer_cast<IntTag>(matches[1].second)->value() == 0x01020304);
+    REQUIRE(matches[2].first == 0);
+    REQUIRE(std::dynamic_pointer_cast<ShortTag>(matches[2].second)->value() == 0x0506);
+    REQUIRE_THROWS(file.readID());
+  }
+  SECTION("List elements") {
+    // compound_tag.dat leaves out the root's (empty) name
+    std::vector<char> bytes = slurp("./test/data/compound_tag.dat");
+    bytes.insert(bytes.begin() + 1, 2, '\0');
+    NBTReader reader{BufferInput{bytes}};
+    std::vector<double> values;
+    Query query{"list child[1]", "missing[0]", "string child.nothing"};
+    size_t count = query.run(reader, [&](size_t path, std::shared_ptr<TagBase> tag) {
+      REQUIRE(path == 0);
+      values.push_back(std::dynamic_pointer_cast<DoubleTag>(tag)->value());
+    });
+    REQUIRE(count == 1);
+    REQUIRE(values == std::vector<double>{13.37});
+    REQUIRE(reader.position() == bytes.size());
+  }
+  SECTION("Truncated input") {
+    Query query{"a"};
+    NBTFile file{"./test/data/ends_unexpectedly_compound.dat"};
+    REQUIRE_THROWS(query.run(file, [](size_t, std::shared_ptr<TagBase>) { }));
+  }
+}
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_region.hpp"
+#include "nbt_writer.hpp"
+#include "test_util.hpp"
+
+
+static void checkChunk(const CompoundTag& chunk, int x, int z, size_t count = 4) {
+  REQUIRE(chunk.get<IntTag>("xPos")->value() == x);
+  REQUIRE(chunk.get<IntTag>("zPos")->value() == z);
+  const std::vector<int64_t>& heights = chunk.get<LongArrayTag>("Heights")->value();
+  REQUIRE(heights.size() == count);
+  REQUIRE(heights.back() == static_cast<int64_t>(count - 1) * 0x0102030405ll);
+}
+
+
+TEST_CASE("Reading region files", "[region]") {
+  std::vector<char> region;
+  addChunk(region, 0, 0, RegionFile::ZLIB, deflateBytes(makeChunk(0, 0), 15), 1600000000);
+  addChunk(region, 31, 2, RegionFile::GZIP, deflateBytes(makeChunk(31, 2), 31), 1600000001);
+  addChunk(region, 5, 31, RegionFile::NONE, makeChunk(5, 31), 1600000002);
+  // Spans several sectors
+  addChunk(region, 7, 7, RegionFile::ZLIB, deflateBytes(makeChunk(7, 7, 5000), 15), 1600000003);
+
+  SECTION("Tables") {
+    RegionFile file{region.data(), region.size()};
+    REQUIRE(file.chunkCount() == 4);
+    REQUIRE(file.contains(0, 0));
+    REQUIRE(file.contains(31, 2));
+    REQUIRE(!file.contains(2, 31));
+    REQUIRE(file.timestamp(5, 31) == 1600000002);
+    REQUIRE(file.timestamp(1, 1) == 0);
+    // Absolute chunk coordinates wrap around
+    REQUIRE(file.contains(-1, 34));
+    REQUIRE(file.contains(32 * 5 + 7, -32 * 3 + 7));
+  }
+  SECTION("Chunks of every compression") {
+    RegionFile file{region.data(), region.size()};
+    checkChunk(file.readChunk(0, 0), 0, 0);
+    checkChunk(file.readChunk(31, 2), 31, 2);
+    checkChunk(file.readChunk(5, 31), 5, 31);
+    checkChunk(file.readChunk(7, 7), 7, 7, 5000);
+    checkChunk(file.readChunk(-25, 7), 7, 7, 5000);
+    REQUIRE_THROWS_AS(file.readChunk(1, 1), NBTException);
+  }
+  SECTION("Stored data and other parsers") {
+    RegionFile file{region.data(), region.size()};
+    RegionFile::ChunkData data = file.chunkData(5, 31);
+    REQUIRE(data.compression == RegionFile::NONE);
+    std::vector<char> raw = makeChunk(5, 31);
+    REQUIRE(std::vector<char>(data.data, data.data + data.size) == raw);
+
+    NBTReader reader = file.openChunk(31, 2);
+    REQUIRE(reader.readID() == TagID::COMPOUND);
+    REQUIRE(reader.readName() == "");
+    REQUIRE(reader.readID() == TagID::INT);
+    REQUIRE(reader.readTag<IntTag>().value() == 31);
+  }
+  SECTION("Corrupt tables and chunks") {
+    {
+      std::vector<char> bad = region;
+      // Past the end of the file
+      storeBigEndian(bad, RegionFile::index(0, 0) * 4, 1000 << 8 | 1);
+      // Inside the header
+      storeBigEndian(bad, RegionFile::index(31, 2) * 4, 1 << 8 | 1);
+      RegionFile file{bad.data(), bad.size()};
+      REQUIRE_THROWS_AS(file.readChunk(0, 0), NBTException);
+      REQUIRE_THROWS_AS(file.readChunk(31, 2), NBTException);
+      checkChunk(file.readChunk(5, 31), 5, 31);
+    }
+    {
+      std::vector<char> bad = region;
+      size_t begin = (loadBigEndian<uint32_t>(bad.data()) >> 8) * RegionFile::SECTOR_SIZE;
+      // A length running off the end of the file
+      storeBigEndian(bad, begin, 0x7fffffff);
+      RegionFile file{bad.data(), bad.size()};
+      REQUIRE_THROWS_AS(file.chunkData(0, 0), NBTException);
+    }
+    {
+      std::vector<char> bad = region;
+      size_t begin = (loadBigEndian<uint32_t>(bad.data()) >> 8) * RegionFile::SECTOR_SIZE;
+      bad[begin + 4] = 4;
+      RegionFile file{bad.data(), bad.size()};
+      REQUIRE_THROWS_AS(file.openChunk(0, 0), NBTException);
+      bad[begin + 4] = static_cast<char>(0x82);
+      REQUIRE_THROWS_AS(file.chunkData(0, 0), NBTException);
+    }
+    REQUIRE_THROWS_AS((RegionFile{region.data(), RegionFile::HEADER_SIZE - 1}), NBTException);
+    RegionFile empty{region.data(), 0};
+    REQUIRE(empty.chunkCount() == 0);
+  }
+  SECTION("Mapped files") {
+    char path[] = "/tmp/nbt_region_XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, region.data(), region.size()) == static_cast<ssize_t>(region.size()));
+    close(fd);
+    {
+      RegionFile file{path};
+      RegionFile moved{std::move(file)};
+      REQUIRE(moved.size() == region.size());
+      checkChunk(moved.readChunk(7, 7), 7, 7, 5000);
+    }
+    unlink(path);
+    REQUIRE_THROWS_AS(RegionFile{path}, NBTException);
+  }
+}
+
+static size_t fileSize(const std::string& path) {
+  struct stat st;
+  REQUIRE(stat(path.c_str(), &st) == 0);
+  return static_cast<size_t>(st.st_size);
+}
+
+/*
+ * Bytes that compress badly, so a chunk takes about their size on disk.
+ */
+static CompoundTag makeNoisyChunk(int x, int z, size_t size) {
+  CompoundTag chunk{""};
+  chunk.push_back(IntTag{"xPos", x});
+  chunk.push_back(IntTag{"zPos", z});
+  std::vector<int8_t> noise(size);
+  uint32_t state = 12345 + x * 31 + z;
+  for (int8_t& b : noise) {
+    state = state * 1103515245 + 12345;
+    b = static_cast<int8_t>(state >> 24);
+  }
+  chunk.push_back(ByteArrayTag{"Noise", noise});
+  return chunk;
+}
+
+
+TEST_CASE("Writing region files", "[region]") {
+  char path[] = "/tmp/nbt_region_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  close(fd);
+  std::string filename{path};
+
+  SECTION("New files, in-place updates and appends") {
+    // An empty file is an empty region.
+    RegionWriter writer{filename};
+    writer.setInPlace(true);
+    REQUIRE(writer.chunkCount() == 0);
+    REQUIRE(writer.sectorCount() == 2);
+    REQUIRE(fileSize(filename) == RegionFile::HEADER_SIZE);
+
+    writer.writeChunk(0, 0, makeNoisyChunk(0, 0, 100), 1600000000);
+    writer.writeChunk(1, 0, makeNoisyChunk(1, 0, 10000), 1600000001);
+    writer.writeChunk(2, 0, makeNoisyChunk(2, 0, 100));
+    REQUIRE(writer.chunkCount() == 3);
+    REQUIRE(writer.sectorCount() == 2 + 1 + 3 + 1);
+    REQUIRE(writer.freeSectors() == 0);
+    REQUIRE(fileSize(filename) == writer.sectorCount() * RegionFile::SECTOR_SIZE);
+    REQUIRE(writer.timestamp(2, 0) > 1600000001);
+
+    // Smaller: stays put and frees its tail
+    writer.writeChunk(1, 0, makeNoisyChunk(1, 0, 5000), 1600000002);
+    REQUIRE(writer.sectorCount() == 7);
+    REQUIRE(writer.freeSectors() == 1);
+    // Larger: goes to the end of the file
+    writer.writeChunk(0, 0, makeNoisyChunk(0, 0, 6000), 1600000003);
+    REQUIRE(writer.sectorCount() == 9);
+    REQUIRE(writer.freeSectors() == 2);
+    // Goes into the first free sector, the one chunk (0, 0) moved out of
+    writer.writeChunk(31, 31, makeNoisyChunk(31, 31, 100), 1600000004);
+    REQUIRE(writer.sectorCount() == 9);
+    REQUIRE(writer.freeSectors() == 1);
+
+    RegionFile region{filename};
+    REQUIRE(region.chunkCount() == 4);
+    REQUIRE(region.timestamp(1, 0) == 1600000002);
+    REQUIRE(region.readChunk(0, 0).get<ByteArrayTag>("Noise")->value().size() == 6000);
+    REQUIRE(region.readChunk(1, 0).get<ByteArrayTag>("Noise")->value().size() == 5000);
+    REQUIRE(region.readChunk(31, 31).get<ByteArrayTag>("Noise")->value() ==
+            makeNoisyChunk(31, 31, 100).get<ByteArrayTag>("Noise")->value());
+    REQUIRE(region.readChunk(2, 0).get<IntTag>("xPos")->value() == 2);
+  }
+  SECTION("Updates don't overwrite the old copy by default") {
+    RegionWriter writer{filename};
+    REQUIRE(!writer.inPlace());
+    writer.writeChunk(0, 0, makeNoisyChunk(0, 0, 10000), 1600000000);
+    REQUIRE(writer.sectorCount() == 2 + 3);
+    // Smaller, but still written to new sectors before the old ones are
+    // freed
+    writer.writeChunk(0, 0, makeNoisyChunk(0, 0, 5000), 1600000001);
+    REQUIRE(writer.sectorCount() == 2 + 3 + 2);
+    REQUIRE(writer.freeSectors() == 3);
+    // Which the next chunk can then use
+    writer.writeChunk(1, 0, makeNoisyChunk(1, 0, 100), 1600000002);
+    REQUIRE(writer.sectorCount() == 7);
+    REQUIRE(writer.freeSectors() == 2);
+
+    RegionFile region{filename};
+    REQUIRE(region.readChunk(0, 0).get<ByteArrayTag>("Noise")->value().size() == 5000);
+    REQUIRE(region.readChunk(1, 0).get<IntTag>("xPos")->value() == 1);
+  }
+  SECTION("Stored data, serialized chunks and removal") {
+    {
+      RegionWriter writer{filename};
+      std::vector<char> raw = makeChunk(4, 5);
+      writer.writeChunkData(4, 5, RegionFile::NONE, raw.data(), raw.size(), 7);
+      // Gathered arrays point into the chunk, so it has to outlive the
+      // write.
+      CompoundTag noisy = makeNoisyChunk(6, 7, 1000);
+      NBTWriter nbt;
+      nbt.setGatherThreshold(64);
+      nbt.writeTag(noisy);
+      writer.writeChunk(6, 7, nbt, 8);
+      writer.writeChunk(8, 9, makeNoisyChunk(8, 9, 10));
+      writer.removeChunk(8, 9);
+      writer.removeChunk(10, 10);
+      REQUIRE(!writer.contains(8, 9));
+      REQUIRE(writer.freeSectors() == 1);
+      REQUIRE_THROWS_AS(writer.writeChunk(0, 1, makeNoisyChunk(0, 1, 2 << 20)), NBTException);
+    }
+    // Reopening reads the tables back.
+    RegionWriter writer{filename};
+    REQUIRE(writer.chunkCount() == 2);
+    REQUIRE(writer.timestamp(4, 5) == 7);
+    REQUIRE(writer.freeSectors() == 1);
+
+    RegionFile region{filename};
+    REQUIRE(region.chunkData(4, 5).compression == RegionFile::NONE);
+    checkChunk(region.readChunk(4, 5), 4, 5);
+    REQUIRE(region.readChunk(6, 7).get<ByteArrayTag>("Noise")->value().size() == 1000);
+    REQUIRE(!region.contains(8, 9));
+  }
+  SECTION("Compaction") {
+    RegionWriter writer{filename};
+    for (int i = 0; i < 20; i++) {
+      writer.writeChunk(i, 0, makeNoisyChunk(i, 0, 3000 + i * 500), 100 + i);
+    }
+    for (int i = 0; i < 20; i += 2) {
+      writer.writeChunk(i, 0, makeNoisyChunk(i, 0, 100), 200 + i);
+    }
+    writer.removeChunk(5, 0);
+    size_t before = fileSize(filename);
+    REQUIRE(writer.freeSectors() > 0);
+
+    writer.compact();
+    REQUIRE(writer.freeSectors() == 0);
+    REQUIRE(writer.chunkCount() == 19);
+    REQUIRE(fileSize(filename) < before);
+    REQUIRE(fileSize(filename) == writer.sectorCount() * RegionFile::SECTOR_SIZE);
+    REQUIRE(access((filename + ".compact").c_str(), F_OK) != 0);
+
+    // Still usable afterwards
+    writer.writeChunk(5, 0, makeNoisyChunk(5, 0, 100), 300);
+    RegionFile region{filename};
+    REQUIRE(region.chunkCount() == 20);
+    for (int i = 0; i < 20; i++) {
+      CompoundTag chunk = region.readChunk(i, 0);
+      REQUIRE(chunk.get<IntTag>("xPos")->value() == i);
+      size_t size = i == 5 || i % 2 == 0 ? 100 : 3000 + i * 500;
+      REQUIRE(chunk.get<ByteArrayTag>("Noise")->value().size() == size);
+    }
+    REQUIRE(region.timestamp(3, 0) == 103);
+    REQUIRE(region.timestamp(4, 0) == 204);
+  }
+  SECTION("Damaged files") {
+    std::vector<char> bad(RegionFile::HEADER_SIZE);
+    // Past the end of the file
+    bad[2] = 100;
+    bad[3] = 1;
+    {
+      FILE* file = fopen(path, "wb");
+      fwrite(bad.data(), 1, bad.size(), file);
+      fclose(file);
+    }
+    RegionWriter writer{filename};
+    REQUIRE(writer.chunkCount() == 0);
+    writer.writeChunk(0, 0, makeNoisyChunk(0, 0, 10));
+    REQUIRE(writer.sectorCount() == 3);
+
+    FILE* file = fopen(path, "wb");
+    fwrite(bad.data(), 1, 100, file);
+    fclose(file);
+    REQUIRE_THROWS_AS(RegionWriter{filename}, NBTException);
+  }
+  unlink(path);
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_schema.hpp"
+#include "nbt_writer.hpp"
+
+
+struct Section {
+  int8_t y = 0;
+  std::vector<int64_t> blockStates;
+};
+
+struct Level {
+  int32_t x = 0;
+  int32_t z = 0;
+  std::string status;
+  std::vector<Section> sections;
+};
+
+struct Chunk {
+  int32_t dataVersion = 0;
+  Level level;
+  std::vector<double> pos;
+  std::vector<std::string> tags;
+};
+
+static constexpr auto sectionSchema = makeSchema<Section>(
+    schemaField<ByteTag>("Y", &Section::y),
+    schemaField<LongArrayTag>("BlockStates", &Section::blockStates));
+
+static constexpr auto levelSchema = makeSchema<Level>(
+    schemaField<IntTag>("xPos", &Level::x),
+    schemaField<IntTag>("zPos", &Level::z),
+    schemaField<StringTag>("Status", &Level::status),
+    schemaCompoundList("Sections", &Level::sections, sectionSchema));
+
+static constexpr auto chunkSchema = makeSchema<Chunk>(
+    schemaField<IntTag>("DataVersion", &Chunk::dataVersion),
+    schemaCompound("Level", &Chunk::level, levelSchema),
+    schemaList<DoubleTag>("Pos", &Chunk::pos),
+    schemaList<StringTag>("Tags", &Chunk::tags));
+
+static_assert(chunkSchema.indexOf("Level") == 1, "Names are matched at compile time");
+static_assert(chunkSchema.indexOf("DataVersion", 2) == 0, "The search wraps around");
+static_assert(chunkSchema.indexOf("DataVersioN") == decltype(chunkSchema)::npos,
+              "Long names are compared in full");
+
+
+static void writeChunk(NBTWriter& writer) {
+  std::vector<int64_t> blockStates{1, 2, 3};
+  writer.beginCompound("");
+  writer.writeString("Unknown", "skipped");
+  writer.beginCompound("Level");
+  writer.writeInt("zPos", -7);
+  writer.writeInt("xPos", 12);
+  writer.beginList("Sections", TagID::COMPOUND, 2);
+  for (int8_t y = 0; y < 2; y++) {
+    writer.beginCompound("");
+    writer.writeByte("Y", y);
+    writer.writeLongArray("BlockStates", blockStates.data(), blockStates.size() - y);
+    writer.beginList("Palette", TagID::STRING, 1);
+    writer.writeString("", "minecraft:air");
+    writer.endList();
+    writer.endCompound();
+  }
+  writer.endList();
+  writer.writeString("Status", "full");
+  writer.endCompound();
+  writer.beginList("Pos", TagID::DOUBLE, 3);
+  writer.writeDouble("", 1.5);
+  writer.writeDouble("", 64);
+  writer.writeDouble("", -2.5);
+  writer.endList();
+  writer.beginList("Tags", TagID::END, 0);
+  writer.endList();
+  writer.writeInt("DataVersion", 2586);
+  writer.endCompound();
+}
+
+static void checkChunk(const Chunk& chunk) {
+  REQUIRE(chunk.dataVersion == 2586);
+  REQUIRE(chunk.level.x == 12);
+  REQUIRE(chunk.level.z == -7);
+  REQUIRE(chunk.level.status == "full");
+  REQUIRE(chunk.level.sections.size() == 2);
+  REQUIRE(chunk.level.sections[1].y == 1);
+  REQUIRE(chunk.level.sections[0].blockStates == std::vector<int64_t>{1, 2, 3});
+  REQUIRE(chunk.level.sections[1].blockStates == std::vector<int64_t>{1, 2});
+  REQUIRE(chunk.pos == std::vector<double>{1.5, 64, -2.5});
+  REQUIRE(chunk.tags.empty());
+}
+
+
+TEST_CASE("Schema-bound structs", "[schema]") {
+  NBTWriter writer;
+  writeChunk(writer);
+  std::vector<char> bytes(writer.data(), writer.data() + writer.size());
+
+  SECTION("From a buffer") {
+    NBTReader reader{BufferInput{bytes}};
+    Chunk chunk = chunkSchema.read(reader);
+    REQUIRE(reader.position() == bytes.size());
+    checkChunk(chunk);
+  }
+  SECTION("From a stream") {
+    std::istringstream stream{std::string{bytes.begin(), bytes.end()}};
+    NBTReader reader{IStreamInput{stream}};
+    checkChunk(chunkSchema.read(reader));
+  }
+  SECTION("Missing children keep their value") {
+    std::vector<char> empty{0x0a, 0x00, 0x00, 0x00};
+    NBTReader reader{BufferInput{empty}};
+    Chunk chunk;
+    chunk.dataVersion = 1;
+    reader.readID();
+    reader.readName();
+    chunkSchema.readPayload(reader, chunk);
+    REQUIRE(chunk.dataVersion == 1);
+    REQUIRE(chunk.level.sections.empty());
+  }
+  SECTION("Type mismatches") {
+    NBTWriter other;
+    other.beginCompound("");
+    other.writeLong("DataVersion", 2586);
+    other.endCompound();
+    NBTReader reader{BufferInput{other.data(), other.size()}};
+    REQUIRE_THROWS_AS(chunkSchema.read(reader), NBTTagException);
+
+    other.clear();
+    other.beginCompound("");
+    other.beginList("Pos", TagID::FLOAT, 1);
+    other.writeFloat("", 1);
+    other.endList();
+    other.endCompound();
+    NBTReader listReader{BufferInput{other.data(), other.size()}};
+    REQUIRE_THROWS_AS(chunkSchema.read(listReader), NBTTagException);
+
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    REQUIRE_THROWS_AS(chunkSchema.read(file), NBTTagException);
+  }
+  SECTION("Truncated input") {
+    NBTReader reader{BufferInput{bytes.data(), bytes.size() - 10}};
+    REQUIRE_THROWS_AS(chunkSchema.read(reader), NBTException);
+  }
+}
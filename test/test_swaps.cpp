@@ -16,9 +16,12 @@
  *
  */
 
+#include <algorithm>
+
 #include "catch2/catch.hpp"
 
 #include "nbt.hpp"
+#include "nbt_swap.hpp"
 
 
 TEST_CASE("Primitive type byte-swaps", "[primitive]") {
@@ -236,3 +239,63 @@ TEST_CASE("Array type byte-swaps", "[array]") {
 #endif
   }
 }
+
+
+/*
+ * Checks swapInPlace against reversing each width-byte group by hand, for
+ * lengths that hit the vector loops and the scalar tails, at every alignment.
+ */
+static void checkBulkSwap(size_t width, void (*swapFn)(void*, size_t)) {
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t count = 0; count < 70; count++) {
+      std::vector<uint8_t> buffer(offset + count * width + 8, 0xee);
+      for (size_t i = 0; i < count * width; i++) {
+        buffer[offset + i] = static_cast<uint8_t>(i * 7 + 1);
+      }
+      std::vector<uint8_t> expected{buffer};
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+      for (size_t i = 0; i < count; i++) {
+        std::reverse(expected.begin() + offset + i * width,
+                     expected.begin() + offset + (i + 1) * width);
+      }
+#endif
+      swapFn(buffer.data() + offset, count);
+      if (buffer != expected) {
+        FAIL("width " << width << ", count " << count << ", offset " << offset);
+      }
+    }
+  }
+}
+
+TEST_CASE("Bulk byte-swaps", "[array]") {
+  SECTION("16-bit") {
+    checkBulkSwap(2, swapInPlace16);
+  }
+  SECTION("32-bit") {
+    checkBulkSwap(4, swapInPlace32);
+  }
+  SECTION("64-bit") {
+    checkBulkSwap(8, swapInPlace64);
+  }
+  SECTION("Every kernel the CPU supports") {
+    // swapInPlace only runs the kernel picked for this machine.
+    std::vector<SwapKernels> kernels = availableSwapKernels();
+    REQUIRE(!kernels.empty());
+    for (const SwapKernels& kernel : kernels) {
+      INFO(kernel.name);
+      checkBulkSwap(2, kernel.swap16);
+      checkBulkSwap(4, kernel.swap32);
+      checkBulkSwap(8, kernel.swap64);
+    }
+  }
+  SECTION("Floating point") {
+    std::vector<double> values{64.0, 1e9, -0.5};
+    std::vector<double> expected;
+    for (double value : values) {
+      expected.push_back(DoubleTag::htof(value));
+    }
+    swapInPlace(values.data(), values.size());
+    REQUIRE(std::memcmp(values.data(), expected.data(),
+                        values.size() * sizeof(double)) == 0);
+  }
+}
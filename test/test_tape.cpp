@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include "nbt_tape.hpp"
+#include "test_util.hpp"
+
+
+
+TEST_CASE("Tape representation", "[tape]") {
+  SECTION("Compound") {
+    // compound_tag.dat leaves out the root's (empty) name
+    std::vector<char> bytes = slurp("./test/data/compound_tag.dat");
+    bytes.insert(bytes.begin() + 1, 2, '\0');
+    Tape tape;
+    tape.parse(bytes.data(), bytes.size());
+    REQUIRE(tape.bytesParsed() == bytes.size());
+    // root, 3 children, list of 2 doubles
+    REQUIRE(tape.size() == 7);
+
+    TapeRef root = tape.root();
+    REQUIRE(root.id() == TagID::COMPOUND);
+    REQUIRE(root.size() == 4);
+    REQUIRE(root.next() == tape.size());
+
+    REQUIRE(root.at(0).name() == "string child");
+    REQUIRE(root.at(0).value<StringTag>() == "Hello world");
+    REQUIRE(root.at(1).value<LongTag>() == 0x7766554433221100);
+    ArrayView<int32_t> ints = root.at(2).value<IntArrayTag>();
+    REQUIRE(ints.size() == 2);
+    REQUIRE(ints[0] == 0x33221100);
+    REQUIRE(ints[1] == 0x00112233);
+
+    TapeRef list = root.find("list child");
+    REQUIRE(list);
+    REQUIRE(list.id() == TagID::LIST);
+    REQUIRE(list.elementID() == TagID::DOUBLE);
+    REQUIRE(list.size() == 2);
+    REQUIRE(list.at(0).value<DoubleTag>() == 21.33);
+    REQUIRE(list.at(1).value<DoubleTag>() == 13.37);
+    REQUIRE_THROWS(list.at(2));
+
+    REQUIRE_FALSE(root.find("missing"));
+    REQUIRE_THROWS_AS(root.at(1).value<IntTag>(), NBTTagException);
+
+    std::vector<std::string_view> names;
+    for (TapeRef child : root) {
+      names.push_back(child.name());
+    }
+    std::vector<std::string_view> expected{
+      "string child", "long child", "int array child", "list child"
+    };
+    REQUIRE(names == expected);
+  }
+  SECTION("List of compounds") {
+    std::vector<char> bytes = slurp("./test/data/list_compound_tag.dat");
+    Tape tape;
+    tape.parse(bytes.data(), bytes.size());
+    TapeRef list = tape.root();
+    REQUIRE(list.name() == "listof compound");
+    REQUIRE(list.elementID() == TagID::COMPOUND);
+    REQUIRE(list.size() == 2);
+
+    TapeRef first = list.at(0);
+    REQUIRE(first.size() == 2);
+    REQUIRE(first.find("string child").value<StringTag>() == "asdfsdfg");
+    ArrayView<int64_t> longs = first.find("long array child").value<LongArrayTag>();
+    REQUIRE(longs.at(1) == 0x08090a0b0c0d0e0f);
+
+    // Jumps over the first element's subtree
+    TapeRef second = list.at(1);
+    REQUIRE(second.index() == first.next());
+    REQUIRE(second.find("int child").value<IntTag>() == 0x01020304);
+    REQUIRE(second.find("short child2").value<ShortTag>() == 0x0708);
+  }
+  SECTION("Reuse") {
+    std::vector<char> list = slurp("./test/data/list_string_tag.dat");
+    std::vector<char> number = slurp("./test/data/float_tag.dat");
+    Tape tape;
+    tape.parse(list.data(), list.size());
+    REQUIRE(tape.root().at(2).value<StringTag>() == "C++ is a language for me and you");
+    tape.parse(number.data(), number.size());
+    REQUIRE(tape.size() == 1);
+    REQUIRE(tape.root().name() == "float tag");
+    REQUIRE(tape.root().value<FloatTag>() == 64.0f);
+  }
+  SECTION("Truncated input") {
+    std::vector<char> bytes = slurp("./test/data/ends_unexpectedly_list.dat");
+    Tape tape;
+    REQUIRE_THROWS(tape.parse(bytes.data(), bytes.size()));
+    REQUIRE(tape.empty());
+  }
+}
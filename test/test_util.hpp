@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#ifndef NBT_TEST_UTIL_HPP
+#define NBT_TEST_UTIL_HPP
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_region.hpp"
+#include "nbt_writer.hpp"
+
+
+/*
+ * Helpers shared by the test files.
+ */
+
+inline std::vector<char> slurp(std::string filename) {
+  std::ifstream file{filename, std::ios_base::in | std::ios_base::binary};
+  return std::vector<char>{std::istreambuf_iterator<char>{file},
+                           std::istreambuf_iterator<char>{}};
+}
+
+/*
+ * Compresses bytes with zlib's deflate, as gzip (windowBits 31) or zlib (15).
+ */
+inline std::vector<char> deflateBytes(const std::vector<char>& bytes, int windowBits) {
+  z_stream stream{};
+  REQUIRE(deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8,
+                       Z_DEFAULT_STRATEGY) == Z_OK);
+  std::vector<char> out(deflateBound(&stream, bytes.size()));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(bytes.data()));
+  stream.avail_in = static_cast<uInt>(bytes.size());
+  stream.next_out = reinterpret_cast<Bytef*>(out.data());
+  stream.avail_out = static_cast<uInt>(out.size());
+  REQUIRE(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  return out;
+}
+
+inline void storeBigEndian(std::vector<char>& bytes, size_t at, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    bytes[at + i] = static_cast<char>(value >> (24 - 8 * i));
+  }
+}
+
+/*
+ * A small chunk: {"xPos": x, "zPos": z, "Heights": [count longs]}
+ */
+inline std::vector<char> makeChunk(int x, int z, size_t count = 4) {
+  std::vector<int64_t> heights(count);
+  for (size_t i = 0; i < count; i++) {
+    heights[i] = static_cast<int64_t>(i) * 0x0102030405ll;
+  }
+  NBTWriter writer;
+  writer.beginCompound("");
+  writer.writeInt("xPos", x);
+  writer.writeInt("zPos", z);
+  writer.writeLongArray("Heights", heights.data(), heights.size());
+  writer.endCompound();
+  return std::vector<char>{writer.data(), writer.data() + writer.size()};
+}
+
+/*
+ * Appends a chunk to a region being built, padded to whole sectors, and
+ * points the tables at it.
+ */
+inline void addChunk(std::vector<char>& region, int x, int z, uint8_t compression,
+                     const std::vector<char>& stored, uint32_t timestamp) {
+  if (region.empty()) {
+    region.resize(RegionFile::HEADER_SIZE);
+  }
+  size_t offset = region.size() / RegionFile::SECTOR_SIZE;
+  size_t sectors = (stored.size() + 5 + RegionFile::SECTOR_SIZE - 1) / RegionFile::SECTOR_SIZE;
+  region.resize(region.size() + sectors * RegionFile::SECTOR_SIZE);
+  size_t begin = offset * RegionFile::SECTOR_SIZE;
+  storeBigEndian(region, begin, static_cast<uint32_t>(stored.size() + 1));
+  region[begin + 4] = static_cast<char>(compression);
+  std::copy(stored.begin(), stored.end(), region.begin() + begin + 5);
+  int i = RegionFile::index(x, z);
+  storeBigEndian(region, i * 4, static_cast<uint32_t>(offset << 8 | sectors));
+  storeBigEndian(region, RegionFile::SECTOR_SIZE + i * 4, timestamp);
+}
+
+/*
+ * Writes a region holding the chunks in the first count slots, zlib
+ * compressed, with absolute coordinates for a region at (regionX, regionZ).
+ * Chunk i has i % 5 heights.
+ */
+inline void writeRegion(const std::filesystem::path& path, int regionX, int regionZ,
+                        int count) {
+  std::vector<char> region(RegionFile::HEADER_SIZE);
+  for (int i = 0; i < count; i++) {
+    int x = i % RegionFile::SIDE;
+    int z = i / RegionFile::SIDE;
+    std::vector<char> raw = makeChunk(regionX * 32 + x, regionZ * 32 + z, i % 5);
+    addChunk(region, x, z, RegionFile::ZLIB, deflateBytes(raw, 15), 0);
+  }
+  std::ofstream file{path, std::ios_base::out | std::ios_base::binary};
+  file.write(region.data(), region.size());
+}
+
+
+#endif // NBT_TEST_UTIL_HPP
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include "catch2/catch.hpp"
+
+#include "nbt_value.hpp"
+#include "nbt_writer.hpp"
+#include "test_util.hpp"
+
+
+/**
+ * Counts a value and everything below it, by type.
+ */
+static void countValues(const Value& value, std::vector<int>& counts) {
+  counts.at(static_cast<size_t>(value.id()))++;
+  value.visit([&](const auto& v) {
+    using V = std::decay_t<decltype(v)>;
+    if constexpr (std::is_same<V, ValueList>::value) {
+      for (const Value& element : v.elements) {
+        countValues(element, counts);
+      }
+    }
+    else if constexpr (std::is_same<V, ValueCompound>::value) {
+      for (const ValueCompound::Member& member : v.members) {
+        countValues(member.second, counts);
+      }
+    }
+  });
+}
+
+
+TEST_CASE("Variant tag values", "[value]") {
+  SECTION("Types follow TagIDs") {
+    REQUIRE(Value{}.id() == TagID::END);
+    REQUIRE(Value{int8_t{1}}.id() == TagID::BYTE);
+    REQUIRE(Value{int16_t{1}}.id() == TagID::SHORT);
+    REQUIRE(Value{1}.id() == TagID::INT);
+    REQUIRE(Value{int64_t{1}}.id() == TagID::LONG);
+    REQUIRE(Value{1.0f}.id() == TagID::FLOAT);
+    REQUIRE(Value{1.0}.id() == TagID::DOUBLE);
+    REQUIRE(Value{std::string{"a"}}.id() == TagID::STRING);
+    REQUIRE(Value{std::vector<int32_t>{1, 2}}.id() == TagID::INT_ARRAY);
+    REQUIRE(Value{ValueCompound{}}.id() == TagID::COMPOUND);
+    REQUIRE(Value::of<ShortTag>(5).id() == TagID::SHORT);
+    REQUIRE(Value::of<LongArrayTag>({1, 2, 3}).get<LongArrayTag>().size() == 3);
+
+    Value value = Value::of<IntTag>(42);
+    REQUIRE(value.is<IntTag>());
+    REQUIRE(!value.is<LongTag>());
+    REQUIRE(value.get<IntTag>() == 42);
+    value.get<IntTag>()++;
+    REQUIRE(*value.getIf<IntTag>() == 43);
+    REQUIRE(value.getIf<ShortTag>() == nullptr);
+    REQUIRE_THROWS_AS(value.get<StringTag>(), NBTTagException);
+    REQUIRE_THROWS_AS(value.list(), NBTTagException);
+    REQUIRE_THROWS_AS(value.compound(), NBTTagException);
+  }
+  SECTION("Compounds") {
+    std::vector<char> bytes = slurp("./test/data/compound_tag.dat");
+    bytes.insert(bytes.begin() + 1, 2, '\0');
+    NBTReader reader{BufferInput{bytes}};
+    ValueCompound::Member root = readNamedValue(reader);
+    REQUIRE(reader.position() == bytes.size());
+    REQUIRE(root.first == "");
+
+    ValueCompound& compound = root.second.compound();
+    REQUIRE(compound.members.size() == 4);
+    REQUIRE(compound.members[0].second.get<StringTag>() == "Hello world");
+    REQUIRE(compound.members[1].second.get<LongTag>() == 0x7766554433221100);
+    REQUIRE(compound.members[2].second.get<IntArrayTag>() ==
+            std::vector<int32_t>{0x33221100, 0x00112233});
+    const ValueList& list = compound.find("list child")->list();
+    REQUIRE(list.elementID == TagID::DOUBLE);
+    REQUIRE(list.elements.size() == 2);
+    REQUIRE(list.elements[1].get<DoubleTag>() == 13.37);
+    REQUIRE(compound.find("missing") == nullptr);
+
+    std::vector<int> counts(13);
+    countValues(root.second, counts);
+    REQUIRE(counts == std::vector<int>{0, 0, 0, 0, 1, 0, 2, 0, 1, 1, 1, 1, 0});
+
+    // Written back out, it is the same bytes, and the same as the tag
+    // classes give.
+    NBTWriter writer;
+    writer.writeValue(root.first, root.second);
+    REQUIRE(std::vector<char>(writer.data(), writer.data() + writer.size()) == bytes);
+
+    NBTReader tagReader{BufferInput{bytes}};
+    tagReader.readID();
+    Value converted = toValue(tagReader.readCompoundTag());
+    NBTWriter convertedWriter;
+    convertedWriter.writeValue("", converted);
+    REQUIRE(std::vector<char>(convertedWriter.data(),
+                              convertedWriter.data() + convertedWriter.size()) == bytes);
+
+    compound.set("list child", Value{int8_t{3}});
+    compound.set("new", Value{std::string{"child"}});
+    REQUIRE(compound.members.size() == 5);
+    REQUIRE(compound.members[3].second.get<ByteTag>() == 3);
+  }
+  SECTION("Lists of compounds, from a stream") {
+    NBTFile file{"./test/data/list_compound_tag.dat"};
+    ValueCompound::Member root = readNamedValue(file);
+    REQUIRE(root.first == "listof compound");
+    const ValueList& list = root.second.list();
+    REQUIRE(list.elementID == TagID::COMPOUND);
+    REQUIRE(list.elements.size() == 2);
+    REQUIRE(list.elements[0].compound().find("long array child")->get<LongArrayTag>() ==
+            std::vector<int64_t>{0x0001020304050607, 0x08090a0b0c0d0e0f});
+    REQUIRE(list.elements[1].compound().find("short child2")->get<ShortTag>() == 0x0708);
+  }
+  SECTION("Lists must hold their element type") {
+    ValueList list;
+    list.elementID = TagID::INT;
+    list.elements.push_back(Value{1});
+    list.elements.push_back(Value{int64_t{2}});
+    NBTWriter writer;
+    REQUIRE_THROWS_AS(writer.writeValue("list", Value{std::move(list)}), NBTTagException);
+  }
+  SECTION("Truncated input") {
+    std::vector<char> bytes = slurp("./test/data/ends_unexpectedly_compound.dat");
+    NBTReader reader{BufferInput{bytes}};
+    REQUIRE_THROWS_AS(readNamedValue(reader), NBTException);
+  }
+}
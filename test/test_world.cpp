@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_pool.hpp"
+#include "nbt_region.hpp"
+#include "nbt_world.hpp"
+#include "nbt_writer.hpp"
+#include "test_util.hpp"
+
+
+TEST_CASE("Work-stealing pool", "[world]") {
+  SECTION("Nested tasks all run before wait returns") {
+    WorkStealingPool pool{4};
+    REQUIRE(pool.size() == 4);
+    // Catch's assertions aren't thread-safe, so tasks only record results.
+    std::atomic<int> sum{0};
+    std::atomic<unsigned> maxWorker{0};
+    for (int i = 0; i < 10; i++) {
+      pool.submit([&pool, &sum, &maxWorker](unsigned worker) {
+        maxWorker = std::max(maxWorker.load(), worker);
+        for (int j = 0; j < 100; j++) {
+          pool.submit([&sum, j](unsigned) { sum += j; });
+        }
+      });
+    }
+    pool.wait();
+    REQUIRE(sum == 10 * 4950);
+    REQUIRE(maxWorker < 4);
+    // Reusable after a wait
+    pool.submit([&sum](unsigned) { sum = 0; });
+    pool.wait();
+    REQUIRE(sum == 0);
+  }
+  SECTION("Exceptions reach wait") {
+    WorkStealingPool pool{2};
+    std::atomic<int> ran{0};
+    for (int i = 0; i < 20; i++) {
+      pool.submit([&ran, i](unsigned) {
+        ran++;
+        if (i == 7) {
+          throw std::runtime_error{"task failed"};
+        }
+      });
+    }
+    REQUIRE_THROWS_AS(pool.wait(), std::runtime_error);
+    REQUIRE(ran == 20);
+    pool.wait();
+  }
+}
+
+TEST_CASE("Scanning worlds", "[world]") {
+  namespace fs = std::filesystem;
+  char temp[] = "/tmp/nbt_world_XXXXXX";
+  REQUIRE(mkdtemp(temp) != nullptr);
+  fs::path world{temp};
+  fs::create_directories(world / "region");
+  fs::create_directories(world / "DIM-1" / "region");
+  fs::create_directories(world / "entities");
+  writeRegion(world / "region" / "r.0.0.mca", 0, 0, 1024);
+  writeRegion(world / "region" / "r.-1.2.mca", -1, 2, 40);
+  writeRegion(world / "DIM-1" / "region" / "r.3.-4.mca", 3, -4, 5);
+  // Not chunk regions
+  writeRegion(world / "entities" / "r.0.0.mca", 0, 0, 5);
+  std::ofstream{world / "region" / "r.0.0.mca.bak"} << "junk";
+  std::ofstream{world / "level.dat"} << "junk";
+
+  std::vector<std::string> regions = findRegionFiles(world.string());
+  REQUIRE(regions.size() == 3);
+  REQUIRE(fs::path{regions[0]}.filename() == "r.3.-4.mca");
+  REQUIRE(regions == findRegionFiles(world.string()));
+  REQUIRE(findRegionFiles((world / "region").string()).size() == 2);
+  REQUIRE_THROWS_AS(findRegionFiles((world / "level.dat").string()), NBTException);
+
+  SECTION("Every chunk once, with its coordinates") {
+    for (unsigned threads : {1u, 3u}) {
+      WorldScanner scanner{threads};
+      REQUIRE(scanner.threads() == threads);
+      std::mutex mutex;
+      std::map<std::pair<int, int>, int> seen;
+      std::atomic<int> mismatched{0};
+      ScanStats stats = scanner.scan(regions, [&](const ChunkInfo& chunk, const Document& doc) {
+        if (doc.root().find("xPos")->value<IntTag>() != chunk.x ||
+            doc.root().find("zPos")->value<IntTag>() != chunk.z) {
+          mismatched++;
+        }
+        std::lock_guard<std::mutex> lock{mutex};
+        seen[{chunk.x, chunk.z}]++;
+      });
+      REQUIRE(mismatched == 0);
+      REQUIRE(stats.regions == 3);
+      REQUIRE(stats.chunks == 1069);
+      REQUIRE(stats.errors == 0);
+      REQUIRE(stats.compressedBytes > 0);
+      REQUIRE(stats.bytes > stats.compressedBytes);
+      REQUIRE(seen.size() == 1069);
+      REQUIRE(seen.at({-32 + 7, 64 + 1}) == 1);
+      REQUIRE(seen.at({96 + 4, -128}) == 1);
+    }
+  }
+  SECTION("Reductions") {
+    WorldScanner scanner{4};
+    ScanStats stats;
+    auto sections = scanner.reduce(regions, std::vector<size_t>(5),
+        [](std::vector<size_t>& counts, const ChunkInfo&, const Document& doc) {
+          counts[doc.root().find("Heights")->size()]++;
+        },
+        [](std::vector<size_t>& counts, std::vector<size_t> other) {
+          for (size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other[i];
+          }
+        },
+        &stats);
+    REQUIRE(stats.chunks == 1069);
+    REQUIRE(sections[0] == 205 + 8 + 1);
+    REQUIRE(sections[4] == 204 + 8 + 1);
+  }
+  SECTION("Errors") {
+    // Truncate one region's last chunk, and make another unreadable.
+    fs::path last = world / "region" / "r.-1.2.mca";
+    fs::resize_file(last, fs::file_size(last) - RegionFile::SECTOR_SIZE);
+    fs::path broken = world / "DIM-1" / "region" / "r.3.-4.mca";
+    fs::resize_file(broken, 100);
+
+    WorldScanner scanner{2};
+    std::mutex mutex;
+    std::vector<std::pair<int, int>> errors;
+    scanner.onError([&](const ChunkInfo& chunk, const NBTException&) {
+      std::lock_guard<std::mutex> lock{mutex};
+      errors.push_back({chunk.x, chunk.z});
+    });
+    ScanStats stats = scanner.scan(regions, [](const ChunkInfo&, const Document&) { });
+    REQUIRE(stats.regions == 2);
+    REQUIRE(stats.chunks == 1024 + 39);
+    REQUIRE(stats.errors == 2);
+    std::sort(errors.begin(), errors.end());
+    REQUIRE(errors == std::vector<std::pair<int, int>>{{-32 + 7, 64 + 1}, {96, -128}});
+
+    // A chunk that inflates past the limit is an error, not an allocation
+    // without end.
+    {
+      std::vector<int8_t> zeros(RegionFile::MAX_INFLATED_SIZE + 1);
+      NBTWriter chunk;
+      chunk.beginCompound("");
+      chunk.writeByteArray("Padding", zeros.data(), zeros.size());
+      chunk.endCompound();
+      RegionWriter writer{last.string()};
+      writer.writeChunk(0, 0, chunk);
+    }
+    REQUIRE_THROWS_AS(RegionFile{last.string()}.readChunk(0, 0), NBTException);
+    errors.clear();
+    stats = scanner.scan(regions, [](const ChunkInfo&, const Document&) { });
+    REQUIRE(stats.errors == 3);
+    std::sort(errors.begin(), errors.end());
+    REQUIRE(errors == std::vector<std::pair<int, int>>{
+      {-32, 64}, {-32 + 7, 64 + 1}, {96, -128}});
+
+    REQUIRE_THROWS_AS(scanner.scan(regions, [](const ChunkInfo& chunk, const Document&) {
+      if (chunk.x == 10) {
+        throw std::runtime_error{"callback failed"};
+      }
+    }), std::runtime_error);
+  }
+  fs::remove_all(world);
+}
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2019  Zack Marvel
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <sstream>
+
+#include "catch2/catch.hpp"
+
+#include "nbt_writer.hpp"
+#include "test_util.hpp"
+
+
+static std::vector<char> contents(const NBTWriter& writer) {
+  return std::vector<char>{writer.data(), writer.data() + writer.size()};
+}
+
+
+TEST_CASE("Writing trees", "[writer]") {
+  SECTION("Round trips") {
+    for (const char* filename : {
+        "byte_tag", "short_tag", "int_tag", "long_tag", "float_tag",
+        "double_tag", "string_tag", "byte_array_tag", "int_array_tag",
+        "long_array_tag", "list_byte_tag", "list_string_tag",
+        "list_compound_tag", "compound_tag"}) {
+      std::string path = std::string{"./test/data/"} + filename + ".dat";
+      INFO(path);
+      std::vector<char> bytes = slurp(path);
+      if (std::string{filename} == "compound_tag") {
+        // compound_tag.dat leaves out the root's (empty) name
+        bytes.insert(bytes.begin() + 1, 2, '\0');
+      }
+      NBTReader reader{BufferInput{bytes}};
+      TagID id = reader.readID();
+      std::shared_ptr<TagBase> tag = reader.readPayload(id, reader.readName());
+
+      NBTWriter writer;
+      writer.writeTag(*tag);
+      REQUIRE(writer.complete());
+      REQUIRE(contents(writer) == bytes);
+    }
+  }
+  SECTION("Built trees") {
+    CompoundTag root{"root"};
+    root.push_back(IntTag{"int", -2});
+    root.push_back(LongArrayTag{"longs", {1, -1, 0x0102030405060708}});
+    CompoundTag child{"child"};
+    child.push_back(StringTag{"string", "value"});
+    root.push_back(std::move(child));
+    ListTag<FloatTag> floats{"floats", 2};
+    floats.push_back(FloatTag{"", 1.5f});
+    floats.push_back(FloatTag{"", -0.25f});
+    root.push_back(std::move(floats));
+
+    NBTWriter writer;
+    writer.writeTag(root);
+    NBTReader reader{BufferInput{writer.data(), writer.size()}};
+    REQUIRE(reader.readID() == TagID::COMPOUND);
+    CompoundTag copy = reader.readCompoundTag();
+    REQUIRE(reader.position() == writer.size());
+    REQUIRE(copy.name() == "root");
+    REQUIRE(copy.get<IntTag>("int")->value() == -2);
+    REQUIRE(copy.get<LongArrayTag>("longs")->value() ==
+            std::vector<int64_t>{1, -1, 0x0102030405060708});
+    REQUIRE(copy.get<CompoundTag>("child")->get<StringTag>("string")->value() == "value");
+    REQUIRE(copy.get<ListTag<FloatTag>>("floats")->value() == std::vector<float>{1.5f, -0.25f});
+  }
+  SECTION("Writing to a stream") {
+    std::vector<char> bytes = slurp("./test/data/int_tag.dat");
+    NBTReader reader{BufferInput{bytes}};
+    reader.readID();
+    NBTWriter writer;
+    writer.writeTag(reader.readTag<IntTag>());
+    std::ostringstream out;
+    writer.writeTo(out);
+    REQUIRE(out.str() == std::string(bytes.data(), bytes.size()));
+  }
+}
+
+
+TEST_CASE("Streaming builder", "[writer]") {
+  SECTION("Matches a file") {
+    NBTWriter writer;
+    writer.beginList("listof compound", TagID::COMPOUND, 2);
+    writer.beginCompound("ignored");
+    writer.writeString("string child", "asdfsdfg");
+    std::vector<int64_t> longs{0x0001020304050607, 0x08090a0b0c0d0e0f};
+    writer.writeLongArray("long array child", longs.data(), longs.size());
+    writer.endCompound();
+    writer.beginCompound("");
+    writer.writeInt("int child", 0x01020304);
+    writer.writeShort("short child", 0x0506);
+    writer.writeShort("short child2", 0x0708);
+    writer.endCompound();
+    REQUIRE(!writer.complete());
+    writer.endList();
+    REQUIRE(writer.complete());
+    REQUIRE(contents(writer) == slurp("./test/data/list_compound_tag.dat"));
+  }
+  SECTION("Trees inside lists") {
+    NBTWriter writer;
+    writer.beginList("list", TagID::COMPOUND, 1);
+    CompoundTag element;
+    element.push_back(ByteTag{"byte", 7});
+    writer.writeTag(element);
+    writer.endList();
+
+    NBTReader reader{BufferInput{writer.data(), writer.size()}};
+    REQUIRE(reader.readID() == TagID::LIST);
+    ListTag<CompoundTag> list = reader.readTagList<CompoundTag>();
+    REQUIRE(list.value().size() == 1);
+    REQUIRE(list.at(0).get<ByteTag>("byte")->value() == 7);
+  }
+  SECTION("Misuse") {
+    NBTWriter writer;
+    REQUIRE_THROWS_AS(writer.endCompound(), NBTException);
+    writer.beginList("list", TagID::INT, 1);
+    REQUIRE_THROWS_AS(writer.writeShort("", 1), NBTTagException);
+    REQUIRE_THROWS_AS(writer.endList(), NBTException);
+    writer.writeInt("", 1);
+    REQUIRE_THROWS_AS(writer.writeInt("", 2), NBTException);
+    REQUIRE_THROWS_AS(writer.endCompound(), NBTException);
+    writer.endList();
+    REQUIRE_THROWS_AS(writer.writeName(std::string(70000, 'x')), NBTException);
+  }
+  SECTION("Growing the buffer") {
+    NBTWriter writer;
+    std::vector<int32_t> ints(100000);
+    for (size_t i = 0; i < ints.size(); i++) {
+      ints[i] = static_cast<int32_t>(i * 2654435761u);
+    }
+    writer.beginCompound("");
+    for (int i = 0; i < 3; i++) {
+      writer.writeIntArray("ints" + std::to_string(i), ints.data(), ints.size());
+    }
+    writer.endCompound();
+
+    NBTReader reader{BufferInput{writer.data(), writer.size()}};
+    reader.readID();
+    CompoundTag root = reader.readCompoundTag();
+    REQUIRE(root.size() == 3);
+    REQUIRE(root.get<IntArrayTag>("ints2")->value() == ints);
+  }
+}
+
+
+TEST_CASE("Gathering arrays", "[writer]") {
+  CompoundTag root{"root"};
+  std::vector<int64_t> longs(1000);
+  std::vector<int8_t> bytes(5000);
+  for (size_t i = 0; i < longs.size(); i++) {
+    longs[i] = static_cast<int64_t>(i * 0x0101010101010101ull);
+  }
+  for (size_t i = 0; i < bytes.size(); i++) {
+    bytes[i] = static_cast<int8_t>(i);
+  }
+  root.push_back(LongArrayTag{"longs", longs});
+  root.push_back(IntTag{"between", 5});
+  root.push_back(ByteArrayTag{"bytes", bytes});
+  root.push_back(ByteArrayTag{"small", {1, 2, 3}});
+
+  NBTWriter copied;
+  copied.writeTag(root);
+  std::vector<char> expected = contents(copied);
+
+  NBTWriter writer;
+  writer.setGatherThreshold(1024);
+  auto gathered = [&]() {
+    std::vector<char> out;
+    for (const struct iovec& segment : writer.segments()) {
+      const char* base = static_cast<const char*>(segment.iov_base);
+      out.insert(out.end(), base, base + segment.iov_len);
+    }
+    return out;
+  };
+
+  writer.writeTag(root);
+  REQUIRE(writer.size() == expected.size());
+  REQUIRE(gathered() == expected);
+  // Header, longs, int and header, bytes, small array and end
+  std::vector<struct iovec> segments = writer.segments();
+  REQUIRE(segments.size() == 5);
+  REQUIRE(segments[1].iov_len == longs.size() * sizeof(int64_t));
+  // Single bytes never need swapping, so they're written from the tag itself.
+  auto tag = root.get<ByteArrayTag>("bytes");
+  REQUIRE(segments[3].iov_base == tag->value().data());
+
+  SECTION("Reusing the writer") {
+    writer.clear();
+    REQUIRE(writer.size() == 0);
+    REQUIRE(writer.segments().empty());
+    writer.writeTag(root);
+    REQUIRE(gathered() == expected);
+  }
+  SECTION("Streams") {
+    std::ostringstream out;
+    writer.writeTo(out);
+    REQUIRE(out.str() == std::string(expected.data(), expected.size()));
+  }
+  SECTION("writev") {
+    FILE* file = tmpfile();
+    REQUIRE(file != nullptr);
+    int fd = fileno(file);
+    writer.writeTo(fd);
+    REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+    NBTReader reader{FdInput{fd}};
+    REQUIRE(reader.readID() == TagID::COMPOUND);
+    CompoundTag copy = reader.readCompoundTag();
+    REQUIRE(copy.get<LongArrayTag>("longs")->value() == longs);
+    REQUIRE(copy.get<ByteArrayTag>("bytes")->value() == bytes);
+    REQUIRE(copy.get<IntTag>("between")->value() == 5);
+    fclose(file);
+  }
+}